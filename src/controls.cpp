@@ -1,5 +1,6 @@
 #include <SFML/Graphics.hpp>
 
+#include <algorithm>
 #include <string>
 #include <sstream>
 #include <iomanip>
@@ -42,7 +43,7 @@ void Param::update(float dt)
     }
 }
 
-ControlsDisplay::ControlsDisplay(FluidSandbox &sandbox, unsigned int width) : sandbox_(sandbox), width_(width)
+ControlsDisplay::ControlsDisplay(const SimulationParameters &params, unsigned int width) : sim_params_(params), width_(width)
 {
     std::string font_path; // To allow for running from different directories
     if (std::filesystem::exists(FONT_PATH_FROM_BUILD))
@@ -65,32 +66,43 @@ ControlsDisplay::ControlsDisplay(FluidSandbox &sandbox, unsigned int width) : sa
     {
         throw std::runtime_error("Failed to load font");
     }
-    params_.emplace_back(Param{"Sim Speed", '1', SIMULATION_SPEED_DEFAULT, sandbox_.params().simulation_speed, 50.0f, 0.01f, 100.0f});
-    params_.emplace_back(Param{"Gravity X", '2', GRAVITY_X_DEFAULT, sandbox_.params().gravity_x, 0.5f});
-    params_.emplace_back(Param{"Gravity Y", '3', GRAVITY_Y_DEFAULT, sandbox_.params().gravity_y, 0.5f});
-    params_.emplace_back(Param{"Edge Bounciness", '4', EDGE_BOUNCINESS_DEFAULT, sandbox_.params().edge_bounciness, 0.5f, 0.0f, 1.0f});
-    params_.emplace_back(Param{"Interaction Radius", '5', INTERACTION_RADIUS_DEFAULT, sandbox_.params().interaction_radius, 20.0f, 0.0f});
-    params_.emplace_back(Param{"Rest Density", '6', REST_DENSITY_DEFAULT, sandbox_.params().rest_density, 5.0f, 0.0f, 10.0f});
-    params_.emplace_back(Param{"Stiffness", '7', STIFFNESS_DEFAULT, sandbox_.params().stiffness, 0.5f, 0.0f});
-    params_.emplace_back(Param{"Near Stiffness", '8', NEAR_STIFFNESS_DEFAULT, sandbox_.params().near_stiffness, 0.5f, 0.0f});
-    params_.emplace_back(Param{"Linear Viscosity", '9', LINEAR_VISCOSITY_DEFAULT, sandbox_.params().linear_viscosity, 0.5f, 0.0f});
-    params_.emplace_back(Param{"Quad Viscosity", '0', QUADRATIC_VISCOSITY_DEFAULT, sandbox_.params().quadratic_viscosity, 0.5f, 0.0f});
-    params_.emplace_back(Param{"Plasticity", 'Q', PLASTICITY_DEFAULT, sandbox_.params().plasticity, 0.5f, 0.2f, 1.0f});
-    params_.emplace_back(Param{"Yield Ratio", 'W', YIELD_RATIO_DEFAULT, sandbox_.params().yield_ratio, 0.2f, 0.0f, 1.0f});
-    params_.emplace_back(Param{"Spring Stiffness", 'E', SPRING_STIFFNESS_DEFAULT, sandbox_.params().spring_stiffness, 0.5f, 0.0f, 1.0f});
-    params_.emplace_back(Param{"Control Radius", 'R', CONTROL_RADIUS_DEFAULT, sandbox_.params().control_radius, 50.0f, 0.01f});
-    params_.emplace_back(Param{"Spawn Rate", 'T', PARTICLE_SPAWN_RATE_DEFAULT, sandbox_.params().particle_spawn_rate, 5.0f, 0.01f});
-    params_.emplace_back(Param{"Object Radius", 'Y', OBJECT_RADIUS_DEFAULT, sandbox_.params().object_radius, 50.0f, 0.01f});
-    params_.emplace_back(Param{"Object Mass", 'U', OBJECT_MASS_DEFAULT, sandbox_.params().object_mass, 5.0f, 0.01f});
-    params_.emplace_back(Param{"Base Size", 'I', BASE_PARTICLE_SIZE_DEFAULT, sandbox_.params().base_particle_size, 5.0f, 0.0f});
-    params_.emplace_back(Param{"Stress Size Mult", 'O', PARTICLE_STRESS_SIZE_MULTIPLIER_DEFAULT, sandbox_.params().particle_stress_size_multiplier, 5.0f, 0.0f});
-    params_.emplace_back(Param{"Base Color", 'P', BASE_PARTICLE_COLOR_DEFAULT, sandbox_.params().base_particle_color, 50.0f, 0.0f});
-    params_.emplace_back(Param{"Stress Color Mult", 'A', PARTICLE_STRESS_COLOR_MULTIPLIER_DEFAULT, sandbox_.params().particle_stress_color_multiplier, 50.0f, 0.0f});
+    params_.emplace_back(Param{"Sim Speed", '1', SIMULATION_SPEED_DEFAULT, sim_params_.simulation_speed, 50.0f, 0.01f, 100.0f});
+    params_.emplace_back(Param{"Substeps", 'S', SUBSTEPS_DEFAULT, sim_params_.substeps, 2.0f, 1.0f, 8.0f});
+    params_.emplace_back(Param{"Gravity X", '2', GRAVITY_X_DEFAULT, sim_params_.gravity_x, 0.5f});
+    params_.emplace_back(Param{"Gravity Y", '3', GRAVITY_Y_DEFAULT, sim_params_.gravity_y, 0.5f});
+    params_.emplace_back(Param{"Edge Bounciness", '4', EDGE_BOUNCINESS_DEFAULT, sim_params_.edge_bounciness, 0.5f, 0.0f, 1.0f});
+    params_.emplace_back(Param{"Interaction Radius", '5', INTERACTION_RADIUS_DEFAULT, sim_params_.interaction_radius, 20.0f, 0.0f});
+    params_.emplace_back(Param{"Rest Density", '6', REST_DENSITY_DEFAULT, sim_params_.rest_density, 5.0f, 0.0f, 10.0f});
+    params_.emplace_back(Param{"Stiffness", '7', STIFFNESS_DEFAULT, sim_params_.stiffness, 0.5f, 0.0f});
+    params_.emplace_back(Param{"Near Stiffness", '8', NEAR_STIFFNESS_DEFAULT, sim_params_.near_stiffness, 0.5f, 0.0f});
+    params_.emplace_back(Param{"Linear Viscosity", '9', LINEAR_VISCOSITY_DEFAULT, sim_params_.linear_viscosity, 0.5f, 0.0f});
+    params_.emplace_back(Param{"Quad Viscosity", '0', QUADRATIC_VISCOSITY_DEFAULT, sim_params_.quadratic_viscosity, 0.5f, 0.0f});
+    params_.emplace_back(Param{"Plasticity", 'Q', PLASTICITY_DEFAULT, sim_params_.plasticity, 0.5f, 0.2f, 1.0f});
+    params_.emplace_back(Param{"Yield Ratio", 'W', YIELD_RATIO_DEFAULT, sim_params_.yield_ratio, 0.2f, 0.0f, 1.0f});
+    params_.emplace_back(Param{"Spring Stiffness", 'E', SPRING_STIFFNESS_DEFAULT, sim_params_.spring_stiffness, 0.5f, 0.0f, 1.0f});
+    params_.emplace_back(Param{"Control Radius", 'R', CONTROL_RADIUS_DEFAULT, sim_params_.control_radius, 50.0f, 0.01f});
+    params_.emplace_back(Param{"Spawn Rate", 'T', PARTICLE_SPAWN_RATE_DEFAULT, sim_params_.particle_spawn_rate, 5.0f, 0.01f});
+    params_.emplace_back(Param{"Object Radius", 'Y', OBJECT_RADIUS_DEFAULT, sim_params_.object_radius, 50.0f, 0.01f});
+    params_.emplace_back(Param{"Object Mass", 'U', OBJECT_MASS_DEFAULT, sim_params_.object_mass, 5.0f, 0.01f});
+    params_.emplace_back(Param{"Base Size", 'I', BASE_PARTICLE_SIZE_DEFAULT, sim_params_.base_particle_size, 5.0f, 0.0f});
+    params_.emplace_back(Param{"Stress Size Mult", 'O', PARTICLE_STRESS_SIZE_MULTIPLIER_DEFAULT, sim_params_.particle_stress_size_multiplier, 5.0f, 0.0f});
+    params_.emplace_back(Param{"Base Color", 'P', BASE_PARTICLE_COLOR_DEFAULT, sim_params_.base_particle_color, 50.0f, 0.0f});
+    params_.emplace_back(Param{"Stress Color Mult", 'A', PARTICLE_STRESS_COLOR_MULTIPLIER_DEFAULT, sim_params_.particle_stress_color_multiplier, 50.0f, 0.0f});
 }
 
 void ControlsDisplay::update(float dt)
 {
     dt_ = dt;
+    frame_times_.push(dt);
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::K)) // Only toggle on key release
+    {
+        timings_key_pressed_ = true;
+    }
+    else if (timings_key_pressed_)
+    {
+        timings_key_pressed_ = false;
+        show_timings_ = !show_timings_;
+    }
     for (auto &param : params_)
     {
         param.update(dt);
@@ -100,7 +112,7 @@ void ControlsDisplay::update(float dt)
 void ControlsDisplay::draw_text(const std::string &text, sf::Text::Style style, sf::RenderTarget &target, sf::Text &text_template, float &y_offset) const
 {
     text_template.setString(text);
-    text_template.setPosition({sandbox_.size().x + TEXT_X_OFFSET, std::round(y_offset)});
+    text_template.setPosition({left() + TEXT_X_OFFSET, std::round(y_offset)});
     text_template.setStyle(style);
     target.draw(text_template);
     y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
@@ -112,7 +124,7 @@ void ControlsDisplay::draw_info(const std::string &text, float value, sf::Render
     text_template.setStyle(sf::Text::Regular);
     ss << text << ": " << std::fixed << std::setprecision(2) << value;
     text_template.setString(ss.str());
-    text_template.setPosition({sandbox_.size().x + TEXT_X_OFFSET, std::round(y_offset)});
+    text_template.setPosition({left() + TEXT_X_OFFSET, std::round(y_offset)});
     target.draw(text_template);
     y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
 }
@@ -124,15 +136,54 @@ void ControlsDisplay::draw_info(const Param &param, sf::RenderTarget &target, sf
     ss << param.name << " (key: " << param.key << ")"
        << ": " << std::fixed << std::setprecision(2) << param.value;
     text_template.setString(ss.str());
-    text_template.setPosition({sandbox_.size().x + TEXT_X_OFFSET, std::round(y_offset)});
+    text_template.setPosition({left() + TEXT_X_OFFSET, std::round(y_offset)});
     target.draw(text_template);
     y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
 }
 
+void ControlsDisplay::draw_timing(const std::string &text, const TimingHistory &history, sf::RenderTarget &target, sf::Text &text_template, float &y_offset) const
+{
+    std::stringstream ss;
+    text_template.setStyle(sf::Text::Regular);
+    ss << text << ": " << std::fixed << std::setprecision(2) << history.mean() * 1000.0 << " / " << history.percentile(99.0) * 1000.0;
+    text_template.setString(ss.str());
+    text_template.setPosition({left() + TEXT_X_OFFSET, std::round(y_offset)});
+    target.draw(text_template);
+    y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
+}
+
+void ControlsDisplay::draw_frame_graph(sf::RenderTarget &target, float &y_offset) const
+{
+    const float graph_left = left() + TEXT_X_OFFSET;
+    const float width = static_cast<float>(width_) - 2 * TEXT_X_OFFSET;
+    const float bottom = y_offset + FRAME_GRAPH_HEIGHT;
+
+    sf::RectangleShape graph_bg({width, FRAME_GRAPH_HEIGHT});
+    graph_bg.setPosition({graph_left, y_offset});
+    graph_bg.setFillColor(sf::Color(224, 224, 224));
+    target.draw(graph_bg);
+
+    // Newest frame on the right, scaled so the slowest frame still fits
+    const double scale = std::max(frame_times_.max(), FRAME_GRAPH_MIN_SCALE);
+    const size_t count = frame_times_.size();
+    frame_graph_vertices_.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float x = graph_left + width * static_cast<float>(TIMING_HISTORY_SIZE - count + i) / static_cast<float>(TIMING_HISTORY_SIZE - 1);
+        const float y = bottom - FRAME_GRAPH_HEIGHT * static_cast<float>(frame_times_.at(i) / scale);
+        frame_graph_vertices_[i].position = {x, y};
+        frame_graph_vertices_[i].color = sf::Color::Black;
+    }
+    target.draw(frame_graph_vertices_.data(), count, sf::PrimitiveType::LineStrip);
+    y_offset = bottom + static_cast<float>(FONT_SIZE) * (LINE_SPACING - 1.0f);
+}
+
 void ControlsDisplay::draw(sf::RenderTarget &target, sf::RenderStates states) const
 {
+    if (state_ == nullptr)
+        return;
     sf::RectangleShape sidebar_bg({static_cast<float>(width_), static_cast<float>(target.getSize().y)});
-    sidebar_bg.setPosition({static_cast<float>(sandbox_.size().x), 0.0f});
+    sidebar_bg.setPosition({left(), 0.0f});
     sidebar_bg.setFillColor(sf::Color(192, 192, 192));
     target.draw(sidebar_bg);
 
@@ -145,23 +196,49 @@ void ControlsDisplay::draw(sf::RenderTarget &target, sf::RenderStates states) co
     draw_text("Runtime Stats", sf::Text::Bold, target, text_template, y_offset);
     y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
 
-    draw_info("Particles", static_cast<float>(sandbox_.particle_count()), target, text_template, y_offset);
-    draw_info("Objects", static_cast<float>(sandbox_.object_count()), target, text_template, y_offset);
+    draw_info("Particles", static_cast<float>(state_->particle_count()), target, text_template, y_offset);
+    draw_info("Objects", static_cast<float>(state_->objects.size()), target, text_template, y_offset);
     draw_info("Frame Rate", 1 / dt_, target, text_template, y_offset);
+    draw_frame_graph(target, y_offset);
 
-    y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
-    draw_text("Controls", sf::Text::Bold, target, text_template, y_offset);
-    y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
+    if (show_timings_) // The breakdown continues the runtime stats
+    {
+        draw_text("Mean / p99 (ms)", sf::Text::Regular, target, text_template, y_offset);
 
-    draw_text("<key> & '+' or '-' to Adjust Param", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("<key> & 'backspace' to Reset Param", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("LMB to Grab and Move Objects", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("D - Spawn Particles", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("F - Delete Particles", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("G - Spawn an Object", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("H - Delete an Object", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("J - Lock/Unlock an Object", sf::Text::Regular, target, text_template, y_offset);
-    draw_text("Space - Clear Particles and Objects", sf::Text::Regular, target, text_template, y_offset);
+#if FLUID_SANDBOX_PROFILING
+        static constexpr const char *PHASE_LABELS[SIMULATION_PHASE_COUNT] = {
+            "Move", "Neighbors", "Springs", "Density Relaxation", "Collisions", "Velocity", "Gravity", "Viscosity"};
+        const Profiler &profiler = state_->profiler;
+        for (size_t phase = 0; phase < SIMULATION_PHASE_COUNT; ++phase)
+        {
+            draw_timing(PHASE_LABELS[phase], profiler.entry(phase), target, text_template, y_offset);
+        }
+        draw_timing("Step Total", profiler.entry(PROFILE_STEP), target, text_template, y_offset);
+        draw_timing("Draw", *draw_times_, target, text_template, y_offset);
+#else
+        draw_text("Timers are compiled out", sf::Text::Regular, target, text_template, y_offset);
+#endif
+        draw_timing("Frame", frame_times_, target, text_template, y_offset);
+        draw_text("K - Show Controls", sf::Text::Regular, target, text_template, y_offset);
+    }
+    else
+    {
+        y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
+        draw_text("Controls", sf::Text::Bold, target, text_template, y_offset);
+        y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
+
+        draw_text("<key> & '+' or '-' to Adjust Param", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("<key> & 'backspace' to Reset Param", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("LMB to Grab and Move Objects", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("D - Spawn Particles", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("F - Delete Particles", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("G - Spawn an Object", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("H - Delete an Object", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("J - Lock/Unlock an Object", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("K - Show Runtime Stats", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("Z / X - Save / Load Snapshot", sf::Text::Regular, target, text_template, y_offset);
+        draw_text("Space - Clear Particles and Objects", sf::Text::Regular, target, text_template, y_offset);
+    }
 
     y_offset += static_cast<float>(FONT_SIZE) * LINE_SPACING;
     draw_text("Simulation Params", sf::Text::Bold, target, text_template, y_offset);
@@ -7,6 +7,8 @@
 #include <vector>
 
 #include "fluid_sandbox.h"
+#include "profiler.h"
+#include "render_state.h"
 
 constexpr char const FONT_PATH_FROM_BUILD[] = "../../assets/Roboto-Regular.ttf";
 constexpr char const FONT_PATH_FROM_SOURCE[] = "../assets/Roboto-Regular.ttf";
@@ -17,6 +19,9 @@ constexpr float LINE_SPACING = 1.3f;
 constexpr float TEXT_X_OFFSET = 10.0f;
 constexpr float TEXT_Y_OFFSET = 10.0f;
 
+constexpr float FRAME_GRAPH_HEIGHT = 50.0f;
+constexpr double FRAME_GRAPH_MIN_SCALE = 1.0 / 30.0; // Frame time at the top of the graph unless a frame took longer
+
 /**
  * @brief Represents a simulation parameter that can be changed.
  */
@@ -54,10 +59,36 @@ class ControlsDisplay : public sf::Drawable
 public:
     /**
      * @brief Constructs the ControlsDisplay.
-     * @param sandbox Reference to the FluidSandbox to access and modify its parameters.
+     * @param params The initial simulation parameters (the display edits its own copy).
      * @param width The width of the display area.
      */
-    ControlsDisplay(FluidSandbox &sandbox, unsigned int width);
+    ControlsDisplay(const SimulationParameters &params, unsigned int width);
+
+    ControlsDisplay(const ControlsDisplay &) = delete; // Params refer into the display
+    ControlsDisplay &operator=(const ControlsDisplay &) = delete;
+
+    /**
+     * @brief Gets the simulation parameters as edited by the user.
+     * @return Reference to the parameters.
+     */
+    const SimulationParameters &params() const { return sim_params_; }
+
+    /**
+     * @brief Replaces the edited parameters (e.g., with the parameters of a loaded snapshot).
+     * @param params The new parameters.
+     */
+    void set_params(const SimulationParameters &params) { sim_params_ = params; }
+
+    /**
+     * @brief Sets the simulation state to show the stats of.
+     * @param state The state (must stay valid until drawing is done).
+     * @param draw_times Durations of drawing the simulation.
+     */
+    void set_state(const RenderState &state, const TimingHistory &draw_times)
+    {
+        state_ = &state;
+        draw_times_ = &draw_times;
+    }
 
     /**
      * @brief Updates the state of all parameters.
@@ -73,12 +104,19 @@ public:
     void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
 
 private:
-    FluidSandbox &sandbox_;
+    SimulationParameters sim_params_;
+    const RenderState *state_ = nullptr;
+    const TimingHistory *draw_times_ = nullptr;
     sf::Font font_;
     unsigned int width_;
     float dt_ = 0.0f;
     std::vector<Param> params_;
 
+    TimingHistory frame_times_;
+    mutable std::vector<sf::Vertex> frame_graph_vertices_; // Reused by every draw
+    bool show_timings_ = false; // Shows the per-phase timing breakdown in place of the controls help
+    bool timings_key_pressed_ = false;
+
     /**
      * @brief Helper function to draw a line of text.
      * @param text The string to draw.
@@ -106,6 +144,29 @@ private:
      * @param y_offset Current Y offset for drawing, updated by this function.
      */
     void draw_info(const Param &param, sf::RenderTarget &target, sf::Text &text_template, float &y_offset) const;
+
+    /**
+     * @brief Helper function to draw the rolling mean and p99 of a timing history (in milliseconds).
+     * @param text The name of the measured section.
+     * @param history The timing history.
+     * @param target The render target.
+     * @param text_template A pre-configured sf::Text object.
+     * @param y_offset Current Y offset for drawing, updated by this function.
+     */
+    void draw_timing(const std::string &text, const TimingHistory &history, sf::RenderTarget &target, sf::Text &text_template, float &y_offset) const;
+
+    /**
+     * @brief Helper function to draw a graph of the recent frame times.
+     * @param target The render target.
+     * @param y_offset Current Y offset for drawing, updated by this function.
+     */
+    void draw_frame_graph(sf::RenderTarget &target, float &y_offset) const;
+
+    /**
+     * @brief Gets the left edge of the sidebar (the width of the simulation area).
+     * @return X coordinate of the left edge.
+     */
+    float left() const { return state_ ? static_cast<float>(state_->size.x) : 0.0f; }
 };
 
 #endif
@@ -0,0 +1,72 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+#include <limits>
+
+/**
+ * @brief Shape of the area of an emitter or a sink.
+ */
+enum class RegionShape : uint8_t
+{
+    Circle,    // Centered at the position, the radius is `size.x`
+    Rectangle, // Top left corner at the position, `size` is the width and height
+    Count
+};
+
+constexpr size_t REGION_SHAPE_COUNT = static_cast<size_t>(RegionShape::Count);
+
+// Names of the shapes (as used in scene files)
+constexpr const char *REGION_SHAPE_NAMES[REGION_SHAPE_COUNT] = {"circle", "rect"};
+
+/**
+ * @brief An area of the simulation, used by emitters and sinks.
+ */
+struct Region
+{
+    RegionShape shape = RegionShape::Circle;
+    sf::Vector2f position;
+    sf::Vector2f size;
+
+    /**
+     * @brief Checks whether a point lies inside the area.
+     * @param x X coordinate of the point.
+     * @param y Y coordinate of the point.
+     * @return True if the point is inside.
+     */
+    bool contains(float x, float y) const
+    {
+        if (shape == RegionShape::Circle)
+        {
+            const float dx = x - position.x;
+            const float dy = y - position.y;
+            return dx * dx + dy * dy < size.x * size.x;
+        }
+        return x >= position.x && x < position.x + size.x && y >= position.y && y < position.y + size.y;
+    }
+};
+
+/**
+ * @brief Spawns particles at random places of an area at a steady rate, all with the same initial velocity.
+ * Circles spawn at a uniformly random angle and distance from the center (denser in the middle, like the spawn key).
+ */
+struct ParticleEmitter
+{
+    Region region;
+    float rate = 0.0f; // Particles per unit of simulation time, the fraction of a step's share spawns on random chance
+    sf::Vector2f velocity;
+    uint64_t first_step = 0; // Steps (by FluidSandbox::step_count) during which the emitter is active
+    uint64_t last_step = std::numeric_limits<uint64_t>::max(); // Inclusive
+};
+
+/**
+ * @brief Removes every particle that enters an area.
+ */
+struct ParticleSink
+{
+    Region region;
+};
+
+#endif
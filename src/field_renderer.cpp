@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "field_renderer.h"
+
+namespace
+{
+    constexpr float SURFACE_EDGE_WIDTH = 0.2f; // Density range of the anti-aliased edge, relative to the threshold
+
+    /**
+     * @brief Tiles touched by a kernel, empty if it lies outside of the image.
+     */
+    struct TileRange
+    {
+        size_t first_x = 1;
+        size_t last_x = 0;
+        size_t first_y = 1;
+        size_t last_y = 0;
+
+        bool empty() const { return first_x > last_x || first_y > last_y; }
+    };
+
+    TileRange tile_range(float x, float y, float radius_x, float radius_y, sf::Vector2u size)
+    {
+        const float left = std::max(x - radius_x, 0.0f);
+        const float right = std::min(x + radius_x, static_cast<float>(size.x) - 1.0f);
+        const float top = std::max(y - radius_y, 0.0f);
+        const float bottom = std::min(y + radius_y, static_cast<float>(size.y) - 1.0f);
+        if (!(left <= right && top <= bottom)) // Also rejects NaN positions
+            return {};
+        return {static_cast<size_t>(left) / FIELD_TILE_SIZE, static_cast<size_t>(right) / FIELD_TILE_SIZE,
+                static_cast<size_t>(top) / FIELD_TILE_SIZE, static_cast<size_t>(bottom) / FIELD_TILE_SIZE};
+    }
+
+    /**
+     * @brief Clips the pixels a disc may cover along one axis to a tile.
+     * @return First pixel and one past the last pixel.
+     */
+    std::pair<size_t, size_t> clip_span(float center, float radius, size_t begin, size_t end)
+    {
+        const float first = std::clamp(center - radius, static_cast<float>(begin), static_cast<float>(end));
+        const float last = std::clamp(center + radius + 1.0f, static_cast<float>(begin), static_cast<float>(end));
+        return {static_cast<size_t>(first), static_cast<size_t>(last)};
+    }
+}
+
+FieldRenderer::FieldRenderer(const SimulationParameters &params, const FieldRenderSettings &settings) : params_(params), settings_(settings)
+{
+    settings_.size = {std::max(settings_.size.x, 1u), std::max(settings_.size.y, 1u)};
+    tiles_x_ = (settings_.size.x + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+    tiles_y_ = (settings_.size.y + FIELD_TILE_SIZE - 1) / FIELD_TILE_SIZE;
+    if (settings_.thread_count > 1)
+    {
+        thread_pool_ = std::make_unique<ThreadPool>(settings_.thread_count);
+    }
+
+    const size_t pixel_count = static_cast<size_t>(settings_.size.x) * settings_.size.y;
+    density_.resize(pixel_count);
+    stress_.resize(pixel_count);
+    pixels_.resize(pixel_count * 4);
+}
+
+void FieldRenderer::render(const RenderState &state)
+{
+    scale_x_ = static_cast<float>(settings_.size.x) / static_cast<float>(std::max(state.size.x, 1u));
+    scale_y_ = static_cast<float>(settings_.size.y) / static_cast<float>(std::max(state.size.y, 1u));
+    const float radius_x = settings_.splat_radius * scale_x_;
+    const float radius_y = settings_.splat_radius * scale_y_;
+    const size_t num_particles = state.particle_count();
+    const size_t num_tiles = tiles_x_ * tiles_y_;
+
+    // Counting sort of the particles into every tile their kernel touches, same scheme as UniformGrid::update
+    tile_start_.assign(num_tiles + 1, 0);
+    for (size_t i = 0; i < num_particles; ++i)
+    {
+        const TileRange range = tile_range(state.position_x[i] * scale_x_, state.position_y[i] * scale_y_, radius_x, radius_y, settings_.size);
+        if (range.empty())
+            continue;
+        for (size_t tile_x = range.first_x; tile_x <= range.last_x; ++tile_x)
+        {
+            for (size_t tile_y = range.first_y; tile_y <= range.last_y; ++tile_y)
+            {
+                ++tile_start_[tile_x * tiles_y_ + tile_y];
+            }
+        }
+    }
+    uint32_t running_sum = 0;
+    for (size_t tile = 0; tile < num_tiles; ++tile)
+    {
+        running_sum += tile_start_[tile];
+        tile_start_[tile] = running_sum;
+    }
+    tile_start_[num_tiles] = running_sum;
+    tile_particles_.resize(running_sum);
+    for (size_t i = num_particles; i-- > 0;)
+    {
+        const TileRange range = tile_range(state.position_x[i] * scale_x_, state.position_y[i] * scale_y_, radius_x, radius_y, settings_.size);
+        if (range.empty())
+            continue;
+        for (size_t tile_x = range.first_x; tile_x <= range.last_x; ++tile_x)
+        {
+            for (size_t tile_y = range.first_y; tile_y <= range.last_y; ++tile_y)
+            {
+                tile_particles_[--tile_start_[tile_x * tiles_y_ + tile_y]] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+
+    // Tiles are numbered column by column, so the contiguous chunks of the threads are vertical strips and each gets a
+    // share of fluid that has settled to the bottom
+    if (thread_pool_)
+    {
+        thread_pool_->parallel_for(num_tiles, [this, &state](size_t begin, size_t end, size_t)
+                                   {
+                                       for (size_t tile = begin; tile < end; ++tile)
+                                       {
+                                           render_tile(tile, state);
+                                       } });
+    }
+    else
+    {
+        for (size_t tile = 0; tile < num_tiles; ++tile)
+        {
+            render_tile(tile, state);
+        }
+    }
+}
+
+void FieldRenderer::render_tile(size_t tile, const RenderState &state)
+{
+    const size_t width = settings_.size.x;
+    const size_t begin_x = (tile / tiles_y_) * FIELD_TILE_SIZE;
+    const size_t begin_y = (tile % tiles_y_) * FIELD_TILE_SIZE;
+    const size_t end_x = std::min(begin_x + FIELD_TILE_SIZE, width);
+    const size_t end_y = std::min(begin_y + FIELD_TILE_SIZE, static_cast<size_t>(settings_.size.y));
+
+    for (size_t y = begin_y; y < end_y; ++y)
+    {
+        std::fill(density_.begin() + y * width + begin_x, density_.begin() + y * width + end_x, 0.0f);
+        std::fill(stress_.begin() + y * width + begin_x, stress_.begin() + y * width + end_x, 0.0f);
+    }
+
+    // Splat the kernel (1 - q^2)^2 of every binned particle, clipped to the tile
+    const float radius_x = settings_.splat_radius * scale_x_;
+    const float radius_y = settings_.splat_radius * scale_y_;
+    const float inv_radius_x = 1.0f / radius_x;
+    const float inv_radius_y = 1.0f / radius_y;
+    for (uint32_t k = tile_start_[tile]; k < tile_start_[tile + 1]; ++k)
+    {
+        const uint32_t i = tile_particles_[k];
+        const float center_x = state.position_x[i] * scale_x_;
+        const float center_y = state.position_y[i] * scale_y_;
+        const float particle_stress = state.stress[i];
+        const auto [first_x, last_x] = clip_span(center_x, radius_x, begin_x, end_x);
+        const auto [first_y, last_y] = clip_span(center_y, radius_y, begin_y, end_y);
+        for (size_t y = first_y; y < last_y; ++y)
+        {
+            const float dy = (static_cast<float>(y) + 0.5f - center_y) * inv_radius_y;
+            const float dy_sq = dy * dy;
+            if (dy_sq >= 1.0f)
+                continue;
+            float *density_row = density_.data() + y * width;
+            float *stress_row = stress_.data() + y * width;
+            for (size_t x = first_x; x < last_x; ++x)
+            {
+                const float dx = (static_cast<float>(x) + 0.5f - center_x) * inv_radius_x;
+                const float q_sq = dx * dx + dy_sq;
+                if (q_sq >= 1.0f)
+                    continue;
+                const float weight = (1.0f - q_sq) * (1.0f - q_sq);
+                density_row[x] += weight;
+                stress_row[x] += weight * particle_stress;
+            }
+        }
+    }
+
+    // Shade over a black background, in the particle colors of the window
+    const float threshold = settings_.surface_threshold;
+    const float edge_width = std::max(threshold * SURFACE_EDGE_WIDTH, 1e-6f);
+    const float inv_density_scale = settings_.density_scale > 0.0f ? 1.0f / settings_.density_scale : 0.0f;
+    for (size_t y = begin_y; y < end_y; ++y)
+    {
+        for (size_t x = begin_x; x < end_x; ++x)
+        {
+            const size_t pixel = y * width + x;
+            const float density = density_[pixel];
+            const float coverage = settings_.mode == FieldRenderMode::Surface
+                                       ? std::clamp((density - threshold) / edge_width + 0.5f, 0.0f, 1.0f)
+                                       : std::min(density * inv_density_scale, 1.0f);
+            const float stress = density > 0.0f ? stress_[pixel] / density : 0.0f;
+            const float pressure_color = std::clamp(params_.base_particle_color - stress * params_.particle_stress_color_multiplier, 0.0f, 255.0f);
+            uint8_t *rgba = pixels_.data() + pixel * 4;
+            rgba[0] = static_cast<uint8_t>(pressure_color * coverage);
+            rgba[1] = static_cast<uint8_t>(pressure_color * coverage);
+            rgba[2] = static_cast<uint8_t>(255.0f * coverage);
+            rgba[3] = 255;
+        }
+    }
+
+    // Objects are drawn on top as solid discs
+    for (const auto &object : state.objects)
+    {
+        const float center_x = object.position.x * scale_x_;
+        const float center_y = object.position.y * scale_y_;
+        const float object_radius_x = object.radius * scale_x_;
+        const float object_radius_y = object.radius * scale_y_;
+        const auto [first_x, last_x] = clip_span(center_x, object_radius_x, begin_x, end_x);
+        const auto [first_y, last_y] = clip_span(center_y, object_radius_y, begin_y, end_y);
+        const uint8_t red = object.is_locked ? 128 : 0;
+        const uint8_t green = object.is_locked ? 0 : 128;
+        for (size_t y = first_y; y < last_y; ++y)
+        {
+            const float dy = (static_cast<float>(y) + 0.5f - center_y) / object_radius_y;
+            for (size_t x = first_x; x < last_x; ++x)
+            {
+                const float dx = (static_cast<float>(x) + 0.5f - center_x) / object_radius_x;
+                if (dx * dx + dy * dy > 1.0f)
+                    continue;
+                uint8_t *rgba = pixels_.data() + (y * width + x) * 4;
+                rgba[0] = red;
+                rgba[1] = green;
+                rgba[2] = 0;
+            }
+        }
+    }
+}
+
+void FieldRenderer::save_png(const std::string &path) const
+{
+    const sf::Image image(settings_.size, pixels_.data());
+    if (!image.saveToFile(path))
+    {
+        throw std::runtime_error("cannot write image '" + path + "'");
+    }
+}
+
+void FieldRenderer::write_raw(std::ostream &out) const
+{
+    out.write(reinterpret_cast<const char *>(pixels_.data()), static_cast<std::streamsize>(pixels_.size()));
+    if (!out)
+    {
+        throw std::runtime_error("cannot write video frame");
+    }
+}
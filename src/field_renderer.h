@@ -0,0 +1,121 @@
+#ifndef FIELD_RENDERER_H
+#define FIELD_RENDERER_H
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "fluid_sandbox.h"
+#include "render_state.h"
+#include "thread_pool.h"
+
+constexpr float FIELD_SPLAT_RADIUS_DEFAULT = 24.0f; // In simulation units
+constexpr float FIELD_SURFACE_THRESHOLD_DEFAULT = 0.5f;
+constexpr float FIELD_DENSITY_SCALE_DEFAULT = 2.0f;
+constexpr size_t FIELD_TILE_SIZE = 64; // Pixels along each side of a tile
+
+/**
+ * @brief How FieldRenderer turns the field into colors.
+ */
+enum class FieldRenderMode
+{
+    Density, // Brightness follows the density, colored by stress like the particles in the window
+    Surface, // Metaballs: solid fluid where the density is above the threshold, anti-aliased at the edge
+};
+
+/**
+ * @brief Settings of a FieldRenderer.
+ */
+struct FieldRenderSettings
+{
+    sf::Vector2u size; // Output resolution in pixels (the simulation area is stretched to fill it)
+    FieldRenderMode mode = FieldRenderMode::Surface;
+    float splat_radius = FIELD_SPLAT_RADIUS_DEFAULT; // Radius of a particle's kernel in simulation units
+    float surface_threshold = FIELD_SURFACE_THRESHOLD_DEFAULT; // Density at the surface (a lone particle peaks at 1)
+    float density_scale = FIELD_DENSITY_SCALE_DEFAULT; // Density drawn at full brightness in density mode
+    size_t thread_count = 1;
+};
+
+/**
+ * @brief Draws a RenderState on the CPU, so frames can be produced without a display or a GPU.
+ * Every particle splats a smooth kernel into a density field at the output resolution, and its stress into a field
+ * weighted the same way. The image is split into square tiles and particles are binned into the tiles their kernel
+ * touches with a counting sort, then each tile is splatted, shaded and gets its objects drawn on one thread. Tiles
+ * write disjoint pixels, so the output does not depend on the thread count. Buffers are reused between frames.
+ */
+class FieldRenderer
+{
+public:
+    /**
+     * @brief Constructs the FieldRenderer.
+     * @param params The parameters to take the particle colors from (must outlive the renderer).
+     * @param settings Resolution, mode and kernel of the output.
+     */
+    FieldRenderer(const SimulationParameters &params, const FieldRenderSettings &settings);
+
+    /**
+     * @brief Renders a state (at the end of its step) into the image.
+     * @param state The state.
+     */
+    void render(const RenderState &state);
+
+    /**
+     * @brief Gets the settings.
+     * @return The settings.
+     */
+    const FieldRenderSettings &settings() const { return settings_; }
+
+    /**
+     * @brief Gets the image of the last render.
+     * @return RGBA pixels, row by row from the top.
+     */
+    const std::vector<uint8_t> &pixels() const { return pixels_; }
+
+    /**
+     * @brief Gets the density field of the last render.
+     * @return Density at each pixel, row by row from the top.
+     */
+    const std::vector<float> &density() const { return density_; }
+
+    /**
+     * @brief Saves the image as a PNG file.
+     * @param path Path of the file.
+     * @throws std::runtime_error If the file can not be written.
+     */
+    void save_png(const std::string &path) const;
+
+    /**
+     * @brief Writes the image as one raw RGBA frame (e.g. to a file or pipe read by a video encoder).
+     * @param out The stream.
+     * @throws std::runtime_error If writing fails.
+     */
+    void write_raw(std::ostream &out) const;
+
+private:
+    const SimulationParameters &params_;
+    FieldRenderSettings settings_;
+    size_t tiles_x_;
+    size_t tiles_y_;
+    std::unique_ptr<ThreadPool> thread_pool_; // Only exists with more than one thread
+
+    std::vector<float> density_;
+    std::vector<float> stress_; // Stress times kernel weight, divided by the density when shading
+    std::vector<uint8_t> pixels_;
+    std::vector<uint32_t> tile_start_; // Index of the first particle of each tile in tile_particles_ (one extra entry at the end)
+    std::vector<uint32_t> tile_particles_; // Particle indices sorted by tile, a particle is in every tile its kernel touches
+    float scale_x_ = 1.0f; // Pixels per simulation unit in the frame being rendered
+    float scale_y_ = 1.0f;
+
+    /**
+     * @brief Splats, shades and draws the objects of one tile.
+     * @param tile Index of the tile (tiles are numbered column by column).
+     * @param state The state being rendered.
+     */
+    void render_tile(size_t tile, const RenderState &state);
+};
+
+#endif
@@ -1,31 +1,112 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 
 #include "fluid_sandbox.h"
+#include "simd_kernels.h"
 #include "utils.h"
 #include "controls.h"
 
+namespace
+{
+    /**
+     * @brief Coloring of the cells along one axis of the particle grid for FluidSandbox::for_each_particle_ordered.
+     * Cells get the color of their index modulo the stride. Along a periodic axis whose cell count is not a multiple
+     * of the stride, the first and the last band of cells meet across the edge, so the cells of the last, partial
+     * band get colors of their own.
+     */
+    struct ColorAxis
+    {
+        size_t stride;
+        size_t bands; // Number of cells of each of the first `stride` colors (some may be past the end of a bounded axis)
+        size_t colors;
+
+        size_t cell_count(size_t color) const { return color < stride ? bands : 1; }
+        size_t cell(size_t color, size_t k) const { return color < stride ? color + k * stride : bands * stride + color - stride; }
+    };
+
+    ColorAxis color_axis(size_t count, size_t stride, bool periodic)
+    {
+        if (periodic && count % stride != 0)
+        {
+            return {stride, count / stride, stride + count % stride};
+        }
+        return {stride, (count + stride - 1) / stride, stride};
+    }
+
+    /**
+     * @brief Number of grid cells a distance spans (rounded up), capped so huge or NaN distances stay in range.
+     */
+    size_t cells_within(float distance, size_t cell_size, size_t limit)
+    {
+        return static_cast<size_t>(std::min(static_cast<float>(limit), std::ceil(distance / static_cast<float>(cell_size))));
+    }
+}
+
+
+void FluidSandbox::set_thread_count(size_t count)
+{
+    if (count == thread_count())
+        return;
+    thread_pool_ = count > 1 ? std::make_unique<ThreadPool>(count) : nullptr;
+}
 
 void FluidSandbox::clear()
 {
+    release_object();
     particles_.clear();
+    neighbors_valid_ = false;
     objects_.clear();
+    springs_.clear();
+    max_acceleration_ = 0.0f;
+    cell_calm_steps_.clear();
+    cell_sleep_.clear();
+    particle_sleep_.clear();
+    skip_cells_.clear();
+    sleeping_particles_ = 0;
 }
 
 void FluidSandbox::add_particles(sf::Vector2f position)
 {
-    size_t num_new_particles = static_cast<size_t>(params_.particle_spawn_rate * dt_);
+    spawn_particles({RegionShape::Circle, position, {params_.control_radius, 0.0f}}, params_.particle_spawn_rate * step_size_, {0.0f, 0.0f});
+}
+
+void FluidSandbox::spawn_particles(const Region &region, float amount, sf::Vector2f velocity)
+{
+    size_t num_new_particles = static_cast<size_t>(amount);
     if (num_new_particles == 0) // If the whole number of particles is 0, we spawn one on random chance
     {
-        num_new_particles = static_cast<float>(rand()) / RAND_MAX < params_.particle_spawn_rate * dt_ ? 1 : 0;
+        num_new_particles = utils::random_float(random_state_) < amount ? 1 : 0;
     }
-    particles_.reserve(particles_.size() + num_new_particles);
+    // No reserve, exact reservations every step would reallocate every time the store grows
     for (size_t i = 0; i < num_new_particles; ++i)
     {
-        float angle = static_cast<float>(rand()) / RAND_MAX * 2.0f * M_PI;
-        float distance = static_cast<float>(rand()) / RAND_MAX * params_.control_radius;
-        sf::Vector2f offset = {std::cos(angle) * distance, std::sin(angle) * distance};
-        particles_.emplace_back(position + offset);
+        sf::Vector2f position;
+        if (region.shape == RegionShape::Circle)
+        {
+            float angle = utils::random_float(random_state_) * 2.0f * M_PI;
+            float distance = utils::random_float(random_state_) * region.size.x;
+            position = region.position + sf::Vector2f(std::cos(angle) * distance, std::sin(angle) * distance);
+        }
+        else
+        {
+            const float x = utils::random_float(random_state_) * region.size.x;
+            position = region.position + sf::Vector2f(x, utils::random_float(random_state_) * region.size.y);
+        }
+        particles_.push_back(Particle(position, velocity));
+    }
+    if (num_new_particles > 0)
+    {
+        neighbors_valid_ = false;
+        if (region.shape == RegionShape::Circle)
+        {
+            wake_cells(region.position, region.size.x);
+        }
+        else
+        {
+            wake_cells(region.position + 0.5f * region.size, 0.5f * std::hypot(region.size.x, region.size.y));
+        }
     }
 }
 
@@ -42,25 +123,37 @@ void FluidSandbox::add_object(sf::Vector2f position)
         }
     }
     objects_.emplace_back(position, params_.object_radius, params_.object_mass);
+    wake_cells(position, params_.object_radius);
+}
+
+void FluidSandbox::add_object(sf::Vector2f position, float radius, float mass, bool locked)
+{
+    objects_.emplace_back(position, radius, mass);
+    objects_.back().is_locked = locked;
+    wake_cells(position, radius);
 }
 
 void FluidSandbox::remove_particles(sf::Vector2f position)
 {
     float radius_sq = params_.control_radius * params_.control_radius;
-    auto it = std::remove_if(particles_.begin(), particles_.end(),
-                             [position, radius_sq](const Particle &particle)
-                             {
-                                 return utils::distance_sq(particle.position, position) < radius_sq;
-                             });
-    particles_.erase(it, particles_.end());
+    particles_.remove_if([this, position, radius_sq](size_t i)
+                         { return utils::distance_sq(particles_.position(i), position) < radius_sq; });
+    neighbors_valid_ = false;
+    wake_cells(position, params_.control_radius);
 }
 
 void FluidSandbox::remove_object(sf::Vector2f position)
 {
+    release_object(); // Indices of the remaining objects may change
     auto it = std::remove_if(objects_.begin(), objects_.end(),
-                             [position](const Object &object)
+                             [this, position](const Object &object)
                              {
-                                 return utils::distance_sq(object.position, position) < object.radius * object.radius;
+                                 const bool removed = utils::distance_sq(object.position, position) < object.radius * object.radius;
+                                 if (removed)
+                                 {
+                                     wake_cells(object.position, object.radius); // The fluid around it fills the hole
+                                 }
+                                 return removed;
                              });
     objects_.erase(it, objects_.end());
 }
@@ -78,53 +171,294 @@ void FluidSandbox::toggle_lock_object(sf::Vector2f position)
     }
 }
 
-std::optional<Object *> FluidSandbox::try_grab_object(sf::Vector2f position)
+bool FluidSandbox::grab_object(sf::Vector2f position)
 {
+    release_object();
     auto it = std::find_if(objects_.begin(), objects_.end(),
                            [position](const Object &object)
                            {
                                return utils::distance_sq(object.position, position) < object.radius * object.radius;
                            });
-    if (it != objects_.end())
+    if (it == objects_.end())
+    {
+        return false;
+    }
+    grabbed_object_ = static_cast<size_t>(it - objects_.begin());
+    grab_offset_ = position - it->position;
+    grab_locked_object_ = !it->is_locked;
+    if (grab_locked_object_)
     {
-        return &(*it);
+        it->toggle_lock();
     }
-    return std::nullopt;
+    return true;
+}
+
+bool FluidSandbox::move_grabbed_object(sf::Vector2f position)
+{
+    if (grabbed_object_ == NO_OBJECT)
+        return false;
+    objects_[grabbed_object_].position = position - grab_offset_;
+    return true;
+}
+
+void FluidSandbox::release_object()
+{
+    if (grabbed_object_ == NO_OBJECT)
+        return;
+    if (grab_locked_object_)
+    {
+        objects_[grabbed_object_].toggle_lock();
+    }
+    grabbed_object_ = NO_OBJECT;
 }
 
 void FluidSandbox::push_everything(sf::Vector2f velocity)
 {
-    for (auto &&particle : particles_)
+    for (auto &&velocity_x : particles_.velocity_x)
     {
-        particle.velocity += velocity;
+        velocity_x += velocity.x;
+    }
+    for (auto &&velocity_y : particles_.velocity_y)
+    {
+        velocity_y += velocity.y;
     }
     for (auto &&object : objects_)
     {
         object.velocity += velocity;
     }
+    wake_all_cells();
+}
+
+void FluidSandbox::step(float step_size)
+{
+    ScopedTimer timer(profiler_, PROFILE_STEP);
+    step_phase_times_ = {};
+    object_grid_.release(); // Its cells (and queries made between steps) are in the arena
+    frame_arena_.reset();
+
+    const bool adaptive = adaptive_stepping_.courant > 0.0f;
+    const size_t substeps = static_cast<size_t>(std::max(1L, std::lround(params_.substeps)));
+    const float substep_size = std::min(step_size / static_cast<float>(substeps), 1.0f); // to prevent instability (some calculations use higher power of dt)
+    step_size_ = adaptive ? std::max(step_size, 0.0f) : substep_size * static_cast<float>(substeps);
+    for (auto &&emitter : emitters_)
+    {
+        if (step_count_ >= emitter.first_step && step_count_ <= emitter.last_step)
+        {
+            spawn_particles(emitter.region, emitter.rate * step_size_, emitter.velocity);
+        }
+    }
+    update_sleep();
+
+    std::copy(particles_.position_x.begin(), particles_.position_x.end(), particles_.step_start_x.begin());
+    std::copy(particles_.position_y.begin(), particles_.position_y.end(), particles_.step_start_y.begin());
+    for (auto &&object : objects_)
+    {
+        object.step_start = object.position;
+    }
+
+    step_stats_ = {};
+    if (adaptive)
+    {
+        step_stats_.min_substep = step_size_;
+        float remaining = step_size_;
+        while (remaining > 0.0f)
+        {
+            StepLimit limit;
+            const float dt = choose_substep(remaining, limit);
+            substep(dt);
+            remaining -= dt;
+            ++step_stats_.substeps;
+            ++step_stats_.limited_by[static_cast<size_t>(limit)];
+            step_stats_.min_substep = std::min(step_stats_.min_substep, dt);
+            step_stats_.max_substep = std::max(step_stats_.max_substep, dt);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < substeps; ++i)
+        {
+            substep(substep_size);
+        }
+        step_stats_.substeps = substeps;
+        step_stats_.min_substep = substep_size;
+        step_stats_.max_substep = substep_size;
+        step_stats_.limited_by[static_cast<size_t>(StepLimit::Fixed)] = substeps;
+    }
+    ++step_count_;
+    if (recorder_)
+    {
+        recorder_->record(*this);
+    }
+}
+
+uint64_t FluidSandbox::state_hash() const
+{
+    // FNV-1a over the raw bytes, floats are compared bit for bit
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto add_bytes = [&hash](const void *data, size_t size)
+    {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+    };
+    auto add = [&add_bytes](const auto &value)
+    { add_bytes(&value, sizeof(value)); };
+
+    add(step_count_);
+    add(random_state_);
+    add(particles_.size());
+    add_bytes(particles_.id.data(), particles_.id.size() * sizeof(size_t));
+    for (const std::vector<float> *array : {&particles_.position_x, &particles_.position_y, &particles_.velocity_x, &particles_.velocity_y})
+    {
+        add_bytes(array->data(), array->size() * sizeof(float));
+    }
+    for (auto &&object : objects_)
+    {
+        add(object.position.x);
+        add(object.position.y);
+        add(object.velocity.x);
+        add(object.velocity.y);
+        add(object.is_locked);
+    }
+
+    // The slot order of the spring table depends on its history, so springs are summed independently of order
+    uint64_t springs = 0;
+    springs_.for_each([&springs](const SpringTable::Slot &spring)
+                      {
+                          uint64_t state = spring.id_low * 0x9E3779B97F4A7C15ull ^ spring.id_high;
+                          uint32_t rest_length;
+                          std::memcpy(&rest_length, &spring.rest_length, sizeof(rest_length));
+                          state ^= static_cast<uint64_t>(rest_length) << 17;
+                          springs += utils::split_mix64(state); });
+    add(springs_.size());
+    add(springs);
+    return hash;
+}
+
+void FluidSandbox::capture(RenderState &state) const
+{
+    state.size = size_;
+    state.step = step_count_;
+    state.position_x.assign(particles_.position_x.begin(), particles_.position_x.end());
+    state.position_y.assign(particles_.position_y.begin(), particles_.position_y.end());
+    state.step_start_x.assign(particles_.step_start_x.begin(), particles_.step_start_x.end());
+    state.step_start_y.assign(particles_.step_start_y.begin(), particles_.step_start_y.end());
+    state.stress.assign(particles_.stress.begin(), particles_.stress.end());
+    state.objects.clear();
+    for (auto &&object : objects_)
+    {
+        state.objects.push_back({object.position, object.step_start, object.radius, object.is_locked});
+    }
+    state.profiler = profiler_;
+}
+
+float FluidSandbox::choose_substep(float remaining, StepLimit &limit)
+{
+    float max_speed_sq = 0.0f;
+    const size_t num_particles = particles_.size();
+    const float *velocity_x = particles_.velocity_x.data();
+    const float *velocity_y = particles_.velocity_y.data();
+    for (size_t i = 0; i < num_particles; ++i)
+    {
+        max_speed_sq = std::max(max_speed_sq, velocity_x[i] * velocity_x[i] + velocity_y[i] * velocity_y[i]);
+    }
+    for (auto &&object : objects_)
+    {
+        max_speed_sq = std::max(max_speed_sq, object.velocity.x * object.velocity.x + object.velocity.y * object.velocity.y);
+    }
+    const float max_speed = std::sqrt(max_speed_sq);
+    const float max_acceleration = max_acceleration_ + std::hypot(params_.gravity_x, params_.gravity_y);
+    step_stats_.max_speed = std::max(step_stats_.max_speed, max_speed);
+    step_stats_.max_acceleration = std::max(step_stats_.max_acceleration, max_acceleration);
+
+    // The reach is how far a particle may move, by its velocity (v * dt) or from rest by the acceleration (a * dt^2 / 2)
+    const float reach = adaptive_stepping_.courant * params_.interaction_radius;
+    float dt = adaptive_stepping_.max_substep;
+    limit = StepLimit::MaxSubstep;
+    if (max_speed * dt > reach)
+    {
+        dt = reach / max_speed;
+        limit = StepLimit::Velocity;
+    }
+    if (0.5f * max_acceleration * dt * dt > reach)
+    {
+        dt = std::sqrt(2.0f * reach / max_acceleration);
+        limit = StepLimit::Acceleration;
+    }
+    const float min_dt = step_size_ / static_cast<float>(std::max<size_t>(adaptive_stepping_.max_substeps, 1));
+    if (!(dt >= min_dt)) // Also catches NaN speeds of an exploded simulation
+    {
+        dt = min_dt;
+        limit = StepLimit::MinSubstep;
+    }
+
+    // A step just slightly longer than a substep is taken whole instead of being split in two
+    const float count = std::max(1.0f, std::ceil(remaining / dt - 1e-3f));
+    return count == 1.0f ? remaining : remaining / count;
 }
 
-void FluidSandbox::update(float dt)
+void FluidSandbox::substep(float dt)
 {
-    dt_ = std::min(dt * params_.simulation_speed, 1.0f); // to prevent instability (some calculations use higher power of dt)
-    move_everything();
-    update_neighbors();
-    adjust_apply_strings();
-    do_double_density_relaxation();
-    resolve_collisions();
-    recalculate_velocity();
-    apply_gravity();
-    apply_viscosity();
+    dt_ = dt;
+    run_phase(SimulationPhase::Move, &FluidSandbox::move_everything);
+    run_phase(SimulationPhase::Neighbors, &FluidSandbox::update_neighbors);
+    run_phase(SimulationPhase::Springs, &FluidSandbox::adjust_apply_strings);
+    run_phase(SimulationPhase::Relaxation, &FluidSandbox::do_double_density_relaxation);
+    run_phase(SimulationPhase::Collisions, &FluidSandbox::resolve_collisions);
+    run_phase(SimulationPhase::Velocity, &FluidSandbox::recalculate_velocity);
+    run_phase(SimulationPhase::Gravity, &FluidSandbox::apply_gravity);
+    run_phase(SimulationPhase::Viscosity, &FluidSandbox::apply_viscosity);
+    if (boundaries_.has_outflow() || !sinks_.empty())
+    {
+        remove_drained_particles();
+    }
     reverse_calculation_order_ = !reverse_calculation_order_; // Reverse the order of calculations for better stability
 }
 
+void FluidSandbox::run_phase(SimulationPhase phase, void (FluidSandbox::*function)())
+{
+    // Always measured, the benchmark reads the phase times even when the profiling timers are compiled out
+    const auto start = std::chrono::steady_clock::now();
+    (this->*function)();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    step_phase_times_[static_cast<size_t>(phase)] += seconds;
+#if FLUID_SANDBOX_PROFILING
+    profiler_.record(static_cast<size_t>(phase), seconds);
+#endif
+}
+
 void FluidSandbox::move_everything()
 {
-    for (auto &&particle : particles_)
+    const size_t num_particles = particles_.size();
+    float *position_x = particles_.position_x.data();
+    float *position_y = particles_.position_y.data();
+    const float *velocity_x = particles_.velocity_x.data();
+    const float *velocity_y = particles_.velocity_y.data();
+    std::copy(position_x, position_x + num_particles, particles_.prev_position_x.data());
+    std::copy(position_y, position_y + num_particles, particles_.prev_position_y.data());
+    for (size_t i = 0; i < num_particles; ++i)
     {
-        particle.update(dt_);
+        position_x[i] += velocity_x[i] * dt_;
+        position_y[i] += velocity_y[i] * dt_;
+    }
+
+    // With reused neighbor lists the grid is kept too, so particles are only reordered when both are rebuilt
+    const bool reorder_due = reorder_interval_ != 0 && ++steps_since_reorder_ >= reorder_interval_;
+    if (!can_reuse_neighbors())
+    {
+        neighbors_valid_ = false;
+        neighbor_radius_ = params_.interaction_radius + neighbor_skin_;
+        particle_grid_.update(particles_.position_x, particles_.position_y, neighbor_radius_, size_, boundaries_.periodic_x(), boundaries_.periodic_y());
+        if (reorder_due)
+        {
+            // Neighbors are gathered after this, so no indices into particles_ are held across the reorder
+            particles_.permute(particle_grid_.cell_order());
+            particle_grid_.update(particles_.position_x, particles_.position_y, neighbor_radius_, size_, boundaries_.periodic_x(), boundaries_.periodic_y());
+            steps_since_reorder_ = 0;
+        }
     }
-    particle_grid_.update(particles_, params_.interaction_radius);
 
     max_object_radius = 0.0f;
     for (auto &&object : objects_)
@@ -139,17 +473,172 @@ void FluidSandbox::move_everything()
     object_grid_.update(objects_, max_object_radius);
 }
 
+bool FluidSandbox::can_reuse_neighbors() const
+{
+    if (neighbor_skin_ <= 0.0f || !neighbors_valid_ || neighbor_radius_ != params_.interaction_radius + neighbor_skin_)
+        return false;
+
+    // Two particles that each moved at most half the skin can't have come closer than the skin
+    const float max_move_sq = 0.25f * neighbor_skin_ * neighbor_skin_;
+    const float *position_x = particles_.position_x.data();
+    const float *position_y = particles_.position_y.data();
+    for (size_t i = 0; i < particles_.size(); ++i)
+    {
+        float move_x = position_x[i] - neighbor_build_x_[i];
+        float move_y = position_y[i] - neighbor_build_y_[i];
+        particle_grid_.wrap_difference(move_x, move_y); // Wrapping around a periodic edge is no movement
+        if (move_x * move_x + move_y * move_y > max_move_sq)
+            return false;
+    }
+    return true;
+}
+
 void FluidSandbox::update_neighbors()
 {
-    if (particles_.size() != particle_neighbors_.size())
+    if (neighbors_valid_)
+        return;
+    neighbors_valid_ = true;
+    ++neighbor_builds_;
+    mark_sleeping_particles();
+    if (neighbor_skin_ > 0.0f)
+    {
+        // Resized rather than assigned, which grows the capacity geometrically while emitters add particles
+        neighbor_build_x_.resize(particles_.size());
+        neighbor_build_y_.resize(particles_.size());
+        std::copy(particles_.position_x.begin(), particles_.position_x.end(), neighbor_build_x_.begin());
+        std::copy(particles_.position_y.begin(), particles_.position_y.end(), neighbor_build_y_.begin());
+    }
+
+    const size_t num_particles = particles_.size();
+    if (!thread_pool_)
+    {
+        gather_neighbors(0, num_particles, particle_neighbors_);
+        relaxation_neighbors_.assign_full(particle_neighbors_);
+        return;
+    }
+
+    // Each thread gathers the neighbors of its own chunk of particles, the chunks are then stitched together
+    const size_t thread_count = thread_pool_->thread_count();
+    neighbor_chunks_.resize(thread_count);
+    neighbor_chunk_bases_.resize(thread_count);
+    thread_pool_->parallel_for(num_particles, [this](size_t begin, size_t end, size_t thread_index)
+                               { gather_neighbors(begin, end, neighbor_chunks_[thread_index]); });
+
+    size_t total_neighbors = 0;
+    for (size_t t = 0; t < thread_count; ++t)
+    {
+        neighbor_chunk_bases_[t] = total_neighbors;
+        total_neighbors += neighbor_chunks_[t].indices.size();
+    }
+    particle_neighbors_.offsets.resize(num_particles + 1);
+    particle_neighbors_.indices.resize(total_neighbors);
+    particle_neighbors_.offsets[num_particles] = static_cast<uint32_t>(total_neighbors);
+
+    thread_pool_->parallel_for(num_particles, [this](size_t begin, size_t end, size_t thread_index)
+                               {
+        const NeighborList &chunk = neighbor_chunks_[thread_index];
+        const uint32_t base = static_cast<uint32_t>(neighbor_chunk_bases_[thread_index]);
+        for (size_t i = begin; i < end; ++i)
+        {
+            particle_neighbors_.offsets[i] = base + chunk.offsets[i - begin];
+        }
+        std::copy(chunk.indices.begin(), chunk.indices.end(), particle_neighbors_.indices.begin() + base); });
+    relaxation_neighbors_.assign_full(particle_neighbors_);
+}
+
+void FluidSandbox::gather_neighbors(size_t begin, size_t end, NeighborList &neighbors) const
+{
+    const float neighbor_radius_sq = neighbor_radius_ * neighbor_radius_;
+    const float *position_x = particles_.position_x.data();
+    const float *position_y = particles_.position_y.data();
+    const uint8_t *sleep = sleeping_mask();
+
+    neighbors.reset(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (sleep && sleep[i] == DEEP) // Its pairs with awake particles are listed under them
+        {
+            neighbors.finish(i - begin);
+            continue;
+        }
+
+        // Each pair is only listed under the particle that comes first in the grid's cell order
+        particle_grid_.for_each_later_in_radius(static_cast<uint32_t>(i), neighbor_radius_, [&](uint32_t neighbor_id)
+                                                {
+            float position_diff_x = position_x[neighbor_id] - position_x[i];
+            float position_diff_y = position_y[neighbor_id] - position_y[i];
+            particle_grid_.wrap_difference(position_diff_x, position_diff_y);
+            float distance_sq = position_diff_x * position_diff_x + position_diff_y * position_diff_y;
+            if (distance_sq < neighbor_radius_sq)
+            {
+                neighbors.push_back(neighbor_id);
+            } });
+        neighbors.finish(i - begin);
+    }
+}
+
+template <typename Function>
+void FluidSandbox::for_each_particle_ordered(Function &&function)
+{
+    const size_t num_particles = particles_.size();
+    const size_t columns = particle_grid_.columns();
+    const size_t rows = particle_grid_.rows();
+
+    const uint8_t *sleep = sleeping_mask(); // Particles in deep sleep have no neighbors, so they are skipped
+
+    if (!thread_pool_ || columns == 0)
     {
-        particle_neighbors_.resize(particles_.size());
+        for (size_t i = 0; i < num_particles; ++i)
+        {
+            const size_t particle_id = reverse_calculation_order_ ? num_particles - i - 1 : i;
+            if (sleep && sleep[particle_id] == DEEP)
+                continue;
+            function(particle_id, 0);
+        }
+        return;
     }
-    size_t particle_id = 0;
-    for (auto &&particle : particles_)
+
+    // A particle only touches neighbors up to `reach` cells away (as binned when the neighbors were gathered),
+    // so particles in cells at least `stride` cells apart never touch the same particle.
+    // Cells are colored by their position modulo stride and cells of one color are processed in parallel.
+    const size_t reach = neighbor_cell_reach();
+    const size_t stride = 2 * reach + 1;
+    const ColorAxis axis_x = color_axis(columns, stride, particle_grid_.periodic_x());
+    const ColorAxis axis_y = color_axis(rows, stride, particle_grid_.periodic_y());
+    const size_t num_colors = axis_x.colors * axis_y.colors;
+    const std::vector<uint32_t> &cell_order = particle_grid_.cell_order();
+    const bool reverse = reverse_calculation_order_;
+
+    for (size_t c = 0; c < num_colors; ++c)
     {
-        particle_neighbors_[particle_id] = particle_grid_.query(particle.position, params_.interaction_radius);
-        ++particle_id;
+        const size_t color = reverse ? num_colors - c - 1 : c;
+        const size_t color_x = color % axis_x.colors;
+        const size_t color_y = color / axis_x.colors;
+        const size_t color_columns = axis_x.cell_count(color_x);
+        const size_t color_rows = axis_y.cell_count(color_y);
+
+        thread_pool_->parallel_for(color_columns * color_rows, [&](size_t begin, size_t end, size_t thread_index)
+                                   {
+            for (size_t k = begin; k < end; ++k)
+            {
+                const size_t x = axis_x.cell(color_x, k % color_columns);
+                const size_t y = axis_y.cell(color_y, k / color_columns);
+                if (x >= columns || y >= rows)
+                    continue;
+
+                const size_t cell = x + y * columns;
+                if (sleep && skip_cells_[cell])
+                    continue;
+                const uint32_t cell_begin = particle_grid_.cell_begin(cell);
+                const uint32_t cell_end = particle_grid_.cell_end(cell);
+                for (uint32_t n = cell_begin; n < cell_end; ++n)
+                {
+                    const uint32_t particle_id = cell_order[reverse ? cell_end - (n - cell_begin) - 1 : n];
+                    if (sleep && sleep[particle_id] == DEEP)
+                        continue;
+                    function(particle_id, thread_index);
+                }
+            } });
     }
 }
 
@@ -164,46 +653,64 @@ void FluidSandbox::adjust_apply_strings()
     const float dt_plasticity = params_.plasticity * dt_;
     const float dt_sq_spring_stiffness_half = params_.spring_stiffness * dt_ * dt_ * 0.5f;
 
-    size_t num_particles = particles_.size();
-
-    for (size_t i = 0; i < num_particles; ++i)
-    {
-        size_t particle_id = reverse_calculation_order_ ? num_particles - i - 1 : i;
-        auto &particle = particles_[particle_id];
+    float *position_x = particles_.position_x.data();
+    float *position_y = particles_.position_y.data();
+    const size_t *ids = particles_.id.data();
+    const uint32_t *neighbor_ids = particle_neighbors_.indices.data();
+    const uint8_t *sleep = sleeping_mask(); // Sleeping particles are not moved
 
-        auto &neighbors = particle_neighbors_[particle_id];
+    // Existing springs are updated in place (each pair is visited once), new ones are collected per thread
+    springs_.begin_step();
+    new_springs_.resize(thread_count());
 
-        std::unordered_map<size_t, float> new_springs;
-        new_springs.reserve(neighbors.size());
+    for_each_particle_ordered([&](size_t particle_id, size_t thread_index)
+                              {
+        const uint32_t neighbors_begin = particle_neighbors_.begin(particle_id);
+        const uint32_t neighbors_end = particle_neighbors_.end(particle_id);
+        const bool particle_awake = !sleep || sleep[particle_id] == AWAKE;
 
-        for (auto &&neighbor : neighbors)
+        for (uint32_t n = neighbors_begin; n < neighbors_end; ++n)
         {
-            if (neighbor <= &particle)
-                continue;
+            const uint32_t neighbor_id = neighbor_ids[n];
+            const bool neighbor_awake = !sleep || sleep[neighbor_id] == AWAKE;
+
+            // Springs are keyed by the particle IDs, so they survive particles being reordered in memory
+            const size_t id_low = std::min(ids[particle_id], ids[neighbor_id]);
+            const size_t id_high = std::max(ids[particle_id], ids[neighbor_id]);
 
-            float distance_sq = utils::distance_sq(particle.position, neighbor->position);
+            float position_diff_x = position_x[neighbor_id] - position_x[particle_id];
+            float position_diff_y = position_y[neighbor_id] - position_y[particle_id];
+            particle_grid_.wrap_difference(position_diff_x, position_diff_y);
+            float distance_sq = position_diff_x * position_diff_x + position_diff_y * position_diff_y;
 
+            // Positions are changed in place by earlier pairs, so the radius has to be checked again
             if (distance_sq >= interaction_radius_sq)
                 continue;
 
-            if (distance_sq < 0.01f)
+            if (!particle_awake && !neighbor_awake)
             {
-                sf::Vector2f position_diff = neighbor->position - particle.position;
-                neighbor->position += {position_diff.x > 0 ? 0.1f : -0.1f, position_diff.y > 0 ? 0.1f : -0.1f};
+                // A sleeping pair keeps its spring as it is
+                if (SpringTable::Slot *spring = springs_.find(id_low, id_high))
+                {
+                    springs_.keep(*spring);
+                }
                 continue;
             }
-            float distance = std::sqrt(distance_sq);
-            float spring_length;
 
-            auto it = particle.springs.find(neighbor->id);
-            if (it != particle.springs.end())
-            {
-                spring_length = it->second;
-            }
-            else
+            if (distance_sq < 0.01f)
             {
-                spring_length = params_.interaction_radius;
+                if (neighbor_awake)
+                {
+                    position_x[neighbor_id] += position_diff_x > 0 ? 0.1f : -0.1f;
+                    position_y[neighbor_id] += position_diff_y > 0 ? 0.1f : -0.1f;
+                }
+                continue;
             }
+            float distance = std::sqrt(distance_sq);
+
+            SpringTable::Slot *spring = springs_.find(id_low, id_high);
+            float spring_length = spring ? spring->rest_length : params_.interaction_radius;
+
             float tolerable_deformation = spring_length * params_.yield_ratio;
             if (distance > spring_length + tolerable_deformation)
             {
@@ -215,18 +722,44 @@ void FluidSandbox::adjust_apply_strings()
             }
             if (spring_length > params_.interaction_radius)
             {
-                continue;
+                continue; // Not kept, so the spring is removed after the pass
+            }
+            if (spring)
+            {
+                spring->rest_length = spring_length;
+                springs_.keep(*spring);
+            }
+            else
+            {
+                new_springs_[thread_index].push_back({id_low, id_high, spring_length});
             }
-            new_springs.emplace(neighbor->id, spring_length);
 
             float displacement_magnitude = dt_sq_spring_stiffness_half * (1 - spring_length * inv_interaction_radius) * (spring_length - distance) / distance;
 
-            sf::Vector2f displacement = (neighbor->position - particle.position) * displacement_magnitude;
+            float displacement_x = position_diff_x * displacement_magnitude;
+            float displacement_y = position_diff_y * displacement_magnitude;
 
-            particle.position -= displacement;
-            neighbor->position += displacement;
+            if (particle_awake)
+            {
+                position_x[particle_id] -= displacement_x;
+                position_y[particle_id] -= displacement_y;
+            }
+            if (neighbor_awake)
+            {
+                position_x[neighbor_id] += displacement_x;
+                position_y[neighbor_id] += displacement_y;
+            }
+        }
+    });
+
+    springs_.remove_stale();
+    for (auto &&thread_springs : new_springs_)
+    {
+        for (auto &&spring : thread_springs)
+        {
+            springs_.insert(spring);
         }
-        std::swap(particle.springs, new_springs);
+        thread_springs.clear();
     }
 }
 
@@ -237,81 +770,112 @@ void FluidSandbox::do_double_density_relaxation()
     const float inv_interaction_radius = 1.0f / params_.interaction_radius;
     const float dt_sq_half = 0.5f * dt_ * dt_;
 
-    size_t num_particles = particles_.size();
+    float *position_x = particles_.position_x.data();
+    float *position_y = particles_.position_y.data();
+    float *stress = particles_.stress.data();
+    const uint32_t *neighbor_ids = relaxation_neighbors_.indices.data();
+    neighbor_scratch_.resize(thread_count());
+    const uint8_t *sleep = sleeping_mask(); // Sleeping particles push their awake neighbors, but are not moved
+    const bool periodic = particle_grid_.periodic_x() || particle_grid_.periodic_y();
 
-    for (size_t i = 0; i < num_particles; ++i)
+    // Nudges the neighbors closer than 0.1 apart, the rare case stays scalar
+    auto nudge_close_neighbors = [&](size_t particle_id, uint32_t neighbors_begin, size_t num_neighbors, NeighborScratch &scratch)
     {
-        size_t particle_id = reverse_calculation_order_ ? num_particles - i - 1 : i;
-        auto &particle = particles_[particle_id];
-        float density = 0.0f;
-        float near_density = 0.0f;
-
-        auto &neighbors = particle_neighbors_[particle_id];
-
-        for (auto &&neighbor : neighbors)
+        for (size_t k = 0; k < num_neighbors; ++k)
         {
-            if (neighbor == &particle)
+            float &position_diff_x = scratch.position_diff_x[k];
+            float &position_diff_y = scratch.position_diff_y[k];
+            if (position_diff_x * position_diff_x + position_diff_y * position_diff_y >= 0.01f)
                 continue;
 
-            float distance_sq = utils::distance_sq(particle.position, neighbor->position);
-
-            if (distance_sq >= interaction_radius_sq)
+            const uint32_t neighbor_id = neighbor_ids[neighbors_begin + k];
+            if (sleep && sleep[neighbor_id] != AWAKE)
                 continue;
-
-            if (distance_sq < 0.01f)
+            position_x[neighbor_id] += position_diff_x > 0 ? 0.1f : -0.1f;
+            position_y[neighbor_id] += position_diff_y > 0 ? 0.1f : -0.1f;
+            position_diff_x = position_x[neighbor_id] - position_x[particle_id];
+            position_diff_y = position_y[neighbor_id] - position_y[particle_id];
+            particle_grid_.wrap_difference(position_diff_x, position_diff_y);
+        }
+    };
+
+    for_each_particle_ordered([&](size_t particle_id, size_t thread_index)
+                              {
+        const uint32_t neighbors_begin = relaxation_neighbors_.begin(particle_id);
+        const size_t num_neighbors = relaxation_neighbors_.end(particle_id) - neighbors_begin;
+        const bool particle_awake = !sleep || sleep[particle_id] == AWAKE;
+        if (!particle_awake && std::none_of(neighbor_ids + neighbors_begin, neighbor_ids + neighbors_begin + num_neighbors,
+                                            [sleep](uint32_t neighbor_id)
+                                            { return sleep[neighbor_id] == AWAKE; }))
+            return; // Nothing to move
+
+        // Positions are changed in place by earlier particles, so the differences are gathered from the live positions
+        NeighborScratch &scratch = neighbor_scratch_[thread_index];
+        scratch.resize(num_neighbors);
+        for (size_t k = 0; k < num_neighbors; ++k)
+        {
+            const uint32_t neighbor_id = neighbor_ids[neighbors_begin + k];
+            scratch.position_diff_x[k] = position_x[neighbor_id] - position_x[particle_id];
+            scratch.position_diff_y[k] = position_y[neighbor_id] - position_y[particle_id];
+        }
+        if (periodic) // Separate pass, so the gather of bounded areas stays as it was
+        {
+            for (size_t k = 0; k < num_neighbors; ++k)
             {
-                sf::Vector2f position_diff = neighbor->position - particle.position;
-                neighbor->position += {position_diff.x > 0 ? 0.1f : -0.1f, position_diff.y > 0 ? 0.1f : -0.1f};
-                continue;
+                particle_grid_.wrap_difference(scratch.position_diff_x[k], scratch.position_diff_y[k]);
             }
-
-            float distance = std::sqrt(distance_sq);
-            float distance_ratio = distance * inv_interaction_radius;
-
-            float one_minus_ratio = 1.0f - distance_ratio;
-            float one_minus_ratio_sq = one_minus_ratio * one_minus_ratio;
-
-            density += one_minus_ratio_sq;
-            near_density += one_minus_ratio_sq * one_minus_ratio;
         }
 
-        float pressure = params_.stiffness * (density - params_.rest_density);
-        float near_pressure = params_.near_stiffness * near_density;
-
-        particle.stress = STRESS_SMOOTHING * particle.stress + (1 - STRESS_SMOOTHING) * near_pressure;
-
-        sf::Vector2f total_displacement = {0.0f, 0.0f};
-
-        for (auto &&neighbor : neighbors)
+        float density;
+        float near_density;
+        if (simd_kernels::accumulate_density(scratch.position_diff_x.data(), scratch.position_diff_y.data(), num_neighbors,
+                                             interaction_radius_sq, inv_interaction_radius, density, near_density) > 0)
         {
-            if (neighbor == &particle)
-                continue;
+            nudge_close_neighbors(particle_id, neighbors_begin, num_neighbors, scratch);
+        }
 
-            sf::Vector2f position_diff = neighbor->position - particle.position;
-            float distance_sq = position_diff.lengthSquared();
+        const float pressure = params_.stiffness * (density - params_.rest_density);
+        const float near_pressure = params_.near_stiffness * near_density;
+        if (particle_awake) // Sleeping particles may be missing pairs, they keep the stress they fell asleep with
+        {
+            stress[particle_id] = STRESS_SMOOTHING * stress[particle_id] + (1 - STRESS_SMOOTHING) * near_pressure;
+        }
 
-            if (distance_sq >= interaction_radius_sq)
-                continue;
+        // Each neighbor only receives its own displacement, so the displacements can be computed before any is applied
+        float total_displacement_x;
+        float total_displacement_y;
+        const size_t num_close = simd_kernels::pressure_displacements(scratch.position_diff_x.data(), scratch.position_diff_y.data(), num_neighbors,
+                                                                      interaction_radius_sq, inv_interaction_radius, dt_sq_half * pressure, dt_sq_half * near_pressure,
+                                                                      scratch.displacement_x.data(), scratch.displacement_y.data(), total_displacement_x, total_displacement_y);
 
-            if (distance_sq < 0.01f)
-            {
-                neighbor->position += {position_diff.x > 0 ? 0.1f : -0.1f, position_diff.y > 0 ? 0.1f : -0.1f};
+        for (size_t k = 0; k < num_neighbors; ++k)
+        {
+            const uint32_t neighbor_id = neighbor_ids[neighbors_begin + k];
+            if (sleep && sleep[neighbor_id] != AWAKE)
                 continue;
-            }
-
-            float distance = std::sqrt(distance_sq);
-            float distance_ratio = distance * inv_interaction_radius;
-            float one_minus_ratio = 1.0f - distance_ratio;
-
-            float displacement_magnitude = dt_sq_half * (pressure * one_minus_ratio + near_pressure * (one_minus_ratio * one_minus_ratio)) / distance;
-
-            sf::Vector2f displacement = position_diff * displacement_magnitude;
-
-            neighbor->position += displacement;
-            total_displacement -= displacement;
+            position_x[neighbor_id] += scratch.displacement_x[k];
+            position_y[neighbor_id] += scratch.displacement_y[k];
         }
-        particle.position += total_displacement;
-    }
+        if (num_close > 0) // Still overlapping after the first nudge, they got no displacement
+        {
+            nudge_close_neighbors(particle_id, neighbors_begin, num_neighbors, scratch);
+        }
+        if (particle_awake)
+        {
+            position_x[particle_id] += total_displacement_x;
+            position_y[particle_id] += total_displacement_y;
+        }
+    });
+}
+
+void FluidSandbox::gather_object_particles(size_t object_index, float pushed)
+{
+    const Object &object = objects_[object_index];
+    std::vector<uint32_t> &particles = object_particles_[object_index];
+    particles.clear();
+    particle_grid_.for_each_in_radius(object.position, object.radius + OBJECT_PARTICLE_MARGIN, [&particles](uint32_t particle_id)
+                                      { particles.push_back(particle_id); }, 0.5f * neighbor_skin_ + pushed); // The grid is as old as the neighbor lists
+    object_particles_center_[object_index] = object.position;
 }
 
 void FluidSandbox::resolve_collisions()
@@ -321,78 +885,151 @@ void FluidSandbox::resolve_collisions()
     const float min_y = 0;
     const float max_y = static_cast<float>(size_.y);
 
+    float *position_x = particles_.position_x.data();
+    float *position_y = particles_.position_y.data();
+    float *velocity_x = particles_.velocity_x.data();
+    float *velocity_y = particles_.velocity_y.data();
+    const size_t num_particles = particles_.size();
+
+    // Periodic edges of an axis the grid could not wrap act as walls, outflow edges let particles pass
+    const bool wrap_x = particle_grid_.periodic_x();
+    const bool wrap_y = particle_grid_.periodic_y();
+    const bool wall_left = !wrap_x && boundaries_.left != BoundaryMode::Outflow;
+    const bool wall_right = !wrap_x && boundaries_.right != BoundaryMode::Outflow;
+    const bool wall_top = !wrap_y && boundaries_.top != BoundaryMode::Outflow;
+    const bool wall_bottom = !wrap_y && boundaries_.bottom != BoundaryMode::Outflow;
+
+    // Whole periods to add to a coordinate outside of the area to bring it back in (usually one, fast particles may need more)
+    auto period_shift = [](float coordinate, float period)
+    { return -std::floor(coordinate / period) * period; };
+
+    // A wrapped particle keeps its velocity and render interpolation by moving its earlier positions along
+    auto wrap_particle = [this](size_t i, float shift_x, float shift_y)
+    {
+        particles_.position_x[i] += shift_x;
+        particles_.prev_position_x[i] += shift_x;
+        particles_.step_start_x[i] += shift_x;
+        particles_.position_y[i] += shift_y;
+        particles_.prev_position_y[i] += shift_y;
+        particles_.step_start_y[i] += shift_y;
+    };
+
     // Particle boundary collisions
-    for (auto &&particle : particles_)
+    for (size_t i = 0; i < num_particles; ++i)
     {
-        if (particle.position.x < min_x)
+        if (position_x[i] < min_x)
         {
-            particle.position.x = min_x;
-            particle.velocity.x *= -params_.edge_bounciness;
+            if (wrap_x)
+            {
+                wrap_particle(i, period_shift(position_x[i], max_x), 0.0f);
+            }
+            else if (wall_left)
+            {
+                position_x[i] = min_x;
+                velocity_x[i] *= -params_.edge_bounciness;
+            }
         }
-        else if (particle.position.x > max_x)
+        else if (position_x[i] > max_x)
         {
-            particle.position.x = max_x;
-            particle.velocity.x *= -params_.edge_bounciness;
+            if (wrap_x)
+            {
+                wrap_particle(i, period_shift(position_x[i], max_x), 0.0f);
+            }
+            else if (wall_right)
+            {
+                position_x[i] = max_x;
+                velocity_x[i] *= -params_.edge_bounciness;
+            }
         }
 
-        if (particle.position.y < min_y)
+        if (position_y[i] < min_y)
         {
-            particle.position.y = min_y;
-            particle.velocity.y *= -params_.edge_bounciness;
+            if (wrap_y)
+            {
+                wrap_particle(i, 0.0f, period_shift(position_y[i], max_y));
+            }
+            else if (wall_top)
+            {
+                position_y[i] = min_y;
+                velocity_y[i] *= -params_.edge_bounciness;
+            }
         }
-        else if (particle.position.y > max_y)
+        else if (position_y[i] > max_y)
         {
-            particle.position.y = max_y;
-            particle.velocity.y *= -params_.edge_bounciness;
+            if (wrap_y)
+            {
+                wrap_particle(i, 0.0f, period_shift(position_y[i], max_y));
+            }
+            else if (wall_bottom)
+            {
+                position_y[i] = max_y;
+                velocity_y[i] *= -params_.edge_bounciness;
+            }
         }
-        if (std::isnan(particle.position.x))
+        if (std::isnan(position_x[i]))
         {
-            particle.position.x = 0;
+            position_x[i] = 0;
         }
-        if (std::isnan(particle.position.y))
+        if (std::isnan(position_y[i]))
         {
-            particle.position.y = 0;
+            position_y[i] = 0;
         }
     }
 
     // Particle object collisions
-    for (auto &object : objects_)
+    // Objects only read particles here, so they run in parallel, each accumulating into its own velocity buffer.
+    // The particles near each object are kept for the object particle collisions below.
+    object_particles_.resize(objects_.size());
+    object_particles_center_.resize(objects_.size());
+    auto collide_objects_with_particles = [&](size_t begin, size_t end, size_t)
     {
-        if (object.is_locked)
+        for (size_t object_index = begin; object_index < end; ++object_index)
         {
-            continue;
-        }
-
-        auto coliding_particles = particle_grid_.query(object.position, object.radius);
-
-        for (auto particle : coliding_particles)
-        {
-
-            float distance_sq = utils::distance_sq(object.position, particle->position);
-
-            if (distance_sq < 0.01f)
+            gather_object_particles(object_index);
+            Object &object = objects_[object_index];
+            if (object.is_locked)
             {
-                sf::Vector2f position_diff = particle->position - object.position;
-                particle->position += {position_diff.x > 0 ? 0.1f : -0.1f, position_diff.y > 0 ? 0.1f : -0.1f};
                 continue;
             }
 
-            float distance = std::sqrt(distance_sq);
+            const float radius_sq = object.radius * object.radius;
+            for (auto particle_id : object_particles_[object_index])
+            {
+                sf::Vector2f position_diff = particles_.position(particle_id) - object.position;
+                particle_grid_.wrap_difference(position_diff.x, position_diff.y);
 
-            sf::Vector2f collision_normal = (object.position - particle->position) / distance;
+                float distance_sq = position_diff.x * position_diff.x + position_diff.y * position_diff.y;
 
-            float inward_velocity = utils::dot_product(object.velocity - particle->velocity, collision_normal);
+                if (distance_sq > radius_sq || distance_sq < 0.01f) // Particles right at the center are nudged by the object particle collisions
+                {
+                    continue;
+                }
 
-            if (inward_velocity < 0)
-            {
-                float mass_ratio = object.mass / (object.mass + 1.0f); // Particle mass is implicitly 1.0f
-                object.velocity_buffer -= collision_normal * inward_velocity * mass_ratio / object.mass;
+                float distance = std::sqrt(distance_sq);
+
+                sf::Vector2f collision_normal = -position_diff / distance;
+
+                float inward_velocity = utils::dot_product(object.velocity - particles_.velocity(particle_id), collision_normal);
+
+                if (inward_velocity < 0)
+                {
+                    float mass_ratio = object.mass / (object.mass + 1.0f); // Particle mass is implicitly 1.0f
+                    object.velocity_buffer -= collision_normal * inward_velocity * mass_ratio / object.mass;
+                }
+                // sqrt here is necessary to prevent particles too much inside the object to push it too much
+                object.velocity_buffer += collision_normal * std::sqrt(object.radius - distance) / object.mass;
             }
-            // sqrt here is necessary to prevent particles too much inside the object to push it too much
-            object.velocity_buffer += collision_normal * std::sqrt(object.radius - distance) / object.mass;
+            object.velocity += object.velocity_buffer;
+            object.position = object.previous_position + object.velocity * dt_;
         }
-        object.velocity += object.velocity_buffer;
-        object.position = object.previous_position + object.velocity * dt_;
+    };
+    if (thread_pool_)
+    {
+        thread_pool_->parallel_for(objects_.size(), collide_objects_with_particles);
+    }
+    else
+    {
+        collide_objects_with_particles(0, objects_.size(), 0);
     }
 
     // Inter object and object boundary collisions
@@ -463,7 +1100,13 @@ void FluidSandbox::resolve_collisions()
             continue;
         }
 
-        if (object.position.x - object.radius < min_x)
+        // Objects wrap around periodic axes by their center and are stopped at all other edges
+        sf::Vector2f wrap_shift = {0.0f, 0.0f};
+        if (wrap_x)
+        {
+            wrap_shift.x = object.position.x < min_x || object.position.x > max_x ? period_shift(object.position.x, max_x) : 0.0f;
+        }
+        else if (object.position.x - object.radius < min_x)
         {
             object.position.x = min_x + object.radius;
             object.velocity.x *= -params_.edge_bounciness;
@@ -474,7 +1117,11 @@ void FluidSandbox::resolve_collisions()
             object.velocity.x *= -params_.edge_bounciness;
         }
 
-        if (object.position.y - object.radius < min_y)
+        if (wrap_y)
+        {
+            wrap_shift.y = object.position.y < min_y || object.position.y > max_y ? period_shift(object.position.y, max_y) : 0.0f;
+        }
+        else if (object.position.y - object.radius < min_y)
         {
             object.position.y = min_y + object.radius;
             object.velocity.y *= -params_.edge_bounciness;
@@ -484,56 +1131,126 @@ void FluidSandbox::resolve_collisions()
             object.position.y = max_y - object.radius;
             object.velocity.y *= -params_.edge_bounciness;
         }
+        object.position += wrap_shift;
+        object.previous_position += wrap_shift;
+        object.step_start += wrap_shift;
     }
 
     // Object particle collisions
-    for (auto &object : objects_)
+    // Objects may share particles here, so they run serially. Each object pushes particles by less than the largest push
+    // it makes, so a particle has moved at most `pushed` since the gathers. The gathered particles stay valid while that
+    // and the distance the object moved since stay within the margin, otherwise they are gathered again.
+    float pushed = 0.0f;
+    for (size_t object_index = 0; object_index < objects_.size(); ++object_index)
     {
-        auto coliding_particles = particle_grid_.query(object.position, object.radius);
+        Object &object = objects_[object_index];
+        if (std::sqrt(utils::distance_sq(object.position, object_particles_center_[object_index])) + pushed > OBJECT_PARTICLE_MARGIN)
+        {
+            gather_object_particles(object_index, pushed);
+        }
 
-        for (auto particle : coliding_particles)
+        float object_push = 0.0f;
+        const float radius_sq = object.radius * object.radius;
+        for (auto particle_id : object_particles_[object_index])
         {
+            sf::Vector2f position_diff = particles_.position(particle_id) - object.position;
+            particle_grid_.wrap_difference(position_diff.x, position_diff.y);
+
+            float distance_sq = position_diff.x * position_diff.x + position_diff.y * position_diff.y;
 
-            float distance_sq = utils::distance_sq(object.position, particle->position);
+            if (distance_sq > radius_sq)
+            {
+                continue;
+            }
 
             if (distance_sq < 0.01f)
             {
-                sf::Vector2f position_diff = particle->position - object.position;
-                particle->position += {position_diff.x > 0 ? 0.1f : -0.1f, position_diff.y > 0 ? 0.1f : -0.1f};
+                position_x[particle_id] += position_diff.x > 0 ? 0.1f : -0.1f;
+                position_y[particle_id] += position_diff.y > 0 ? 0.1f : -0.1f;
+                object_push = std::max(object_push, 0.15f); // The nudge moves less than 0.15
                 continue;
             }
 
             float distance = std::sqrt(distance_sq);
+            object_push = std::max(object_push, object.radius - distance);
 
-            sf::Vector2f collision_normal = (object.position - particle->position) / distance;
+            sf::Vector2f collision_normal = -position_diff / distance;
 
-            float inward_velocity = utils::dot_product(object.velocity - particle->velocity, collision_normal);
+            float inward_velocity = utils::dot_product(object.velocity - particles_.velocity(particle_id), collision_normal);
 
             if (inward_velocity < 0)
             {
                 float mass_ratio = object.mass / (object.mass + 1.0f); // Particle mass is implicitly 1.0f
-                particle->velocity += collision_normal * inward_velocity * (1.0f - mass_ratio);
+                velocity_x[particle_id] += collision_normal.x * inward_velocity * (1.0f - mass_ratio);
+                velocity_y[particle_id] += collision_normal.y * inward_velocity * (1.0f - mass_ratio);
             }
-            particle->position -= collision_normal * (object.radius - distance);
+            position_x[particle_id] -= collision_normal.x * (object.radius - distance);
+            position_y[particle_id] -= collision_normal.y * (object.radius - distance);
         }
+        pushed += object_push;
     }
 }
 
 void FluidSandbox::recalculate_velocity()
 {
     const float inv_dt = 1.0f / dt_;
-    for (auto &&particle : particles_)
+    const size_t num_particles = particles_.size();
+    const float *position_x = particles_.position_x.data();
+    const float *position_y = particles_.position_y.data();
+    const float *prev_position_x = particles_.prev_position_x.data();
+    const float *prev_position_y = particles_.prev_position_y.data();
+    float *velocity_x = particles_.velocity_x.data();
+    float *velocity_y = particles_.velocity_y.data();
+    if (adaptive_stepping_.courant > 0.0f)
     {
-        particle.velocity = (particle.position - particle.prev_position) * inv_dt;
+        // The particles moved with a velocity that already includes gravity and viscosity, so the change is what the
+        // springs, relaxation and collisions did, the acceleration estimate for the next substep
+        float max_change_sq = 0.0f;
+        for (size_t i = 0; i < num_particles; ++i)
+        {
+            const float new_velocity_x = (position_x[i] - prev_position_x[i]) * inv_dt;
+            const float new_velocity_y = (position_y[i] - prev_position_y[i]) * inv_dt;
+            const float change_x = new_velocity_x - velocity_x[i];
+            const float change_y = new_velocity_y - velocity_y[i];
+            max_change_sq = std::max(max_change_sq, change_x * change_x + change_y * change_y);
+            velocity_x[i] = new_velocity_x;
+            velocity_y[i] = new_velocity_y;
+        }
+        max_acceleration_ = std::sqrt(max_change_sq) * inv_dt;
+        return;
+    }
+    for (size_t i = 0; i < num_particles; ++i)
+    {
+        velocity_x[i] = (position_x[i] - prev_position_x[i]) * inv_dt;
+        velocity_y[i] = (position_y[i] - prev_position_y[i]) * inv_dt;
     }
 }
 
 void FluidSandbox::apply_gravity()
 {
-    for (auto &&particle : particles_)
+    const float gravity_dt_x = params_.gravity_x * dt_;
+    const float gravity_dt_y = params_.gravity_y * dt_;
+    if (const uint8_t *sleep = sleeping_mask())
     {
-        particle.velocity.x += params_.gravity_x * dt_;
-        particle.velocity.y += params_.gravity_y * dt_;
+        // Sleeping particles rest on the fluid below them, which does not push back
+        for (size_t i = 0; i < particles_.size(); ++i)
+        {
+            if (sleep[i] != AWAKE)
+                continue;
+            particles_.velocity_x[i] += gravity_dt_x;
+            particles_.velocity_y[i] += gravity_dt_y;
+        }
+    }
+    else
+    {
+        for (auto &&velocity_x : particles_.velocity_x)
+        {
+            velocity_x += gravity_dt_x;
+        }
+        for (auto &&velocity_y : particles_.velocity_y)
+        {
+            velocity_y += gravity_dt_y;
+        }
     }
     for (auto &&object : objects_)
     {
@@ -552,34 +1269,45 @@ void FluidSandbox::apply_viscosity()
     const float inv_interaction_radius = 1.0f / params_.interaction_radius;
     const float dt_half = 0.5f * dt_;
 
-    size_t num_particles = particles_.size();
-
-    for (size_t i = 0; i < num_particles; ++i)
-    {
-        size_t particle_id = reverse_calculation_order_ ? num_particles - i - 1 : i;
-        auto &particle = particles_[particle_id];
+    float *position_x = particles_.position_x.data();
+    float *position_y = particles_.position_y.data();
+    float *velocity_x = particles_.velocity_x.data();
+    float *velocity_y = particles_.velocity_y.data();
+    const uint32_t *neighbor_ids = particle_neighbors_.indices.data();
+    const uint8_t *sleep = sleeping_mask(); // Sleeping particles stay stopped
 
-        auto &neighbors = particle_neighbors_[particle_id];
+    for_each_particle_ordered([&](size_t particle_id, size_t)
+                              {
+        const uint32_t neighbors_begin = particle_neighbors_.begin(particle_id);
+        const uint32_t neighbors_end = particle_neighbors_.end(particle_id);
+        const bool particle_awake = !sleep || sleep[particle_id] == AWAKE;
 
-        for (auto &&neighbor : neighbors)
+        for (uint32_t n = neighbors_begin; n < neighbors_end; ++n)
         {
-            if (neighbor <= &particle)
+            const uint32_t neighbor_id = neighbor_ids[n];
+            const bool neighbor_awake = !sleep || sleep[neighbor_id] == AWAKE;
+            if (!particle_awake && !neighbor_awake)
                 continue;
 
-            float distance_sq = utils::distance_sq(particle.position, neighbor->position);
+            float position_diff_x = position_x[neighbor_id] - position_x[particle_id];
+            float position_diff_y = position_y[neighbor_id] - position_y[particle_id];
+            particle_grid_.wrap_difference(position_diff_x, position_diff_y);
+            float distance_sq = position_diff_x * position_diff_x + position_diff_y * position_diff_y;
 
             if (distance_sq >= interaction_radius_sq)
                 continue;
 
             if (distance_sq < 0.01f)
             {
-                sf::Vector2f position_diff = neighbor->position - particle.position;
-                neighbor->position += {position_diff.x > 0 ? 0.1f : -0.1f, position_diff.y > 0 ? 0.1f : -0.1f};
+                if (neighbor_awake)
+                {
+                    position_x[neighbor_id] += position_diff_x > 0 ? 0.1f : -0.1f;
+                    position_y[neighbor_id] += position_diff_y > 0 ? 0.1f : -0.1f;
+                }
                 continue;
             }
 
-            sf::Vector2f position_diff = (neighbor->position - particle.position);
-            float non_normal_inward_velocity = utils::dot_product((particle.velocity - neighbor->velocity), position_diff);
+            float non_normal_inward_velocity = (velocity_x[particle_id] - velocity_x[neighbor_id]) * position_diff_x + (velocity_y[particle_id] - velocity_y[neighbor_id]) * position_diff_y;
 
             if (non_normal_inward_velocity > 0.0f)
             {
@@ -588,70 +1316,272 @@ void FluidSandbox::apply_viscosity()
 
                 float impulse_magnitude = dt_half * (1 - distance * inv_interaction_radius) * inward_velocity * (params_.linear_viscosity + params_.quadratic_viscosity * inward_velocity) / distance;
 
-                sf::Vector2f impulse = position_diff * impulse_magnitude;
+                float impulse_x = position_diff_x * impulse_magnitude;
+                float impulse_y = position_diff_y * impulse_magnitude;
 
-                particle.velocity -= impulse;
-                neighbor->velocity += impulse;
+                if (particle_awake)
+                {
+                    velocity_x[particle_id] -= impulse_x;
+                    velocity_y[particle_id] -= impulse_y;
+                }
+                if (neighbor_awake)
+                {
+                    velocity_x[neighbor_id] += impulse_x;
+                    velocity_y[neighbor_id] += impulse_y;
+                }
             }
         }
-    }
+    });
 }
 
-void FluidSandbox::draw(sf::RenderTarget &target, sf::RenderStates states) const
+void FluidSandbox::remove_drained_particles()
 {
-    // Draw particles as squares
-    sf::VertexArray particle_vertices(sf::PrimitiveType::Triangles, particles_.size() * 6);
-    for (size_t i = 0; i < particles_.size(); i++)
+    const bool out_left = boundaries_.left == BoundaryMode::Outflow;
+    const bool out_right = boundaries_.right == BoundaryMode::Outflow;
+    const bool out_top = boundaries_.top == BoundaryMode::Outflow;
+    const bool out_bottom = boundaries_.bottom == BoundaryMode::Outflow;
+    const float max_x = static_cast<float>(size_.x);
+    const float max_y = static_cast<float>(size_.y);
+    const float *position_x = particles_.position_x.data();
+    const float *position_y = particles_.position_y.data();
+
+    const size_t num_particles = particles_.size();
+    particles_.remove_if([&](size_t i)
+                         {
+                             const float x = position_x[i];
+                             const float y = position_y[i];
+                             const bool drained = (out_left && x < 0.0f) || (out_right && x > max_x) || (out_top && y < 0.0f) || (out_bottom && y > max_y) ||
+                                                  std::any_of(sinks_.begin(), sinks_.end(), [x, y](const ParticleSink &sink)
+                                                              { return sink.region.contains(x, y); });
+                             if (drained)
+                             {
+                                 wake_cells({x, y}, 0.0f);
+                             }
+                             return drained; });
+    if (particles_.size() != num_particles)
     {
-        auto &&particle = particles_[i];
-        float particle_size = std::max(params_.base_particle_size + particle.stress * params_.particle_stress_size_multiplier, 1.0f);
-        int pressure_color = std::clamp(static_cast<int>(params_.base_particle_color - particle.stress * params_.particle_stress_color_multiplier), 0, 255);
-        sf::Color particle_color = sf::Color(pressure_color, pressure_color, 255);
+        neighbors_valid_ = false;
+    }
+}
+
+bool FluidSandbox::sleep_matches_grid() const
+{
+    return !cell_calm_steps_.empty() && sleep_columns_ == particle_grid_.columns() && sleep_rows_ == particle_grid_.rows() &&
+           sleep_cell_size_ == particle_grid_.cell_size() && cell_calm_steps_.size() == sleep_columns_ * sleep_rows_;
+}
+
+size_t FluidSandbox::neighbor_cell_reach() const
+{
+    return static_cast<size_t>(std::ceil(neighbor_radius_ / static_cast<float>(particle_grid_.cell_size())));
+}
 
-        particle_vertices[i * 6].position = particle.position + sf::Vector2f(-particle_size, -particle_size);
-        particle_vertices[i * 6 + 1].position = particle.position + sf::Vector2f({particle_size, -particle_size});
-        particle_vertices[i * 6 + 2].position = particle.position + sf::Vector2f(particle_size, particle_size);
-        particle_vertices[i * 6 + 3].position = particle.position + sf::Vector2f(-particle_size, -particle_size);
-        particle_vertices[i * 6 + 4].position = particle.position + sf::Vector2f(particle_size, particle_size);
-        particle_vertices[i * 6 + 5].position = particle.position + sf::Vector2f(-particle_size, particle_size);
-        for (size_t j = 0; j < 6; j++)
+template <typename Callback>
+void FluidSandbox::for_each_cell_around(size_t cell, size_t reach, Callback &&callback) const
+{
+    // First cell and number of cells along one axis, a range wrapping around a periodic axis visits each cell once
+    auto span = [reach](size_t center, size_t count, bool periodic) -> std::pair<size_t, size_t>
+    {
+        if (periodic)
+        {
+            if (2 * reach + 1 >= count)
+                return {0, count};
+            return {(center + count - reach) % count, 2 * reach + 1};
+        }
+        const size_t first = center > reach ? center - reach : 0;
+        return {first, std::min(center + reach, count - 1) - first + 1};
+    };
+    const auto [first_x, length_x] = span(cell % sleep_columns_, sleep_columns_, particle_grid_.periodic_x());
+    const auto [first_y, length_y] = span(cell / sleep_columns_, sleep_rows_, particle_grid_.periodic_y());
+    for (size_t j = 0; j < length_y; ++j)
+    {
+        const size_t row_offset = (first_y + j) % sleep_rows_ * sleep_columns_;
+        for (size_t i = 0; i < length_x; ++i)
         {
-            particle_vertices[i * 6 + j].color = particle_color;
+            callback((first_x + i) % sleep_columns_ + row_offset);
         }
     }
+}
 
-    states.blendMode = sf::BlendMax;
-    target.draw(particle_vertices, states);
-    states.blendMode = sf::BlendAlpha;
+void FluidSandbox::update_sleep()
+{
+    const size_t columns = particle_grid_.columns();
+    const size_t rows = particle_grid_.rows();
+    const size_t num_cells = columns * rows;
+    if (sleep_settings_.speed_threshold <= 0.0f || num_cells == 0)
+    {
+        if (!cell_calm_steps_.empty())
+        {
+            cell_calm_steps_.clear();
+            cell_sleep_.clear();
+            neighbors_valid_ = false;
+        }
+        sleeping_particles_ = 0;
+        return;
+    }
+    if (!sleep_matches_grid() || !sleep_params_.physics_equal(params_))
+    {
+        // Counters collected in another grid layout or under other parameters say nothing about the fluid now
+        sleep_columns_ = columns;
+        sleep_rows_ = rows;
+        sleep_cell_size_ = particle_grid_.cell_size();
+        sleep_params_ = params_;
+        cell_calm_steps_.assign(num_cells, 0);
+        cell_sleep_.assign(num_cells, AWAKE);
+        neighbors_valid_ = false;
+    }
 
-    // Draw objects as circles
-    sf::VertexArray object_vertices(sf::PrimitiveType::Triangles, objects_.size() * CIRCLE_DRAW_SEGMENTS * 3);
+    const uint32_t sleep_steps = static_cast<uint32_t>(std::min<size_t>(sleep_settings_.steps, UINT32_MAX));
+    for (auto &&calm_steps : cell_calm_steps_)
+    {
+        if (calm_steps < sleep_steps)
+        {
+            ++calm_steps;
+        }
+    }
 
-    for (size_t i = 0; i < objects_.size(); ++i)
+    // Anything that may move during the step wakes the cells within the neighbor reach of where it can get to
+    const float threshold = sleep_settings_.speed_threshold;
+    const size_t reach = neighbor_cell_reach();
+    const size_t max_reach = columns + rows;
+    const size_t num_particles = particles_.size();
+    float *position_x = particles_.position_x.data();
+    float *position_y = particles_.position_y.data();
+    float *velocity_x = particles_.velocity_x.data();
+    float *velocity_y = particles_.velocity_y.data();
+    auto wake_around = [this](size_t cell, size_t cell_reach)
     {
-        const auto &object = objects_[i];
-        sf::Color object_color = object.is_locked ? sf::Color(128, 0, 0) : sf::Color(0, 128, 0);
+        for_each_cell_around(cell, cell_reach, [this](size_t around)
+                             { cell_calm_steps_[around] = 0; });
+    };
 
-        sf::Vector2f center_pos = object.position;
+    // Fastest particle of each cell, so every cell is only spread once
+    cell_speed_.resize(num_cells);
+    std::fill(cell_speed_.begin(), cell_speed_.end(), 0.0f);
+    for (size_t i = 0; i < num_particles; ++i)
+    {
+        const float speed_sq = velocity_x[i] * velocity_x[i] + velocity_y[i] * velocity_y[i];
+        if (!(speed_sq < threshold * threshold)) // NaN speeds of an exploded simulation count as fast
+        {
+            float &cell_speed = cell_speed_[particle_grid_.cell_of(position_x[i], position_y[i])];
+            cell_speed = std::max(cell_speed, std::sqrt(speed_sq));
+        }
+    }
+    for (size_t cell = 0; cell < num_cells; ++cell)
+    {
+        if (cell_speed_[cell] > 0.0f)
+        {
+            wake_around(cell, reach + cells_within(cell_speed_[cell] * step_size_, sleep_cell_size_, max_reach));
+        }
+    }
+    for (auto &&object : objects_)
+    {
+        // Dragged objects are moved without a velocity, so the distance moved since the last step counts too
+        const float speed = std::hypot(object.velocity.x, object.velocity.y);
+        const float moved = std::hypot(object.position.x - object.step_start.x, object.position.y - object.step_start.y);
+        if (speed < threshold && moved < threshold * step_size_)
+            continue;
+        const float distance = object.radius + std::max(speed * step_size_, moved);
+        wake_around(particle_grid_.cell_of(object.position.x, object.position.y), reach + cells_within(distance, sleep_cell_size_, max_reach));
+    }
 
-        for (size_t j = 0; j < CIRCLE_DRAW_SEGMENTS; ++j)
+    // A sleeping cell within the reach of an awake one holds up its particles, so its densities have to be summed from
+    // all pairs, which are listed under particles up to twice the reach away from awake ones. Springs of sleeping pairs
+    // are only kept by the spring pass, so with springs every sleeping cell keeps its lists.
+    const bool deep_sleep = params_.spring_stiffness == 0.0f;
+    cell_flags_.resize(num_cells);
+    std::fill(cell_flags_.begin(), cell_flags_.end(), static_cast<uint8_t>(!deep_sleep));
+    if (deep_sleep)
+    {
+        for (size_t cell = 0; cell < num_cells; ++cell)
         {
-            float angle1 = static_cast<float>(j) / CIRCLE_DRAW_SEGMENTS * 2.0f * M_PI;
-            float angle2 = static_cast<float>(j + 1) / CIRCLE_DRAW_SEGMENTS * 2.0f * M_PI;
+            if (cell_calm_steps_[cell] >= sleep_steps)
+                continue;
+            for_each_cell_around(cell, 2 * reach, [this](size_t around)
+                                 { cell_flags_[around] = 1; });
+        }
+    }
+    bool changed = false;
+    for (size_t cell = 0; cell < num_cells; ++cell)
+    {
+        const uint8_t level = cell_calm_steps_[cell] < sleep_steps ? AWAKE : (cell_flags_[cell] ? FROZEN : DEEP);
+        changed = changed || level != cell_sleep_[cell];
+        cell_sleep_[cell] = level;
+    }
+    if (changed)
+    {
+        neighbors_valid_ = false;
+    }
+
+    // Particles of sleeping cells were slower than the threshold for all those steps, now they stop
+    sleeping_particles_ = 0;
+    for (size_t i = 0; i < num_particles; ++i)
+    {
+        if (cell_sleep_[particle_grid_.cell_of(position_x[i], position_y[i])] == AWAKE)
+            continue;
+        velocity_x[i] = 0.0f;
+        velocity_y[i] = 0.0f;
+        ++sleeping_particles_;
+    }
+}
 
-            sf::Vector2f p1 = object.position + sf::Vector2f(std::cos(angle1) * object.radius, std::sin(angle1) * object.radius);
-            sf::Vector2f p2 = object.position + sf::Vector2f(std::cos(angle2) * object.radius, std::sin(angle2) * object.radius);
+void FluidSandbox::wake_cells(sf::Vector2f position, float radius)
+{
+    if (cell_calm_steps_.empty())
+        return;
+    if (!sleep_matches_grid())
+    {
+        wake_all_cells();
+        return;
+    }
+    const size_t reach = neighbor_cell_reach();
+    const size_t wake_reach = reach + cells_within(radius, sleep_cell_size_, sleep_columns_ + sleep_rows_);
+    const size_t cell = particle_grid_.cell_of(position.x, position.y);
+    for_each_cell_around(cell, wake_reach + 2 * reach, [this](size_t around)
+                         {
+                             if (cell_sleep_[around] == DEEP)
+                             {
+                                 cell_sleep_[around] = FROZEN;
+                             } });
+    for_each_cell_around(cell, wake_reach, [this](size_t around)
+                         {
+                             cell_calm_steps_[around] = 0;
+                             cell_sleep_[around] = AWAKE; });
+    neighbors_valid_ = false;
+}
 
-            size_t vertex_idx = (i * CIRCLE_DRAW_SEGMENTS + j) * 3;
+void FluidSandbox::wake_all_cells()
+{
+    if (cell_calm_steps_.empty())
+        return;
+    std::fill(cell_calm_steps_.begin(), cell_calm_steps_.end(), 0);
+    std::fill(cell_sleep_.begin(), cell_sleep_.end(), AWAKE);
+    neighbors_valid_ = false;
+}
 
-            object_vertices[vertex_idx].position = object.position;
-            object_vertices[vertex_idx + 1].position = p1;
-            object_vertices[vertex_idx + 2].position = p2;
+void FluidSandbox::mark_sleeping_particles()
+{
+    particle_sleep_.clear();
+    if (!sleep_matches_grid() || std::all_of(cell_sleep_.begin(), cell_sleep_.end(), [](uint8_t level)
+                                             { return level == AWAKE; }))
+        return;
 
-            object_vertices[vertex_idx].color = object_color;
-            object_vertices[vertex_idx + 1].color = object_color;
-            object_vertices[vertex_idx + 2].color = object_color;
+    const size_t num_cells = cell_sleep_.size();
+    const std::vector<uint32_t> &cell_order = particle_grid_.cell_order();
+    const float *velocity_x = particles_.velocity_x.data();
+    const float *velocity_y = particles_.velocity_y.data();
+    particle_sleep_.resize(particles_.size());
+    skip_cells_.resize(num_cells);
+    for (size_t cell = 0; cell < num_cells; ++cell)
+    {
+        const uint8_t level = cell_sleep_[cell];
+        bool skip = level == DEEP;
+        for (uint32_t n = particle_grid_.cell_begin(cell); n < particle_grid_.cell_end(cell); ++n)
+        {
+            // Particles that moved into a sleeping cell during the step are awake until the next step
+            const uint32_t i = cell_order[n];
+            particle_sleep_[i] = velocity_x[i] == 0.0f && velocity_y[i] == 0.0f ? level : AWAKE;
+            skip = skip && particle_sleep_[i] == DEEP;
         }
+        skip_cells_[cell] = skip;
     }
-    target.draw(object_vertices, states);
 }
@@ -3,17 +3,31 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <array>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <tuple>
 #include <unordered_map>
 #include <algorithm>
-#include <optional>
+#include <memory>
 
+#include "emitter.h"
+#include "frame_arena.h"
 #include "particle.h"
+#include "particle_store.h"
+#include "profiler.h"
 #include "object.h"
+#include "render_state.h"
+#include "neighbor_list.h"
 #include "spatial_hash_grid.h"
+#include "spring_table.h"
+#include "thread_pool.h"
+#include "trajectory.h"
+#include "uniform_grid.h"
 
 inline constexpr float SIMULATION_SPEED_DEFAULT = 100.0f;
+inline constexpr float SUBSTEPS_DEFAULT = 1.0f;
 inline constexpr float GRAVITY_X_DEFAULT = 0.0f;
 inline constexpr float GRAVITY_Y_DEFAULT = 0.4f;
 inline constexpr float EDGE_BOUNCINESS_DEFAULT = 0.0f;
@@ -35,7 +49,131 @@ inline constexpr float PARTICLE_STRESS_SIZE_MULTIPLIER_DEFAULT = 7.0f;
 inline constexpr float BASE_PARTICLE_COLOR_DEFAULT = 255.0f;
 inline constexpr float PARTICLE_STRESS_COLOR_MULTIPLIER_DEFAULT = 125.0f;
 
-constexpr size_t CIRCLE_DRAW_SEGMENTS = 30;
+constexpr size_t PARTICLE_REORDER_INTERVAL_DEFAULT = 20; // Steps between sorting particles by grid cell (0 = never)
+constexpr float OBJECT_PARTICLE_MARGIN = 4.0f; // How far an object may move during the collisions before its nearby particles are gathered again
+constexpr float ADAPTIVE_MAX_SUBSTEP_DEFAULT = 1.0f; // Same as the limit of fixed substeps
+constexpr size_t ADAPTIVE_MAX_SUBSTEPS_DEFAULT = 32;
+constexpr size_t SLEEP_STEPS_DEFAULT = 30; // Calm steps before a grid cell falls asleep
+
+/**
+ * @brief The phases of one simulation step, in the order they run.
+ */
+enum class SimulationPhase
+{
+    Move,
+    Neighbors,
+    Springs,
+    Relaxation,
+    Collisions,
+    Velocity,
+    Gravity,
+    Viscosity,
+    Count
+};
+
+constexpr size_t SIMULATION_PHASE_COUNT = static_cast<size_t>(SimulationPhase::Count);
+
+// Names of the phases (the methods running them)
+constexpr const char *SIMULATION_PHASE_NAMES[SIMULATION_PHASE_COUNT] = {
+    "move_everything",
+    "update_neighbors",
+    "adjust_apply_strings",
+    "do_double_density_relaxation",
+    "resolve_collisions",
+    "recalculate_velocity",
+    "apply_gravity",
+    "apply_viscosity",
+};
+
+// Profiler entries of FluidSandbox: one per simulation phase (measured per substep), then the whole step
+constexpr size_t PROFILE_STEP = SIMULATION_PHASE_COUNT;
+constexpr size_t PROFILE_ENTRY_COUNT = SIMULATION_PHASE_COUNT + 1;
+
+/**
+ * @brief What decided the length of a substep.
+ */
+enum class StepLimit : uint8_t
+{
+    Fixed,        // Adaptive stepping is off, the step is split into `substeps` equal substeps
+    Velocity,     // CFL: the fastest particle or object would move `courant` interaction radii
+    Acceleration, // The largest acceleration would move a particle at rest `courant` interaction radii
+    MaxSubstep,   // The fluid is calm, the substep is as long as allowed
+    MinSubstep,   // The step is already split into the most substeps allowed
+    Count
+};
+
+constexpr size_t STEP_LIMIT_COUNT = static_cast<size_t>(StepLimit::Count);
+
+// Names of the step limits (as printed by the tools)
+constexpr const char *STEP_LIMIT_NAMES[STEP_LIMIT_COUNT] = {"fixed", "velocity", "acceleration", "max_substep", "min_substep"};
+
+/**
+ * @brief Settings of adaptive time stepping (see FluidSandbox::set_adaptive_stepping).
+ */
+struct AdaptiveStepSettings
+{
+    float courant = 0.0f; // Fraction of the interaction radius a particle may move during a substep (0 = fixed substeps)
+    float max_substep = ADAPTIVE_MAX_SUBSTEP_DEFAULT; // Longest substep, taken while the fluid is calm
+    size_t max_substeps = ADAPTIVE_MAX_SUBSTEPS_DEFAULT; // Most substeps per step, bounds the cost of a violent step
+};
+
+/**
+ * @brief How the last step was split into substeps.
+ */
+struct StepStats
+{
+    size_t substeps = 0;
+    float min_substep = 0.0f;
+    float max_substep = 0.0f;
+    float max_speed = 0.0f; // Largest particle or object speed seen when choosing a substep (adaptive stepping only)
+    float max_acceleration = 0.0f; // Largest acceleration estimate used when choosing a substep (adaptive stepping only)
+    std::array<size_t, STEP_LIMIT_COUNT> limited_by{}; // Number of substeps whose length each limit decided
+};
+
+/**
+ * @brief Settings of sleeping fluid (see FluidSandbox::set_sleeping).
+ */
+struct SleepSettings
+{
+    float speed_threshold = 0.0f; // Speed below which a particle counts as calm (0 = nothing ever sleeps)
+    size_t steps = SLEEP_STEPS_DEFAULT; // Steps a grid cell has to stay calm before it falls asleep
+};
+
+/**
+ * @brief What happens at an edge of the simulation area.
+ */
+enum class BoundaryMode : uint8_t
+{
+    Wall,     // Particles and objects are stopped at the edge (bouncing off with the edge bounciness)
+    Periodic, // Leaving through the edge enters through the opposite one, which has to be periodic too
+    Outflow,  // Particles leaving through the edge are removed, objects are stopped like by a wall
+    Count
+};
+
+constexpr size_t BOUNDARY_MODE_COUNT = static_cast<size_t>(BoundaryMode::Count);
+
+// Names of the boundary modes (as used in scene files)
+constexpr const char *BOUNDARY_MODE_NAMES[BOUNDARY_MODE_COUNT] = {"wall", "periodic", "outflow"};
+
+/**
+ * @brief Boundary modes of the four edges of the simulation area.
+ */
+struct Boundaries
+{
+    BoundaryMode left = BoundaryMode::Wall;
+    BoundaryMode right = BoundaryMode::Wall;
+    BoundaryMode top = BoundaryMode::Wall;
+    BoundaryMode bottom = BoundaryMode::Wall;
+
+    bool periodic_x() const { return left == BoundaryMode::Periodic && right == BoundaryMode::Periodic; }
+    bool periodic_y() const { return top == BoundaryMode::Periodic && bottom == BoundaryMode::Periodic; }
+    bool has_outflow() const
+    {
+        return left == BoundaryMode::Outflow || right == BoundaryMode::Outflow || top == BoundaryMode::Outflow || bottom == BoundaryMode::Outflow;
+    }
+
+    bool operator==(const Boundaries &) const = default;
+};
 
 /**
  * @brief Structure holding all tunable parameters for the fluid simulation.
@@ -44,6 +182,7 @@ struct SimulationParameters
 {
     // Physics parameters
     float simulation_speed = SIMULATION_SPEED_DEFAULT;
+    float substeps = SUBSTEPS_DEFAULT; // Number of substeps per step (rounded, at least 1)
     float gravity_x = GRAVITY_X_DEFAULT;
     float gravity_y = GRAVITY_Y_DEFAULT;
     float edge_bounciness = EDGE_BOUNCINESS_DEFAULT;
@@ -68,12 +207,29 @@ struct SimulationParameters
     float particle_stress_size_multiplier = PARTICLE_STRESS_SIZE_MULTIPLIER_DEFAULT;
     float base_particle_color = BASE_PARTICLE_COLOR_DEFAULT;
     float particle_stress_color_multiplier = PARTICLE_STRESS_COLOR_MULTIPLIER_DEFAULT;
+
+    bool operator==(const SimulationParameters &) const = default;
+
+    /**
+     * @brief Compares only the physics parameters, the ones that change how the fluid moves.
+     * @param other Parameters to compare with.
+     * @return True if all physics parameters are equal.
+     */
+    bool physics_equal(const SimulationParameters &other) const
+    {
+        return simulation_speed == other.simulation_speed && substeps == other.substeps && gravity_x == other.gravity_x &&
+               gravity_y == other.gravity_y && edge_bounciness == other.edge_bounciness && interaction_radius == other.interaction_radius &&
+               rest_density == other.rest_density && stiffness == other.stiffness && near_stiffness == other.near_stiffness &&
+               linear_viscosity == other.linear_viscosity && quadratic_viscosity == other.quadratic_viscosity &&
+               plasticity == other.plasticity && yield_ratio == other.yield_ratio && spring_stiffness == other.spring_stiffness;
+    }
 };
 
 /**
  * @brief Main class for the fluid simulation sandbox.
+ * Drawing is done by SandboxView from a RenderState captured after a step, so the simulation can run on its own thread.
  */
-class FluidSandbox : public sf::Drawable
+class FluidSandbox
 {
 public:
     /**
@@ -106,14 +262,183 @@ public:
      */
     SimulationParameters &params() { return params_; }
 
+    /**
+     * @brief Gets the simulation parameters.
+     * @return Reference to the simulation parameters.
+     */
+    const SimulationParameters &params() const { return params_; }
+
+    /**
+     * @brief Gets all particles of the simulation.
+     * @return Reference to the particle store (indices change whenever particles are reordered, added or removed).
+     */
+    const ParticleStore &particles() const { return particles_; }
+
+    /**
+     * @brief Gets all objects of the simulation.
+     * @return Reference to the objects.
+     */
+    const std::vector<Object> &objects() const { return objects_; }
+
+    /**
+     * @brief Sets how often particles are reordered in memory by their grid cell.
+     * Keeping spatially close particles close in memory makes neighbor accesses cache friendly.
+     * Particle IDs and stress move with the particles and springs are keyed by particle IDs, so they stay valid.
+     * @param steps Number of simulation steps between reorders (0 disables reordering).
+     */
+    void set_reorder_interval(size_t steps) { reorder_interval_ = steps; }
+
+    /**
+     * @brief Sets the skin of the Verlet neighbor lists.
+     * With a skin, neighbors are gathered within `interaction_radius + skin` and the lists and the particle grid are
+     * only rebuilt once a particle has moved more than half the skin since the last build. Every pass checks the
+     * interaction radius against the current positions, so the same pairs interact as without a skin (summed in a
+     * different order, so results differ in rounding). Resuming a snapshot rebuilds the lists, so it is only
+     * bit-exact without a skin.
+     * @param skin Extra gathering distance (0 rebuilds the lists every substep).
+     */
+    void set_neighbor_skin(float skin)
+    {
+        neighbor_skin_ = std::max(0.0f, skin);
+        neighbors_valid_ = false;
+    }
+
+    /**
+     * @brief Sets up adaptive time stepping, which replaces the `substeps` parameter.
+     * Every step still advances the simulation by its whole length, but each substep is chosen from the state it
+     * starts in: short enough that the fastest particle or object moves at most `courant` interaction radii (CFL)
+     * and that the largest acceleration of the last substep (plus gravity) would move a particle at rest no
+     * farther, and at most `max_substep` long. Calm fluid then takes few long substeps and violent fluid many short
+     * ones. The acceleration estimate is saved in snapshots, so resuming stays bit-exact.
+     * @param settings The settings (a courant number of 0 goes back to fixed substeps).
+     */
+    void set_adaptive_stepping(const AdaptiveStepSettings &settings) { adaptive_stepping_ = settings; }
+
+    /**
+     * @brief Gets the adaptive time stepping settings.
+     * @return The settings.
+     */
+    const AdaptiveStepSettings &adaptive_stepping() const { return adaptive_stepping_; }
+
+    /**
+     * @brief Gets how the last step was split into substeps.
+     * @return The statistics.
+     */
+    const StepStats &step_stats() const { return step_stats_; }
+
+    /**
+     * @brief Sets up sleeping of settled fluid, tracked per particle grid cell.
+     * A cell falls asleep once all particles in it and the cells around it have stayed slower than the threshold
+     * for `steps` steps. Its particles are then stopped and left out of gravity, springs, relaxation and viscosity,
+     * they only hold up the awake fluid around them like a wall. Cells deep inside a sleeping region (out of reach
+     * of every awake particle) don't even get neighbor lists, unless springs are on, so a large settled tank costs
+     * little more than moving its particles through the grid. Fast particles or moving objects nearby wake a cell,
+     * and so do spawning, removing, adding or removing objects and pushing everything. The calm step counters are
+     * saved in snapshots, so resuming stays bit-exact.
+     * @param settings The settings (a threshold of 0 turns sleeping off and wakes everything).
+     */
+    void set_sleeping(const SleepSettings &settings)
+    {
+        sleep_settings_ = settings;
+        sleep_settings_.steps = std::max<size_t>(sleep_settings_.steps, 1);
+        wake_all_cells();
+    }
+
+    /**
+     * @brief Gets the sleeping settings.
+     * @return The settings.
+     */
+    const SleepSettings &sleeping() const { return sleep_settings_; }
+
+    /**
+     * @brief Gets the number of particles that were asleep during the last step.
+     * @return Number of particles.
+     */
+    size_t sleeping_particle_count() const { return sleeping_particles_; }
+
+    /**
+     * @brief Gets how many times the neighbor lists have been built.
+     * @return Number of builds.
+     */
+    size_t neighbor_builds() const { return neighbor_builds_; }
+
+    /**
+     * @brief Sets the number of threads used to simulate a step.
+     * With more than one thread, neighbor gathering, springs, double density relaxation and viscosity run on a
+     * fixed-size worker pool. Passes that move neighbors in place process grid cells colored so that cells of one
+     * color never share a neighbor, so every count of two or more threads gives the same result. A single thread
+     * processes the particles in another order and gives a slightly different result.
+     * @param count Number of threads (1 = single threaded).
+     */
+    void set_thread_count(size_t count);
+
+    /**
+     * @brief Gets the number of threads used to simulate a step.
+     * @return Number of threads.
+     */
+    size_t thread_count() const { return thread_pool_ ? thread_pool_->thread_count() : 1; }
+
     /**
      * @brief Resizes the simulation area.
      * @param size The new size of the simulation area.
      */
-    void resize(sf::Vector2u size) { size_ = size; }
+    void resize(sf::Vector2u size)
+    {
+        size_ = size;
+        neighbors_valid_ = false;
+        wake_all_cells();
+    }
+
+    /**
+     * @brief Sets what happens at each edge of the simulation area.
+     * An axis only wraps around if both of its edges are periodic and it is long enough for three particle grid
+     * cells (`size / (interaction_radius + skin + 1)`), otherwise its periodic edges act as walls. Particles crossing
+     * a periodic edge reappear at the opposite one and interact with particles across it as if the area repeated,
+     * so a small tile can stand in for a large body of fluid. Objects wrap too, but only collide with each other
+     * within the area. Particles past an outflow edge are removed at the end of the substep.
+     * @param boundaries The modes of the edges.
+     */
+    void set_boundaries(const Boundaries &boundaries)
+    {
+        boundaries_ = boundaries;
+        neighbors_valid_ = false;
+        wake_all_cells();
+    }
+
+    /**
+     * @brief Gets the modes of the edges of the simulation area.
+     * @return The boundary modes.
+     */
+    const Boundaries &boundaries() const { return boundaries_; }
+
+    /**
+     * @brief Sets the emitters, each spawns `rate * step_size` particles at the start of every step it is active in.
+     * @param emitters The emitters (replacing the current ones).
+     */
+    void set_emitters(std::vector<ParticleEmitter> emitters) { emitters_ = std::move(emitters); }
+
+    /**
+     * @brief Gets the emitters.
+     * @return The emitters.
+     */
+    const std::vector<ParticleEmitter> &emitters() const { return emitters_; }
+
+    /**
+     * @brief Sets the sinks, which remove the particles inside them at the end of every substep.
+     * Together with emitters, a scene with continuous inflow and outflow runs at constant memory once the particle
+     * count has leveled off: removed particles free their slots for new ones.
+     * @param sinks The sinks (replacing the current ones).
+     */
+    void set_sinks(std::vector<ParticleSink> sinks) { sinks_ = std::move(sinks); }
+
+    /**
+     * @brief Gets the sinks.
+     * @return The sinks.
+     */
+    const std::vector<ParticleSink> &sinks() const { return sinks_; }
 
     /**
-     * @brief Clears all particles and objects.
+     * @brief Clears all particles and objects (the boundary modes, emitters and sinks are kept).
      */
     void clear();
 
@@ -129,6 +454,27 @@ public:
      */
     void add_object(sf::Vector2f position);
 
+    /**
+     * @brief Adds a single particle to the simulation.
+     * @param position The position of the particle.
+     * @param velocity The initial velocity of the particle (defaults to zero).
+     */
+    void add_particle(sf::Vector2f position, sf::Vector2f velocity = {0.0f, 0.0f})
+    {
+        particles_.push_back(Particle(position, velocity));
+        neighbors_valid_ = false;
+        wake_cells(position, 0.0f);
+    }
+
+    /**
+     * @brief Adds an object to the simulation, even if it overlaps an existing object.
+     * @param position The position of the object.
+     * @param radius The radius of the object.
+     * @param mass The mass of the object.
+     * @param locked Whether the object starts locked in place.
+     */
+    void add_object(sf::Vector2f position, float radius, float mass, bool locked = false);
+
     /**
      * @brief Removes particles or objects at a given position.
      * @param position The position to remove particles or objects from.
@@ -148,11 +494,23 @@ public:
     void toggle_lock_object(sf::Vector2f position);
 
     /**
-     * @brief Attempts to grab an object at a given position.
+     * @brief Grabs an object at a given position, locking it in place until it is released.
      * @param position The position to check for an object.
-     * @return An optional pointer to the grabbed object, or nullopt if no object was found.
+     * @return True if an object was grabbed.
+     */
+    bool grab_object(sf::Vector2f position);
+
+    /**
+     * @brief Moves the grabbed object (keeping the offset from the position it was grabbed at).
+     * @param position The new grab position.
+     * @return False if no object is grabbed.
      */
-    std::optional<Object *> try_grab_object(sf::Vector2f position);
+    bool move_grabbed_object(sf::Vector2f position);
+
+    /**
+     * @brief Releases the grabbed object, unlocking it again unless it was locked before being grabbed.
+     */
+    void release_object();
 
     /**
      * @brief Pushes all particles and objects in a given direction.
@@ -161,35 +519,260 @@ public:
     void push_everything(sf::Vector2f velocity);
 
     /**
-     * @brief Updates the simulation state by time step.
-     * (implementation of algorithm 1, section 3. Simulation Step)
-     * @param dt Time step.
+     * @brief Advances the simulation by one step, split into `substeps` equal substeps (at most 1 long) or into
+     * substeps chosen by adaptive stepping. Active emitters spawn first. Positions at the start of the step are kept
+     * for render interpolation. Frees the frame arena of the previous step.
+     * @param step_size Length of the step in simulation time.
+     */
+    void step(float step_size);
+
+    /**
+     * @brief Advances the simulation by a frame of real time (one step of `dt * simulation_speed`).
+     * @param dt Real time step.
+     */
+    void update(float dt) { step(dt * params_.simulation_speed); }
+
+    /**
+     * @brief Gets the number of steps simulated so far.
+     * @return Number of steps.
+     */
+    uint64_t step_count() const { return step_count_; }
+
+    /**
+     * @brief Seeds the random generator used for spawning particles (every sandbox has its own).
+     * @param seed The seed.
+     */
+    void seed(uint64_t seed) { random_state_ = seed; }
+
+    /**
+     * @brief Hashes the simulation state (step count, particles, objects, springs and the random generator), to
+     * check that two runs ended in the same state.
+     * @return The hash.
+     */
+    uint64_t state_hash() const;
+
+    /**
+     * @brief Copies everything needed for drawing into a render state (reusing its memory).
+     * @param state The state to fill.
+     */
+    void capture(RenderState &state) const;
+
+    /**
+     * @brief Sets a recorder that gets the state after every step (it decides which steps to keep).
+     * @param recorder The recorder (must outlive its use, nullptr stops recording).
+     */
+    void set_recorder(TrajectoryRecorder *recorder) { recorder_ = recorder; }
+
+    /**
+     * @brief Saves the whole simulation state to a binary snapshot file (format described in snapshot.h).
+     * @param path Path of the file.
+     * @throws std::runtime_error If the file can not be written.
      */
-    void update(float dt);
+    void save_snapshot(const std::string &path) const;
 
     /**
-     * @brief Draws the current state of the simulation to a render target.
-     * @param target The render target.
-     * @param states Current render states.
+     * @brief Replaces the simulation state with a snapshot file, stepping on from it gives the same result as
+     * stepping on from the saved simulation (with the same thread count and instruction set of the relaxation kernels).
+     * The file is memory mapped and copied straight into the particle arrays. Releases the grabbed object.
+     * @param path Path of the file.
+     * @throws std::runtime_error If the file can not be read or is not a valid snapshot (the state is left unchanged).
      */
-    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+    void load_snapshot(const std::string &path);
+
+    /**
+     * @brief Gets how long a phase took during the last step, summed over its substeps (measured even when the
+     * profiling timers are compiled out).
+     * @param phase The phase.
+     * @return Duration of the phase in seconds.
+     */
+    double phase_time(SimulationPhase phase) const { return step_phase_times_[static_cast<size_t>(phase)]; }
+
+    /**
+     * @brief Gets the timing histories of the simulation phases and the whole step.
+     * @return The profiler (entries are SimulationPhase values and PROFILE_STEP).
+     */
+    const Profiler &profiler() const { return profiler_; }
 
 private:
+    /**
+     * @brief Per-thread buffers for the neighbors of the particle being relaxed.
+     */
+    struct NeighborScratch
+    {
+        std::vector<float> position_diff_x;
+        std::vector<float> position_diff_y;
+        std::vector<float> displacement_x;
+        std::vector<float> displacement_y;
+
+        void resize(size_t size)
+        {
+            if (position_diff_x.size() >= size) // Only grows, shrinking and regrowing would zero the buffers every particle
+                return;
+            position_diff_x.resize(size);
+            position_diff_y.resize(size);
+            displacement_x.resize(size);
+            displacement_y.resize(size);
+        }
+    };
+
     sf::Vector2u size_;
     SimulationParameters params_;
-
-    float dt_ = 0.0f;
+    Boundaries boundaries_;
+    std::vector<ParticleEmitter> emitters_;
+    std::vector<ParticleSink> sinks_;
+
+    float dt_ = 0.0f; // Length of the current substep
+    float step_size_ = 0.0f; // Length of the last whole step
+    float max_acceleration_ = 0.0f; // Largest particle acceleration of the last substep, estimated by adaptive stepping
+    AdaptiveStepSettings adaptive_stepping_;
+    StepStats step_stats_;
+    uint64_t step_count_ = 0;
+    uint64_t random_state_ = 0; // SplitMix64 state for spawning particles
 
     bool reverse_calculation_order_ = false; // If true, the order of some calculations is reversed (improves stability)
 
-    std::vector<Particle> particles_;
+    ParticleStore particles_;
     std::vector<Object> objects_;
 
-    SpatialHashGrid<Particle> particle_grid_;
-    SpatialHashGrid<Object> object_grid_;
+    static constexpr size_t NO_OBJECT = static_cast<size_t>(-1);
+    size_t grabbed_object_ = NO_OBJECT; // Index of the grabbed object
+    sf::Vector2f grab_offset_;
+    bool grab_locked_object_ = false; // Whether grabbing locked the object (and releasing has to unlock it)
+
+    size_t reorder_interval_ = PARTICLE_REORDER_INTERVAL_DEFAULT;
+    size_t steps_since_reorder_ = 0;
+
+    FrameArena frame_arena_; // Containers rebuilt every step, reset at the start of each step (declared before its users)
+
+    UniformGrid particle_grid_;
+    SpatialHashGrid<Object> object_grid_{&frame_arena_};
     float max_object_radius = 0.0f;
+    std::vector<std::vector<uint32_t>> object_particles_; // Particles near each object, gathered once per collision pass (buffers are reused)
+    std::vector<sf::Vector2f> object_particles_center_; // Where each object was when its particles were gathered
+
+    NeighborList particle_neighbors_; // Half lists, each pair is listed under one of its particles
+    NeighborList relaxation_neighbors_; // Full lists built from the half lists, each pair is listed under both particles
+    float neighbor_skin_ = 0.0f;
+    float neighbor_radius_ = 0.0f; // Radius the neighbor lists were gathered with (interaction radius + skin)
+    bool neighbors_valid_ = false; // Whether the neighbor lists and the particle grid match the particles
+    size_t neighbor_builds_ = 0;
+    std::vector<float> neighbor_build_x_; // Positions when the neighbor lists were gathered (only with a skin)
+    std::vector<float> neighbor_build_y_;
+
+    SpringTable springs_;
+    std::vector<std::vector<SpringTable::Spring>> new_springs_; // Springs created by each thread during the spring pass
+
+    std::unique_ptr<ThreadPool> thread_pool_; // Only exists with more than one thread
+    std::vector<NeighborList> neighbor_chunks_; // Neighbors gathered by each thread before being stitched together
+    std::vector<size_t> neighbor_chunk_bases_;
+    std::vector<NeighborScratch> neighbor_scratch_; // One per thread, used by the density relaxation kernels
+
+    // Sleep levels of grid cells and particles
+    static constexpr uint8_t AWAKE = 0;
+    static constexpr uint8_t FROZEN = 1; // Stopped, but keeps its neighbor lists (its density is needed by awake neighbors or by springs)
+    static constexpr uint8_t DEEP = 2; // Stopped and without neighbor lists
+
+    SleepSettings sleep_settings_;
+    size_t sleep_columns_ = 0; // Particle grid layout the sleep state belongs to
+    size_t sleep_rows_ = 0;
+    size_t sleep_cell_size_ = 0;
+    SimulationParameters sleep_params_; // Parameters the calm counters were collected under, changing a physics one wakes everything
+    std::vector<uint32_t> cell_calm_steps_; // Steps each cell has been calm for (up to the sleep steps), empty if sleeping is off
+    std::vector<uint8_t> cell_sleep_; // Sleep level of each cell
+    std::vector<float> cell_speed_; // Scratch for the fastest particle of each cell while updating the sleep levels
+    std::vector<uint8_t> cell_flags_; // Scratch for the cells next to awake ones while updating the sleep levels
+    std::vector<uint8_t> particle_sleep_; // Sleep level of each particle at the last neighbor build, empty if all are awake
+    std::vector<uint8_t> skip_cells_; // Cells whose particles are all in deep sleep (as binned at the last neighbor build)
+    size_t sleeping_particles_ = 0;
+
+    Profiler profiler_{PROFILE_ENTRY_COUNT};
+    std::array<double, SIMULATION_PHASE_COUNT> step_phase_times_{}; // Seconds spent in each phase during the last step
+
+    TrajectoryRecorder *recorder_ = nullptr;
 
-    std::vector<std::vector<Particle *>> particle_neighbors_;
+    /**
+     * @brief Spawns particles at random places of an area.
+     * @param region The area.
+     * @param amount Number of particles, a fraction below one spawns a particle on random chance.
+     * @param velocity Initial velocity of the particles.
+     */
+    void spawn_particles(const Region &region, float amount, sf::Vector2f velocity);
+
+    /**
+     * @brief Checks whether the sleep state belongs to the current layout of the particle grid.
+     * @return True if sleeping is on and the cells match.
+     */
+    bool sleep_matches_grid() const;
+
+    /**
+     * @brief Gets the reach of the neighbor lists in grid cells.
+     * @return Number of cells.
+     */
+    size_t neighbor_cell_reach() const;
+
+    /**
+     * @brief Calls a function for every cell of the sleep state up to some cells away from a cell, wrapping around
+     * periodic edges of the particle grid.
+     * @tparam Callback Callable taking the index of the cell (`size_t`).
+     * @param cell Index of the center cell.
+     * @param reach Number of cells to each side.
+     * @param callback The function to call.
+     */
+    template <typename Callback>
+    void for_each_cell_around(size_t cell, size_t reach, Callback &&callback) const;
+
+    /**
+     * @brief Counts the calm steps of every cell and puts cells to sleep or wakes them, at the start of a step.
+     * Stops the particles of sleeping cells.
+     */
+    void update_sleep();
+
+    /**
+     * @brief Wakes the cells whose particles could interact with a disc, and prepares the cells around them to be
+     * next to awake ones.
+     * @param position Center of the disc.
+     * @param radius Radius of the disc.
+     */
+    void wake_cells(sf::Vector2f position, float radius);
+
+    /**
+     * @brief Wakes every cell.
+     */
+    void wake_all_cells();
+
+    /**
+     * @brief Gives every particle the sleep level of the cell it is binned in (or awake if it moves), when the
+     * neighbor lists are gathered.
+     */
+    void mark_sleeping_particles();
+
+    /**
+     * @brief Gets the sleep levels of the particles for the passes over the neighbor lists.
+     * @return The levels, or nullptr if every particle is awake.
+     */
+    const uint8_t *sleeping_mask() const { return particle_sleep_.size() == particles_.size() ? particle_sleep_.data() : nullptr; }
+
+    /**
+     * @brief Chooses the length of the next substep for adaptive stepping.
+     * @param remaining Simulation time left in the step.
+     * @param limit Gets what decided the length.
+     * @return Length of the substep, the rest of the step is split evenly so it does not end with a sliver.
+     */
+    float choose_substep(float remaining, StepLimit &limit);
+
+    /**
+     * @brief Runs one substep of the simulation.
+     * (implementation of algorithm 1, section 3. Simulation Step)
+     * @param dt Time step.
+     */
+    void substep(float dt);
+
+    /**
+     * @brief Runs one phase of the simulation step, timed for `phase_time` and (unless compiled out) the profiler.
+     * @param phase The phase being run.
+     * @param function The method running the phase.
+     */
+    void run_phase(SimulationPhase phase, void (FluidSandbox::*function)());
 
     /**
      * @brief Moves all particles and objects based on their velocities.
@@ -197,10 +780,35 @@ private:
     void move_everything();
 
     /**
-     * @brief Updates the neighbors of each particle using the spatial hash grid.
+     * @brief Checks whether the neighbor lists can be kept: a skin is set, nothing invalidated them and no particle
+     * has moved more than half the skin since they were gathered.
+     * @return True if the lists and the particle grid can be reused.
+     */
+    bool can_reuse_neighbors() const;
+
+    /**
+     * @brief Updates the neighbors of each particle using the uniform grid (unless the lists are reused).
      */
     void update_neighbors();
 
+    /**
+     * @brief Gathers the neighbors of a range of particles that come after them in the grid's cell order.
+     * @param begin Index of the first particle.
+     * @param end Index one past the last particle.
+     * @param neighbors The lists to fill (indexed from `begin`).
+     */
+    void gather_neighbors(size_t begin, size_t end, NeighborList &neighbors) const;
+
+    /**
+     * @brief Calls a function for every particle in the order of the current calculation order,
+     * either one by one or cell color by cell color on the thread pool.
+     * The function may change the particle and its neighbors.
+     * @tparam Function Callable taking the index of the particle and the index of the calling thread (`size_t, size_t`).
+     * @param function The function to call.
+     */
+    template <typename Function>
+    void for_each_particle_ordered(Function &&function);
+
     /**
      * @brief Simulation of elasticity (Implementation of algorithms 3 and 4, section 5. Viscoelasticity).
      */
@@ -208,11 +816,22 @@ private:
 
     /**
      * @brief The core of the fluid simulation (Implementation of algorithm 2, section 4. Double density relaxation).
+     * Like the paper's sequential loop, each particle sums its density from the live positions of all its neighbors
+     * (the full lists) just before it displaces them, so it sees the moves of the particles relaxed before it.
      */
     void do_double_density_relaxation();
 
+    /**
+     * @brief Gathers the particles within an object's radius plus OBJECT_PARTICLE_MARGIN into its reused buffer.
+     * Safe to call for different objects in parallel.
+     * @param object_index Index of the object.
+     * @param pushed How far particles may have been pushed since the particle grid was updated (besides their own moves).
+     */
+    void gather_object_particles(size_t object_index, float pushed = 0.0f);
+
     /**
      * @brief Resolves collisions between particles, objects and simulation boundaries (Implementation of algorithm 6, section 6. Collisions).
+     * Also wraps particles and objects around periodic edges.
      */
     void resolve_collisions();
 
@@ -230,5 +849,11 @@ private:
      * @brief Simulation of viscosity (Implementation of algorithm 5, section 5. Viscoelasticity).
      */
     void apply_viscosity();
+
+    /**
+     * @brief Removes the particles that left the simulation area through an outflow edge or are inside a sink,
+     * in one pass filling the holes with particles from the end.
+     */
+    void remove_drained_particles();
 };
 #endif
@@ -0,0 +1,37 @@
+#include <algorithm>
+
+#include "frame_arena.h"
+
+FrameArena::FrameArena(size_t capacity) : block_(std::make_unique_for_overwrite<std::byte[]>(capacity)), capacity_(capacity)
+{
+    resource_.emplace(block_.get(), capacity_, std::pmr::new_delete_resource());
+}
+
+void FrameArena::reset()
+{
+    resource_.reset(); // Returns what overflowed to the heap
+    if (used_ > capacity_)
+    {
+        capacity_ = std::max(used_ + used_ / 2, 2 * capacity_); // Room for the next step to grow a little
+        block_.reset();
+        block_ = std::make_unique_for_overwrite<std::byte[]>(capacity_);
+    }
+    used_ = 0;
+    resource_.emplace(block_.get(), capacity_, std::pmr::new_delete_resource());
+}
+
+void *FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    used_ += bytes + alignment - 1; // Worst case padding, so a grown block surely fits the same allocations
+    return resource_->allocate(bytes, alignment);
+}
+
+void FrameArena::do_deallocate(void *, size_t, size_t)
+{
+    // Everything is freed at once by reset
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
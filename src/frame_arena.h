@@ -0,0 +1,58 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+constexpr size_t FRAME_ARENA_INITIAL_CAPACITY = 64 * 1024; // Bytes
+
+/**
+ * @brief Memory for containers that only live during one simulation step.
+ * Allocating bumps a pointer through one owned block and freeing does nothing, `reset` frees everything at once.
+ * A step that needs more than the block gets the rest from the heap, and the block grows to fit it on the next
+ * reset, so once the steps stop growing they don't touch the global heap. Not thread safe.
+ */
+class FrameArena : public std::pmr::memory_resource
+{
+public:
+    /**
+     * @brief Creates an arena.
+     * @param capacity Initial size of the block in bytes.
+     */
+    explicit FrameArena(size_t capacity = FRAME_ARENA_INITIAL_CAPACITY);
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    /**
+     * @brief Frees everything allocated since the last reset, growing the block if it was too small.
+     * Containers using the arena must be destroyed or emptied of all memory first.
+     */
+    void reset();
+
+    /**
+     * @brief Gets the size of the block.
+     * @return Size in bytes.
+     */
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * @brief Gets the number of bytes allocated since the last reset.
+     * @return Number of bytes (including alignment padding).
+     */
+    size_t used() const { return used_; }
+
+private:
+    std::unique_ptr<std::byte[]> block_;
+    size_t capacity_;
+    size_t used_ = 0;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_; // Recreated on every reset, over the current block
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "input_log.h"
+
+namespace
+{
+    static_assert(std::is_trivially_copyable_v<SimulationParameters> && sizeof(SimulationParameters) % sizeof(float) == 0,
+                  "input logs store SimulationParameters as an array of floats");
+    constexpr size_t PARAM_COUNT = sizeof(SimulationParameters) / sizeof(float);
+
+    /**
+     * @brief Arguments an event takes.
+     */
+    enum class EventArgs
+    {
+        None,
+        Position,
+        Size,
+        Params,
+        Path,
+    };
+
+    struct EventName
+    {
+        InputEventType type;
+        const char *name;
+        EventArgs args;
+    };
+
+    constexpr EventName EVENT_NAMES[] = {
+        {InputEventType::AddParticles, "add_particles", EventArgs::Position},
+        {InputEventType::RemoveParticles, "remove_particles", EventArgs::Position},
+        {InputEventType::AddObject, "add_object", EventArgs::Position},
+        {InputEventType::RemoveObject, "remove_object", EventArgs::Position},
+        {InputEventType::ToggleLock, "toggle_lock", EventArgs::Position},
+        {InputEventType::Grab, "grab", EventArgs::Position},
+        {InputEventType::Release, "release", EventArgs::None},
+        {InputEventType::Push, "push", EventArgs::Position},
+        {InputEventType::Clear, "clear", EventArgs::None},
+        {InputEventType::Resize, "resize", EventArgs::Size},
+        {InputEventType::SetParams, "params", EventArgs::Params},
+        {InputEventType::LoadSnapshot, "load", EventArgs::Path},
+        {InputEventType::SaveSnapshot, "save", EventArgs::Path},
+    };
+
+    const EventName &event_name(InputEventType type)
+    {
+        for (auto &&name : EVENT_NAMES)
+        {
+            if (name.type == type)
+                return name;
+        }
+        throw std::logic_error("input event type without a name");
+    }
+
+    void write_params(std::ostream &out, const SimulationParameters &params)
+    {
+        const auto *values = reinterpret_cast<const float *>(&params);
+        out << PARAM_COUNT;
+        for (size_t i = 0; i < PARAM_COUNT; ++i)
+        {
+            out << ' ' << values[i];
+        }
+    }
+
+    /**
+     * @brief Reads a float written as a hexadecimal float (istream can't parse those).
+     */
+    bool read_float(std::istream &in, float &value)
+    {
+        std::string token;
+        if (!(in >> token))
+            return false;
+        char *end = nullptr;
+        value = std::strtof(token.c_str(), &end);
+        return end == token.c_str() + token.size();
+    }
+
+    bool read_params(std::istream &in, SimulationParameters &params)
+    {
+        size_t count;
+        if (!(in >> count) || count != PARAM_COUNT)
+            return false;
+        auto *values = reinterpret_cast<float *>(&params);
+        for (size_t i = 0; i < PARAM_COUNT; ++i)
+        {
+            if (!read_float(in, values[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool read_instruction_set(std::istream &in, simd_kernels::InstructionSet &instruction_set)
+    {
+        std::string name;
+        if (!(in >> name))
+            return false;
+        for (auto candidate : {simd_kernels::InstructionSet::Scalar, simd_kernels::InstructionSet::SSE2, simd_kernels::InstructionSet::AVX2})
+        {
+            if (name == simd_kernels::instruction_set_name(candidate))
+            {
+                instruction_set = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool read_event(std::istringstream &line, InputEvent &event)
+    {
+        std::string name;
+        if (!(line >> name))
+            return false;
+        for (auto &&candidate : EVENT_NAMES)
+        {
+            if (name != candidate.name)
+                continue;
+            event.type = candidate.type;
+            switch (candidate.args)
+            {
+            case EventArgs::None:
+                return true;
+            case EventArgs::Position:
+                return read_float(line, event.position.x) && read_float(line, event.position.y);
+            case EventArgs::Size:
+                return static_cast<bool>(line >> event.size.x >> event.size.y);
+            case EventArgs::Params:
+                return read_params(line, event.params);
+            case EventArgs::Path:
+                line >> std::ws;
+                std::getline(line, event.path);
+                return !event.path.empty();
+            }
+        }
+        return false;
+    }
+}
+
+void InputEvent::apply(FluidSandbox &sandbox) const
+{
+    switch (type)
+    {
+    case InputEventType::AddParticles:
+        sandbox.add_particles(position);
+        break;
+    case InputEventType::RemoveParticles:
+        sandbox.remove_particles(position);
+        break;
+    case InputEventType::AddObject:
+        sandbox.add_object(position);
+        break;
+    case InputEventType::RemoveObject:
+        sandbox.remove_object(position);
+        break;
+    case InputEventType::ToggleLock:
+        sandbox.toggle_lock_object(position);
+        break;
+    case InputEventType::Grab:
+        if (!sandbox.move_grabbed_object(position)) // Keep trying to grab until an object is hit
+            sandbox.grab_object(position);
+        break;
+    case InputEventType::Release:
+        sandbox.release_object();
+        break;
+    case InputEventType::Push:
+        sandbox.push_everything(position);
+        break;
+    case InputEventType::Clear:
+        sandbox.clear();
+        break;
+    case InputEventType::Resize:
+        sandbox.resize(size);
+        break;
+    case InputEventType::SetParams:
+        sandbox.params() = params;
+        break;
+    case InputEventType::LoadSnapshot:
+        sandbox.load_snapshot(path);
+        break;
+    case InputEventType::SaveSnapshot:
+        sandbox.save_snapshot(path);
+        break;
+    }
+}
+
+InputLog InputLog::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("cannot open input log '" + path + "'");
+    }
+
+    InputLog log;
+    std::string text;
+    size_t line_number = 0;
+    while (std::getline(file, text))
+    {
+        ++line_number;
+        std::istringstream line(text);
+        std::string record;
+        if (!(line >> record))
+        {
+            continue;
+        }
+
+        bool valid = false;
+        if (line_number == 1)
+        {
+            int version;
+            valid = record == "fluid_input_log" && line >> version;
+            if (valid && version != INPUT_LOG_VERSION)
+            {
+                throw std::runtime_error(path + ": unsupported input log version " + std::to_string(version));
+            }
+        }
+        else if (log.finished)
+        {
+            valid = false; // Nothing may follow the end record
+        }
+        else if (record == "size")
+        {
+            valid = static_cast<bool>(line >> log.size.x >> log.size.y);
+        }
+        else if (record == "seed")
+        {
+            valid = static_cast<bool>(line >> log.seed);
+        }
+        else if (record == "next_id")
+        {
+            valid = static_cast<bool>(line >> log.next_id);
+        }
+        else if (record == "threads")
+        {
+            valid = static_cast<bool>(line >> log.thread_count);
+        }
+        else if (record == "simd")
+        {
+            valid = read_instruction_set(line, log.instruction_set);
+        }
+        else if (record == "step_size")
+        {
+            valid = read_float(line, log.step_size) && log.step_size > 0.0f;
+        }
+        else if (record == "params")
+        {
+            valid = read_params(line, log.params);
+        }
+        else if (record == "event")
+        {
+            LoggedInputEvent &event = log.events.emplace_back();
+            valid = line >> event.step && read_event(line, event.event);
+        }
+        else if (record == "end")
+        {
+            valid = static_cast<bool>(line >> log.end_step >> std::hex >> log.state_hash);
+            log.finished = true;
+        }
+        if (!valid)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) + ": invalid record '" + text + "'");
+        }
+    }
+    if (line_number == 0)
+    {
+        throw std::runtime_error(path + ": empty input log");
+    }
+    return log;
+}
+
+void InputLog::start(FluidSandbox &sandbox) const
+{
+    sandbox.clear();
+    sandbox.resize(size);
+    sandbox.params() = params;
+    sandbox.seed(seed);
+    Particle::set_next_id(next_id);
+
+    simd_kernels::set_instruction_set(instruction_set);
+    if (simd_kernels::active_instruction_set() != instruction_set)
+    {
+        throw std::runtime_error(std::string("the session used the ") + simd_kernels::instruction_set_name(instruction_set) +
+                                 " kernels, which this CPU does not support, so the replay would not end in the same state");
+    }
+}
+
+InputLogWriter::InputLogWriter(const std::string &path, const FluidSandbox &sandbox, uint64_t seed, float step_size) : out_(path)
+{
+    if (!out_)
+    {
+        throw std::runtime_error("cannot open input log '" + path + "' for writing");
+    }
+    out_ << std::hexfloat;
+    out_ << "fluid_input_log " << INPUT_LOG_VERSION << '\n'
+         << "size " << sandbox.size().x << ' ' << sandbox.size().y << '\n'
+         << "seed " << seed << '\n'
+         << "next_id " << Particle::next_id() << '\n'
+         << "threads " << sandbox.thread_count() << '\n'
+         << "simd " << simd_kernels::instruction_set_name(simd_kernels::active_instruction_set()) << '\n'
+         << "step_size " << step_size << '\n'
+         << "params ";
+    write_params(out_, sandbox.params());
+    out_ << '\n';
+}
+
+void InputLogWriter::write(uint64_t step, const InputEvent &event)
+{
+    const EventName &name = event_name(event.type);
+    out_ << "event " << step << ' ' << name.name;
+    switch (name.args)
+    {
+    case EventArgs::None:
+        break;
+    case EventArgs::Position:
+        out_ << ' ' << event.position.x << ' ' << event.position.y;
+        break;
+    case EventArgs::Size:
+        out_ << ' ' << event.size.x << ' ' << event.size.y;
+        break;
+    case EventArgs::Params:
+        out_ << ' ';
+        write_params(out_, event.params);
+        break;
+    case EventArgs::Path:
+        out_ << ' ' << event.path;
+        break;
+    }
+    out_ << '\n';
+}
+
+void InputLogWriter::finish(const FluidSandbox &sandbox)
+{
+    out_ << "end " << sandbox.step_count() << ' ' << std::hex << sandbox.state_hash() << std::dec << std::endl;
+}
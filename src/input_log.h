@@ -0,0 +1,149 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "fluid_sandbox.h"
+#include "simd_kernels.h"
+
+/*
+ * Input logs (InputLogWriter / InputLog::load).
+ *
+ * Plain text, one record per line, floats written as hexadecimal floats so they read back bit for bit:
+ * - `fluid_input_log <version>`
+ * - `size <width> <height>`, `seed <seed>`, `next_id <id>`, `threads <count>`, `simd <instruction set>`,
+ *   `step_size <length>`, `params <count> <value>...` (members of SimulationParameters in order): the state the
+ *   session started from. The relaxation kernels round differently on every instruction set, so it is logged too.
+ * - `event <step> <name> [arguments]`: An input applied when the sandbox had simulated `step` steps, in the order
+ *   they were applied (names and arguments as in InputEventType). Loading a snapshot also loads its step count, so
+ *   steps only increase between loads. Snapshots are referenced by path. A replay saves the snapshots the session
+ *   saved to scratch files and loads those instead, so only snapshots that existed before the session have to be
+ *   unchanged for it.
+ * - `end <step> <state hash>`: Written when the session ends, the step count and FluidSandbox::state_hash then.
+ */
+
+constexpr int INPUT_LOG_VERSION = 2;
+
+/**
+ * @brief Kinds of input, with the arguments they take.
+ */
+enum class InputEventType
+{
+    AddParticles,    // position
+    RemoveParticles, // position
+    AddObject,       // position
+    RemoveObject,    // position
+    ToggleLock,      // position
+    Grab,            // position: moves the grabbed object there, or grabs an object there if none is grabbed
+    Release,
+    Push,            // position holds the velocity
+    Clear,
+    Resize,          // size
+    SetParams,       // params
+    LoadSnapshot,    // path
+    SaveSnapshot,    // path
+};
+
+/**
+ * @brief One input to a sandbox, as recorded in an input log.
+ */
+struct InputEvent
+{
+public:
+    InputEventType type = InputEventType::Clear;
+    sf::Vector2f position{};
+    sf::Vector2u size{};
+    SimulationParameters params{};
+    std::string path{};
+
+    /**
+     * @brief Applies the input to a sandbox.
+     * @param sandbox The sandbox.
+     * @throws std::runtime_error If a snapshot can not be loaded or saved.
+     */
+    void apply(FluidSandbox &sandbox) const;
+};
+
+/**
+ * @brief An input and the number of steps simulated before it was applied.
+ */
+struct LoggedInputEvent
+{
+    uint64_t step;
+    InputEvent event;
+};
+
+/**
+ * @brief A loaded input log: the starting state of a session and every input applied during it.
+ */
+struct InputLog
+{
+public:
+    sf::Vector2u size;
+    uint64_t seed = 0;
+    size_t next_id = 0;
+    size_t thread_count = 1;
+    simd_kernels::InstructionSet instruction_set = simd_kernels::InstructionSet::Scalar; // Used by the relaxation kernels
+    float step_size = 1.0f;
+    SimulationParameters params;
+    std::vector<LoggedInputEvent> events;
+    bool finished = false; // Whether the end record is present (missing if the session crashed)
+    uint64_t end_step = 0;
+    uint64_t state_hash = 0;
+
+    /**
+     * @brief Loads an input log.
+     * @param path Path of the log.
+     * @return The loaded log.
+     * @throws std::runtime_error If the file can not be read or contains an invalid record.
+     */
+    static InputLog load(const std::string &path);
+
+    /**
+     * @brief Puts a sandbox into the state the session started from (empty, sized, seeded, with the logged parameters)
+     * and selects the logged instruction set of the relaxation kernels.
+     * @param sandbox The sandbox to set up.
+     * @throws std::runtime_error If the CPU does not support the logged instruction set.
+     */
+    void start(FluidSandbox &sandbox) const;
+};
+
+/**
+ * @brief Writes an input log while a session runs. Must only be used from the thread that applies the inputs.
+ */
+class InputLogWriter
+{
+public:
+    /**
+     * @brief Creates the log and writes the starting state of a sandbox.
+     * @param path Path of the log.
+     * @param sandbox The sandbox, seeded with `seed` and without particles or objects.
+     * @param seed Seed of the sandbox's random generator.
+     * @param step_size Simulation time per step.
+     * @throws std::runtime_error If the file can not be created.
+     */
+    InputLogWriter(const std::string &path, const FluidSandbox &sandbox, uint64_t seed, float step_size);
+
+    /**
+     * @brief Logs an input, call right before applying it.
+     * @param step Number of steps simulated so far.
+     * @param event The input.
+     */
+    void write(uint64_t step, const InputEvent &event);
+
+    /**
+     * @brief Writes the end record with the final step count and state hash.
+     * @param sandbox The sandbox after the last step.
+     */
+    void finish(const FluidSandbox &sandbox);
+
+private:
+    std::ofstream out_;
+};
+
+#endif
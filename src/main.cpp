@@ -1,9 +1,21 @@
 #include <SFML/Graphics.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
 #include <optional>
+#include <random>
+#include <string>
+#include <thread>
 
 #include "fluid_sandbox.h"
 #include "controls.h"
+#include "input_log.h"
+#include "sandbox_view.h"
+#include "simulation_runner.h"
 
 constexpr char const WINDOW_TITLE[] = "Fluid Simulation Sandbox";
 
@@ -15,21 +27,78 @@ constexpr size_t FRAME_RATE_LIMIT = 100;
 
 constexpr float WINDOW_MOVE_STRENGTH = 0.1f;
 
-int main()
+constexpr char const SNAPSHOT_PATH[] = "sandbox.snapshot";
+
+constexpr char const USAGE[] =
+    "Usage: fluid_simulation_sandbox [options]\n"
+    "\n"
+    "Options:\n"
+    "  --record-input <file>  Logs every input, for replaying the session with fluid_simulation_replay\n";
+
+int main(int argc, char **argv)
 {
+    std::string input_log_path;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option = argv[i];
+        if (option == "--record-input" && i + 1 < argc)
+        {
+            input_log_path = argv[++i];
+        }
+        else
+        {
+            std::cerr << USAGE;
+            return option == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
     auto window = sf::RenderWindow(sf::VideoMode({DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT}), WINDOW_TITLE);
     window.setFramerateLimit(FRAME_RATE_LIMIT);
 
     FluidSandbox sandbox({(DEFAULT_WINDOW_WIDTH > SIDEBAR_WIDTH ? DEFAULT_WINDOW_WIDTH - SIDEBAR_WIDTH : 0), DEFAULT_WINDOW_HEIGHT});
-    ControlsDisplay controls_display(sandbox, SIDEBAR_WIDTH);
+    sandbox.set_thread_count(std::max(1u, std::thread::hardware_concurrency()));
+    ControlsDisplay controls_display(sandbox.params(), SIDEBAR_WIDTH);
+    SandboxView sandbox_view(controls_display.params());
+    SimulationParameters submitted_params = controls_display.params();
+
+    const uint64_t seed = std::random_device{}();
+    sandbox.seed(seed);
+    std::unique_ptr<InputLogWriter> input_log;
+    if (!input_log_path.empty())
+    {
+        try
+        {
+            input_log = std::make_unique<InputLogWriter>(input_log_path, sandbox, seed, SIMULATION_STEP_SIZE_DEFAULT);
+        }
+        catch (const std::exception &error)
+        {
+            std::cerr << error.what() << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    // From here on the sandbox lives on the simulation thread, input is sent to it as commands
+    SimulationRunner runner(sandbox);
+    // Inputs are applied (and logged) on the simulation thread, so the log knows the step they were applied at
+    auto send = [&runner, log = input_log.get()](InputEvent event)
+    {
+        runner.submit([event = std::move(event), log](FluidSandbox &sandbox)
+                      {
+                          if (log)
+                              log->write(sandbox.step_count(), event);
+                          event.apply(sandbox); });
+    };
 
     sf::Clock clock;
     auto window_position = window.getPosition();
 
     bool lock_pressed = false;
-    std::optional<Object *> grabbed_object = std::nullopt;
-    sf::Vector2i grab_offset;
-    bool grabbed_object_locked = false;
+    bool save_pressed = false;
+    bool load_pressed = false;
+    std::future<SimulationParameters> loaded_params; // Parameters of a loaded snapshot, for the sidebar to take over
+    bool grabbing = false; // Left mouse button held
+    uint64_t shown_step = 0; // Step of the last drawn state
+    uint64_t spawn_step = 0; // Step particles were last spawned for (spawning once per step keeps the rate independent of the frame rate)
 
     while (window.isOpen())
     {
@@ -43,30 +112,32 @@ int main()
             if (const auto *resized = event->getIf<sf::Event::Resized>())
             {
                 window.setView(sf::View(sf::FloatRect({0, 0}, static_cast<sf::Vector2f>(resized->size))));
-                sandbox.resize({(resized->size.x > SIDEBAR_WIDTH ? resized->size.x - SIDEBAR_WIDTH : 0), resized->size.y});
+                const sf::Vector2u sandbox_size = {(resized->size.x > SIDEBAR_WIDTH ? resized->size.x - SIDEBAR_WIDTH : 0), resized->size.y};
+                send({.type = InputEventType::Resize, .size = sandbox_size});
             }
         }
 
         // Keyboard and mouse input handling
-        const auto mouse_position = sf::Mouse::getPosition(window);
+        const auto mouse_position = static_cast<sf::Vector2f>(sf::Mouse::getPosition(window));
         auto new_window_position = window.getPosition();
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::D))
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::D) && spawn_step != shown_step)
         {
-            sandbox.add_particles(static_cast<sf::Vector2f>(mouse_position));
+            spawn_step = shown_step;
+            send({.type = InputEventType::AddParticles, .position = mouse_position});
         }
         if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::F))
         {
-            sandbox.remove_particles(static_cast<sf::Vector2f>(mouse_position));
+            send({.type = InputEventType::RemoveParticles, .position = mouse_position});
         }
-        if (!grabbed_object.has_value()) // Don't allow adding/removing objects while dragging an object (it could invalidate the pointer)
+        if (!grabbing) // Don't allow adding/removing objects while dragging an object
         {
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::G))
             {
-                sandbox.add_object(static_cast<sf::Vector2f>(mouse_position));
+                send({.type = InputEventType::AddObject, .position = mouse_position});
             }
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::H))
             {
-                sandbox.remove_object(static_cast<sf::Vector2f>(mouse_position));
+                send({.type = InputEventType::RemoveObject, .position = mouse_position});
             }
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::J)) // Only lock / unlock objects on key release
             {
@@ -75,62 +146,120 @@ int main()
             else if (lock_pressed)
             {
                 lock_pressed = false;
-                sandbox.toggle_lock_object(static_cast<sf::Vector2f>(mouse_position));
+                send({.type = InputEventType::ToggleLock, .position = mouse_position});
             }
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Space))
             {
-                sandbox.clear();
+                send({.type = InputEventType::Clear});
             }
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::X)) // Only load on key release
+            {
+                load_pressed = true;
+            }
+            else if (load_pressed)
+            {
+                load_pressed = false;
+                auto promise = std::make_shared<std::promise<SimulationParameters>>();
+                loaded_params = promise->get_future();
+                runner.submit([promise, log = input_log.get()](FluidSandbox &sandbox)
+                              {
+                                  try
+                                  {
+                                      const uint64_t step = sandbox.step_count();
+                                      const InputEvent load{.type = InputEventType::LoadSnapshot, .path = SNAPSHOT_PATH};
+                                      const InputEvent resize{.type = InputEventType::Resize, .size = sandbox.size()}; // Keep fitting the window
+                                      load.apply(sandbox);
+                                      resize.apply(sandbox);
+                                      if (log) // Only successful loads are logged, a replay can't fail where the session didn't
+                                      {
+                                          log->write(step, load);
+                                          log->write(sandbox.step_count(), resize);
+                                      }
+                                      promise->set_value(sandbox.params());
+                                  }
+                                  catch (const std::exception &)
+                                  {
+                                      promise->set_exception(std::current_exception());
+                                  } });
+            }
+        }
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Z)) // Only save on key release
+        {
+            save_pressed = true;
+        }
+        else if (save_pressed)
+        {
+            save_pressed = false;
+            runner.submit([log = input_log.get()](FluidSandbox &sandbox)
+                          {
+                              try
+                              {
+                                  const InputEvent save{.type = InputEventType::SaveSnapshot, .path = SNAPSHOT_PATH};
+                                  save.apply(sandbox);
+                                  if (log) // Logged so a replay saves the same state before loading it again
+                                  {
+                                      log->write(sandbox.step_count(), save);
+                                  }
+                              }
+                              catch (const std::exception &error)
+                              {
+                                  std::cerr << "Saving snapshot failed: " << error.what() << '\n';
+                              } });
         }
 
         if (window_position != new_window_position)
         {
-            sandbox.push_everything(static_cast<sf::Vector2f>(window_position - new_window_position) * WINDOW_MOVE_STRENGTH);
+            const auto push = static_cast<sf::Vector2f>(window_position - new_window_position) * WINDOW_MOVE_STRENGTH;
+            send({.type = InputEventType::Push, .position = push});
             window_position = new_window_position;
         }
         if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left))
         {
-            if (grabbed_object == std::nullopt)
-            {
-                grabbed_object = sandbox.try_grab_object(static_cast<sf::Vector2f>(mouse_position));
-                if (grabbed_object.has_value())
-                {
-                    if (!grabbed_object.value()->is_locked)
-                    {
-                        grabbed_object.value()->toggle_lock();
-                        grabbed_object_locked = true;
-                    }
-                    else
-                    {
-                        grabbed_object_locked = false;
-                    }
-                    grab_offset = static_cast<sf::Vector2i>(mouse_position) - static_cast<sf::Vector2i>(grabbed_object.value()->position);
-                }
-            }
-            else
-            {
-                if (grabbed_object.value() != nullptr)
-                {
-                    grabbed_object.value()->position = static_cast<sf::Vector2f>(mouse_position) - static_cast<sf::Vector2f>(grab_offset);
-                }
-            }
+            grabbing = true;
+            send({.type = InputEventType::Grab, .position = mouse_position});
         }
-        else if (grabbed_object.has_value())
+        else if (grabbing)
         {
-            if (grabbed_object_locked)
-                grabbed_object.value()->toggle_lock();
-            grabbed_object = std::nullopt;
+            grabbing = false;
+            send({.type = InputEventType::Release});
         }
 
         float dt = clock.restart().asSeconds();
 
+        if (loaded_params.valid() && loaded_params.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            try
+            {
+                controls_display.set_params(loaded_params.get());
+                submitted_params = controls_display.params();
+            }
+            catch (const std::exception &error)
+            {
+                std::cerr << "Loading snapshot failed: " << error.what() << '\n';
+            }
+        }
         controls_display.update(dt);
-        sandbox.update(dt);
+        if (controls_display.params() != submitted_params)
+        {
+            submitted_params = controls_display.params();
+            send({.type = InputEventType::SetParams, .params = submitted_params});
+        }
 
         window.clear();
-        window.draw(sandbox);
-        window.draw(controls_display);
+        runner.read_state([&](const RenderState &state, float alpha)
+                          {
+                              shown_step = state.step;
+                              sandbox_view.set_state(state, alpha);
+                              controls_display.set_state(state, sandbox_view.draw_times());
+                              window.draw(sandbox_view);
+                              window.draw(controls_display); });
         window.display();
     }
+
+    runner.stop();
+    if (input_log)
+    {
+        input_log->finish(sandbox);
+    }
     return 0;
 }
@@ -0,0 +1,96 @@
+#include <stdexcept>
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("cannot open '" + path + "'");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        throw std::runtime_error("cannot read the size of '" + path + "'");
+    }
+    file_ = file;
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) // Empty files can't be mapped
+        return;
+
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ != nullptr)
+    {
+        data_ = static_cast<const std::byte *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (data_ == nullptr)
+    {
+        if (mapping_ != nullptr)
+            CloseHandle(mapping_);
+        CloseHandle(file);
+        throw std::runtime_error("cannot map '" + path + "'");
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+    if (mapping_ != nullptr)
+        CloseHandle(mapping_);
+    if (file_ != nullptr)
+        CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path)
+{
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        throw std::runtime_error("cannot open '" + path + "'");
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0)
+    {
+        close(file);
+        throw std::runtime_error("cannot read the size of '" + path + "'");
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ != 0) // Empty files can't be mapped
+    {
+        void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED)
+        {
+            close(file);
+            throw std::runtime_error("cannot map '" + path + "'");
+        }
+        madvise(data, size_, MADV_SEQUENTIAL); // Snapshots are read front to back
+        data_ = static_cast<const std::byte *>(data);
+    }
+    close(file); // The mapping stays valid without the descriptor
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<std::byte *>(data_), size_);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ * Pages are only read from disk when they are accessed, so large files can be read without copying them into an
+ * intermediate buffer first.
+ */
+class MappedFile
+{
+public:
+    /**
+     * @brief Maps a file.
+     * @param path Path of the file.
+     * @throws std::runtime_error If the file can not be opened or mapped.
+     */
+    explicit MappedFile(const std::string &path);
+
+    /**
+     * @brief Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @brief Gets the contents of the file.
+     * @return Pointer to the first byte (nullptr for an empty file).
+     */
+    const std::byte *data() const { return data_; }
+
+    /**
+     * @brief Gets the size of the file.
+     * @return Size in bytes.
+     */
+    size_t size() const { return size_; }
+
+private:
+    const std::byte *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#endif
+};
+
+#endif
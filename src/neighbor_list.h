@@ -0,0 +1,97 @@
+#ifndef NEIGHBOR_LIST_H
+#define NEIGHBOR_LIST_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Neighbor lists of all particles stored in compressed sparse row form.
+ * Neighbors of particle `i` are the entries `offsets[i]` to `offsets[i + 1]` of one flat array of 32-bit particle indices.
+ * The buffers are reused between steps, so rebuilding the lists does not allocate once they have grown.
+ */
+struct NeighborList
+{
+public:
+    std::vector<uint32_t> offsets; // Start of each particle's neighbors in indices (one extra entry at the end)
+    std::vector<uint32_t> indices; // Neighbor particle indices
+
+    /**
+     * @brief Gets the number of particles the lists were built for.
+     * @return Number of particles.
+     */
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    /**
+     * @brief Gets the index of the first neighbor entry of a particle.
+     * @param particle_id Index of the particle.
+     * @return Index into `indices`.
+     */
+    uint32_t begin(size_t particle_id) const { return offsets[particle_id]; }
+
+    /**
+     * @brief Gets the index one past the last neighbor entry of a particle.
+     * @param particle_id Index of the particle.
+     * @return Index into `indices`.
+     */
+    uint32_t end(size_t particle_id) const { return offsets[particle_id + 1]; }
+
+    /**
+     * @brief Starts building new lists, keeping the allocated memory.
+     * @param num_particles Number of particles the lists will be built for.
+     */
+    void reset(size_t num_particles)
+    {
+        offsets.resize(num_particles + 1);
+        offsets[0] = 0;
+        indices.clear();
+    }
+
+    /**
+     * @brief Appends a neighbor to the particle currently being built.
+     * @param neighbor_id Index of the neighbor.
+     */
+    void push_back(uint32_t neighbor_id) { indices.push_back(neighbor_id); }
+
+    /**
+     * @brief Finishes the neighbors of one particle (particles must be finished in order).
+     * @param particle_id Index of the particle.
+     */
+    void finish(size_t particle_id) { offsets[particle_id + 1] = static_cast<uint32_t>(indices.size()); }
+
+    /**
+     * @brief Replaces the lists by full lists built from half lists, listing every pair under both of its particles.
+     * The order of the entries only depends on the half lists.
+     * @param half Lists in which every pair is listed under one of its particles.
+     */
+    void assign_full(const NeighborList &half)
+    {
+        const size_t num_particles = half.size();
+        // While filling, offsets[i + 1] is where the next neighbor of particle i goes (one extra entry at the end)
+        offsets.assign(num_particles + 2, 0);
+        for (size_t i = 0; i < num_particles; ++i)
+        {
+            offsets[i + 2] += half.end(i) - half.begin(i);
+            for (uint32_t n = half.begin(i); n < half.end(i); ++n)
+            {
+                ++offsets[half.indices[n] + 2];
+            }
+        }
+        for (size_t i = 2; i < num_particles + 2; ++i)
+        {
+            offsets[i] += offsets[i - 1];
+        }
+        indices.resize(half.indices.size() * 2);
+        for (size_t i = 0; i < num_particles; ++i)
+        {
+            for (uint32_t n = half.begin(i); n < half.end(i); ++n)
+            {
+                const uint32_t neighbor_id = half.indices[n];
+                indices[offsets[i + 1]++] = neighbor_id;
+                indices[offsets[neighbor_id + 1]++] = static_cast<uint32_t>(i);
+            }
+        }
+        offsets.pop_back();
+    }
+};
+
+#endif
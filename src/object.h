@@ -15,6 +15,7 @@ public:
     float mass;
     sf::Vector2f velocity;
     sf::Vector2f velocity_buffer;
+    sf::Vector2f step_start; // Position at the start of the current fixed step, rendering interpolates from it
 
     bool is_locked = false;
 
@@ -26,7 +27,7 @@ public:
      * @param velocity Initial velocity of the object (defaults to zero).
      */
     Object(sf::Vector2f position, float radius, float mass, sf::Vector2f velocity = {0.0f, 0.0f})
-        : position(position), radius(radius), mass(mass), velocity(velocity) {}
+        : position(position), radius(radius), mass(mass), velocity(velocity), step_start(position) {}
 
     /**
      * @brief Updates the object's position based on its velocity and the time step.
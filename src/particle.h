@@ -3,12 +3,11 @@
 
 #include <SFML/Graphics.hpp>
 
-#include <unordered_map>
-
 constexpr float STRESS_SMOOTHING = 0.7f; // Smoothing factor to prevent flickering from changing computation order.
 
 /**
  * @brief Represents a single particle in the fluid simulation.
+ * The simulation itself keeps particles in a ParticleStore, this is the value used to add or read out one particle.
  */
 struct Particle
 {
@@ -21,13 +20,6 @@ public:
     sf::Vector2f prev_position;
     sf::Vector2f velocity;
 
-    /**
-     * @brief Stores springs connected to this particle.
-     * The key is the ID of the other particle, and the value is the resting length of the spring.
-     * Used to model viscoelasticity.
-     */
-    std::unordered_map<size_t, float> springs;
-
     float stress = 0.0f; // Represents the stress experienced by the particle, used only for visualization.
 
     /**
@@ -38,14 +30,16 @@ public:
     Particle(sf::Vector2f position, sf::Vector2f velocity = {0.0f, 0.0f}) : position(position), prev_position(position), velocity(velocity) {}
 
     /**
-     * @brief Updates the particle's position based on its velocity and the time step.
-     * @param dt Time step.
+     * @brief Gets the ID the next particle will get.
+     * @return The next ID.
+     */
+    static size_t next_id() { return id_counter; }
+
+    /**
+     * @brief Sets the ID the next particle will get (used when restoring a saved simulation).
+     * @param id The next ID.
      */
-    inline void update(float dt)
-    {
-        prev_position = position;
-        position += velocity * dt;
-    }
+    static void set_next_id(size_t id) { id_counter = id; }
 };
 
 inline size_t Particle::id_counter = 0;
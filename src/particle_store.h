@@ -0,0 +1,224 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "particle.h"
+
+/**
+ * @brief Structure-of-arrays storage of all particles in the simulation.
+ * Every attribute lives in its own contiguous array indexed by particle index, so passes that only
+ * touch positions or velocities stream through exactly the data they need.
+ * Removing a particle moves the last one into its place, so the arrays stay dense and keep their capacity:
+ * the slots past the end are the free list that later particles reuse without allocating.
+ */
+struct ParticleStore
+{
+public:
+    std::vector<size_t> id;
+    std::vector<float> position_x;
+    std::vector<float> position_y;
+    std::vector<float> prev_position_x;
+    std::vector<float> prev_position_y;
+    std::vector<float> velocity_x;
+    std::vector<float> velocity_y;
+    std::vector<float> stress; // Represents the stress experienced by the particle, used only for visualization.
+    std::vector<float> step_start_x; // Position at the start of the current fixed step, rendering interpolates from it
+    std::vector<float> step_start_y;
+
+    /**
+     * @brief Gets the number of particles.
+     * @return Number of particles.
+     */
+    size_t size() const { return id.size(); }
+
+    /**
+     * @brief Checks whether there are no particles.
+     * @return True if there are no particles.
+     */
+    bool empty() const { return id.empty(); }
+
+    /**
+     * @brief Gets the position of a particle.
+     * @param index Index of the particle.
+     * @return Position of the particle.
+     */
+    sf::Vector2f position(size_t index) const { return {position_x[index], position_y[index]}; }
+
+    /**
+     * @brief Gets the velocity of a particle.
+     * @param index Index of the particle.
+     * @return Velocity of the particle.
+     */
+    sf::Vector2f velocity(size_t index) const { return {velocity_x[index], velocity_y[index]}; }
+
+    /**
+     * @brief Reserves space for a number of particles in all arrays.
+     * @param count Number of particles.
+     */
+    void reserve(size_t count);
+
+    /**
+     * @brief Removes all particles.
+     */
+    void clear();
+
+    /**
+     * @brief Resizes all arrays to a number of particles (new particles are zeroed and need their values filled in).
+     * @param count Number of particles.
+     */
+    void resize(size_t count);
+
+    /**
+     * @brief Appends a particle.
+     * @param particle The particle to append.
+     */
+    void push_back(const Particle &particle);
+
+    /**
+     * @brief Removes all particles for which the predicate returns true, filling each hole with the last particle.
+     * The predicate is called once per particle and reads the particle at the index it gets (a moved particle is
+     * checked at its new index). The order of the remaining particles is not kept.
+     * @tparam Predicate Callable taking the index of a particle and returning bool.
+     * @param predicate The predicate.
+     */
+    template <typename Predicate>
+    void remove_if(Predicate &&predicate);
+
+    /**
+     * @brief Reorders particles, the particle at index `order[i]` moves to index `i`.
+     * @param order A permutation of particle indices.
+     */
+    void permute(const std::vector<uint32_t> &order);
+
+private:
+    std::vector<float> float_scratch_;
+    std::vector<size_t> id_scratch_;
+
+    /**
+     * @brief Moves one index into another in all arrays.
+     * @param from The source index.
+     * @param to The destination index.
+     */
+    void move_particle(size_t from, size_t to);
+
+    /**
+     * @brief Reorders one array by a permutation.
+     * @tparam T Element type of the array.
+     * @param values The array to reorder.
+     * @param order The permutation.
+     * @param scratch A reusable buffer of the same type.
+     */
+    template <typename T>
+    static void permute_array(std::vector<T> &values, const std::vector<uint32_t> &order, std::vector<T> &scratch);
+};
+
+inline void ParticleStore::reserve(size_t count)
+{
+    id.reserve(count);
+    position_x.reserve(count);
+    position_y.reserve(count);
+    prev_position_x.reserve(count);
+    prev_position_y.reserve(count);
+    velocity_x.reserve(count);
+    velocity_y.reserve(count);
+    stress.reserve(count);
+    step_start_x.reserve(count);
+    step_start_y.reserve(count);
+}
+
+inline void ParticleStore::clear()
+{
+    resize(0);
+}
+
+inline void ParticleStore::resize(size_t count)
+{
+    id.resize(count);
+    position_x.resize(count);
+    position_y.resize(count);
+    prev_position_x.resize(count);
+    prev_position_y.resize(count);
+    velocity_x.resize(count);
+    velocity_y.resize(count);
+    stress.resize(count);
+    step_start_x.resize(count);
+    step_start_y.resize(count);
+}
+
+inline void ParticleStore::push_back(const Particle &particle)
+{
+    id.push_back(particle.id);
+    position_x.push_back(particle.position.x);
+    position_y.push_back(particle.position.y);
+    prev_position_x.push_back(particle.prev_position.x);
+    prev_position_y.push_back(particle.prev_position.y);
+    velocity_x.push_back(particle.velocity.x);
+    velocity_y.push_back(particle.velocity.y);
+    stress.push_back(particle.stress);
+    step_start_x.push_back(particle.position.x);
+    step_start_y.push_back(particle.position.y);
+}
+
+inline void ParticleStore::move_particle(size_t from, size_t to)
+{
+    id[to] = id[from];
+    position_x[to] = position_x[from];
+    position_y[to] = position_y[from];
+    prev_position_x[to] = prev_position_x[from];
+    prev_position_y[to] = prev_position_y[from];
+    velocity_x[to] = velocity_x[from];
+    velocity_y[to] = velocity_y[from];
+    stress[to] = stress[from];
+    step_start_x[to] = step_start_x[from];
+    step_start_y[to] = step_start_y[from];
+}
+
+template <typename Predicate>
+inline void ParticleStore::remove_if(Predicate &&predicate)
+{
+    size_t count = size();
+    for (size_t i = 0; i < count;)
+    {
+        if (!predicate(i))
+        {
+            ++i;
+            continue;
+        }
+        if (i != --count)
+        {
+            move_particle(count, i); // Checked next, at its new index
+        }
+    }
+    resize(count);
+}
+
+template <typename T>
+inline void ParticleStore::permute_array(std::vector<T> &values, const std::vector<uint32_t> &order, std::vector<T> &scratch)
+{
+    scratch.resize(values.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        scratch[i] = std::move(values[order[i]]);
+    }
+    values.swap(scratch);
+}
+
+inline void ParticleStore::permute(const std::vector<uint32_t> &order)
+{
+    permute_array(id, order, id_scratch_);
+    permute_array(position_x, order, float_scratch_);
+    permute_array(position_y, order, float_scratch_);
+    permute_array(prev_position_x, order, float_scratch_);
+    permute_array(prev_position_y, order, float_scratch_);
+    permute_array(velocity_x, order, float_scratch_);
+    permute_array(velocity_y, order, float_scratch_);
+    permute_array(stress, order, float_scratch_);
+    permute_array(step_start_x, order, float_scratch_);
+    permute_array(step_start_y, order, float_scratch_);
+}
+
+#endif
@@ -0,0 +1,48 @@
+#include <algorithm>
+#include <cmath>
+
+#include "profiler.h"
+
+void TimingHistory::push(double seconds)
+{
+    samples_[next_] = seconds;
+    next_ = (next_ + 1) % TIMING_HISTORY_SIZE;
+    count_ = std::min(count_ + 1, TIMING_HISTORY_SIZE);
+}
+
+double TimingHistory::mean() const
+{
+    if (count_ == 0)
+        return 0.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < count_; ++i)
+    {
+        sum += at(i);
+    }
+    return sum / static_cast<double>(count_);
+}
+
+double TimingHistory::max() const
+{
+    double max = 0.0;
+    for (size_t i = 0; i < count_; ++i)
+    {
+        max = std::max(max, at(i));
+    }
+    return max;
+}
+
+double TimingHistory::percentile(double percentile) const
+{
+    if (count_ == 0)
+        return 0.0;
+    std::array<double, TIMING_HISTORY_SIZE> sorted;
+    for (size_t i = 0; i < count_; ++i)
+    {
+        sorted[i] = at(i);
+    }
+    const double rank = std::ceil(percentile / 100.0 * static_cast<double>(count_));
+    const size_t index = static_cast<size_t>(std::clamp(rank, 1.0, static_cast<double>(count_))) - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + count_);
+    return sorted[index];
+}
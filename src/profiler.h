@@ -0,0 +1,142 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+// Set to 0 (CMake option FLUID_SANDBOX_PROFILING=OFF) to compile all scoped timers out
+#ifndef FLUID_SANDBOX_PROFILING
+#define FLUID_SANDBOX_PROFILING 1
+#endif
+
+constexpr size_t TIMING_HISTORY_SIZE = 240; // Number of samples kept for rolling statistics (a few seconds of frames)
+
+/**
+ * @brief Ring buffer of the most recent durations of one measured section, with rolling statistics over it.
+ */
+class TimingHistory
+{
+public:
+    /**
+     * @brief Adds a sample, overwriting the oldest one once the buffer is full.
+     * @param seconds The measured duration.
+     */
+    void push(double seconds);
+
+    /**
+     * @brief Gets the number of samples in the buffer.
+     * @return Number of samples (at most TIMING_HISTORY_SIZE).
+     */
+    size_t size() const { return count_; }
+
+    /**
+     * @brief Gets a sample by age.
+     * @param index Index of the sample, 0 is the oldest one.
+     * @return The sample in seconds.
+     */
+    double at(size_t index) const { return samples_[(next_ + TIMING_HISTORY_SIZE - count_ + index) % TIMING_HISTORY_SIZE]; }
+
+    /**
+     * @brief Gets the most recent sample.
+     * @return The sample in seconds (0 if there is none).
+     */
+    double last() const { return count_ == 0 ? 0.0 : at(count_ - 1); }
+
+    /**
+     * @brief Gets the mean of the samples in the buffer.
+     * @return Mean in seconds (0 if there are no samples).
+     */
+    double mean() const;
+
+    /**
+     * @brief Gets the largest sample in the buffer.
+     * @return Maximum in seconds (0 if there are no samples).
+     */
+    double max() const;
+
+    /**
+     * @brief Gets a percentile of the samples in the buffer (nearest rank).
+     * @param percentile The percentile (0 to 100).
+     * @return The percentile in seconds (0 if there are no samples).
+     */
+    double percentile(double percentile) const;
+
+private:
+    std::array<double, TIMING_HISTORY_SIZE> samples_{};
+    size_t next_ = 0; // Index the next sample is written to
+    size_t count_ = 0;
+};
+
+/**
+ * @brief Collects timing histories of a fixed set of measured sections (entries are plain indices chosen by the owner).
+ */
+class Profiler
+{
+public:
+    /**
+     * @brief Constructs the Profiler.
+     * @param entry_count Number of measured sections.
+     */
+    explicit Profiler(size_t entry_count) : entries_(entry_count) {}
+
+    /**
+     * @brief Records a duration of a section.
+     * @param entry Index of the section.
+     * @param seconds The measured duration.
+     */
+    void record(size_t entry, double seconds) { entries_[entry].push(seconds); }
+
+    /**
+     * @brief Gets the timing history of a section.
+     * @param entry Index of the section.
+     * @return The timing history.
+     */
+    const TimingHistory &entry(size_t entry) const { return entries_[entry]; }
+
+    /**
+     * @brief Gets the number of measured sections.
+     * @return Number of sections.
+     */
+    size_t entry_count() const { return entries_.size(); }
+
+private:
+    std::vector<TimingHistory> entries_;
+};
+
+/**
+ * @brief Measures the time until the end of the enclosing scope and records it in a profiler.
+ * Does nothing when FLUID_SANDBOX_PROFILING is 0.
+ */
+class ScopedTimer
+{
+public:
+#if FLUID_SANDBOX_PROFILING
+    /**
+     * @brief Starts the timer.
+     * @param profiler The profiler to record to.
+     * @param entry Index of the measured section.
+     */
+    ScopedTimer(Profiler &profiler, size_t entry) : profiler_(profiler), entry_(entry), start_(std::chrono::steady_clock::now()) {}
+
+    /**
+     * @brief Stops the timer and records the duration.
+     */
+    ~ScopedTimer() { profiler_.record(entry_, std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count()); }
+#else
+    ScopedTimer(Profiler &, size_t) {}
+#endif
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+#if FLUID_SANDBOX_PROFILING
+    Profiler &profiler_;
+    size_t entry_;
+    std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "profiler.h"
+
+/**
+ * @brief Object data needed for drawing.
+ */
+struct ObjectRenderState
+{
+    sf::Vector2f position;
+    sf::Vector2f step_start; // Position at the start of the last step
+    float radius;
+    bool is_locked;
+};
+
+/**
+ * @brief Everything the renderer and the sidebar need from the simulation, copied out after a step.
+ * Particles are stored by index (the order of the simulation at the time of the copy).
+ */
+struct RenderState
+{
+public:
+    sf::Vector2u size;
+    uint64_t step = 0; // Number of steps simulated when the state was copied
+    std::vector<float> position_x;
+    std::vector<float> position_y;
+    std::vector<float> step_start_x; // Positions at the start of the last step
+    std::vector<float> step_start_y;
+    std::vector<float> stress;
+    std::vector<ObjectRenderState> objects;
+
+    Profiler profiler{0}; // Copy of the simulation timings
+    std::chrono::steady_clock::time_point published_at; // When the last step finished
+    float step_period = 0.0f; // Wall time one step stands for (seconds), 0 if stepping is not paced
+
+    /**
+     * @brief Gets the number of particles.
+     * @return Number of particles.
+     */
+    size_t particle_count() const { return position_x.size(); }
+
+    /**
+     * @brief Gets how far rendering is between the start and the end of the last step.
+     * @param now The time of rendering.
+     * @return Interpolation factor from 0 (start of the step) to 1 (end of the step).
+     */
+    float interpolation(std::chrono::steady_clock::time_point now) const
+    {
+        if (step_period <= 0.0f)
+            return 1.0f;
+        const float elapsed = std::chrono::duration<float>(now - published_at).count();
+        return std::clamp(elapsed / step_period, 0.0f, 1.0f);
+    }
+};
+
+#endif
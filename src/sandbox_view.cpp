@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cmath>
+
+#include "sandbox_view.h"
+
+SandboxView::SandboxView(const SimulationParameters &params) : params_(params)
+{
+    for (size_t j = 0; j <= CIRCLE_DRAW_SEGMENTS; ++j)
+    {
+        float angle = static_cast<float>(j % CIRCLE_DRAW_SEGMENTS) / CIRCLE_DRAW_SEGMENTS * 2.0f * M_PI;
+        circle_directions_[j] = {std::cos(angle), std::sin(angle)};
+    }
+}
+
+void SandboxView::draw_vertices(const std::vector<sf::Vertex> &vertices, sf::VertexBuffer &buffer, sf::RenderTarget &target, const sf::RenderStates &states)
+{
+    if (vertices.empty())
+        return;
+    if (sf::VertexBuffer::isAvailable())
+    {
+        // Grow geometrically so a growing particle count rarely reallocates, if that fails the array is drawn directly
+        const bool has_room = buffer.getVertexCount() >= vertices.size() ||
+                              buffer.create(std::max(vertices.size(), buffer.getVertexCount() * 2));
+        if (has_room && buffer.update(vertices.data(), vertices.size(), 0))
+        {
+            target.draw(buffer, 0, vertices.size(), states);
+            return;
+        }
+    }
+    target.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles, states);
+}
+
+void SandboxView::draw(sf::RenderTarget &target, sf::RenderStates states) const
+{
+    if (state_ == nullptr)
+        return;
+    ScopedTimer timer(profiler_, 0);
+    const RenderState &state = *state_;
+
+    // Draw particles as squares
+    const size_t particle_count = state.particle_count();
+    particle_vertices_.resize(particle_count * 6);
+    sf::Vertex *particle_vertex = particle_vertices_.data();
+    for (size_t i = 0; i < particle_count; i++, particle_vertex += 6)
+    {
+        const sf::Vector2f particle_position = {state.step_start_x[i] + (state.position_x[i] - state.step_start_x[i]) * alpha_,
+                                                state.step_start_y[i] + (state.position_y[i] - state.step_start_y[i]) * alpha_};
+        const float particle_stress = state.stress[i];
+        float particle_size = std::max(params_.base_particle_size + particle_stress * params_.particle_stress_size_multiplier, 1.0f);
+        int pressure_color = std::clamp(static_cast<int>(params_.base_particle_color - particle_stress * params_.particle_stress_color_multiplier), 0, 255);
+        sf::Color particle_color = sf::Color(pressure_color, pressure_color, 255);
+
+        particle_vertex[0].position = particle_position + sf::Vector2f(-particle_size, -particle_size);
+        particle_vertex[1].position = particle_position + sf::Vector2f(particle_size, -particle_size);
+        particle_vertex[2].position = particle_position + sf::Vector2f(particle_size, particle_size);
+        particle_vertex[3].position = particle_vertex[0].position;
+        particle_vertex[4].position = particle_vertex[2].position;
+        particle_vertex[5].position = particle_position + sf::Vector2f(-particle_size, particle_size);
+        for (size_t j = 0; j < 6; j++)
+        {
+            particle_vertex[j].color = particle_color;
+        }
+    }
+
+    states.blendMode = sf::BlendMax;
+    draw_vertices(particle_vertices_, particle_buffer_, target, states);
+    states.blendMode = sf::BlendAlpha;
+
+    // Draw objects as circles
+    object_vertices_.resize(state.objects.size() * CIRCLE_DRAW_SEGMENTS * 3);
+    sf::Vertex *object_vertex = object_vertices_.data();
+    for (const auto &object : state.objects)
+    {
+        const sf::Color object_color = object.is_locked ? sf::Color(128, 0, 0) : sf::Color(0, 128, 0);
+        const sf::Vector2f center_pos = object.step_start + (object.position - object.step_start) * alpha_;
+
+        for (size_t j = 0; j < CIRCLE_DRAW_SEGMENTS; ++j, object_vertex += 3)
+        {
+            object_vertex[0].position = center_pos;
+            object_vertex[1].position = center_pos + circle_directions_[j] * object.radius;
+            object_vertex[2].position = center_pos + circle_directions_[j + 1] * object.radius;
+
+            object_vertex[0].color = object_color;
+            object_vertex[1].color = object_color;
+            object_vertex[2].color = object_color;
+        }
+    }
+    draw_vertices(object_vertices_, object_buffer_, target, states);
+}
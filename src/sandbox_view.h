@@ -0,0 +1,80 @@
+#ifndef SANDBOX_VIEW_H
+#define SANDBOX_VIEW_H
+
+#include <SFML/Graphics.hpp>
+
+#include <array>
+#include <vector>
+
+#include "fluid_sandbox.h"
+#include "profiler.h"
+#include "render_state.h"
+
+constexpr size_t CIRCLE_DRAW_SEGMENTS = 30;
+
+/**
+ * @brief Draws the simulation from a RenderState, interpolating between the start and the end of the last step.
+ * Vertices are generated straight from the state's arrays into persistent buffers and uploaded to a vertex buffer
+ * with a stream usage hint, which is updated in place and only grows, so drawing does not allocate once the
+ * particle count has settled. Falls back to drawing the vertices directly when vertex buffers are not available.
+ */
+class SandboxView : public sf::Drawable
+{
+public:
+    /**
+     * @brief Constructs the SandboxView.
+     * @param params The parameters to take the visual parameters from (must outlive the view).
+     */
+    explicit SandboxView(const SimulationParameters &params);
+
+    /**
+     * @brief Sets the state to draw.
+     * @param state The state (must stay valid until drawing is done).
+     * @param alpha Interpolation factor from 0 (start of the last step) to 1 (end of the last step).
+     */
+    void set_state(const RenderState &state, float alpha)
+    {
+        state_ = &state;
+        alpha_ = alpha;
+    }
+
+    /**
+     * @brief Gets the timing history of drawing.
+     * @return Durations of the draw calls.
+     */
+    const TimingHistory &draw_times() const { return profiler_.entry(0); }
+
+    /**
+     * @brief Draws the state to a render target.
+     * @param target The render target.
+     * @param states Current render states.
+     */
+    void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+
+private:
+    const SimulationParameters &params_;
+    const RenderState *state_ = nullptr;
+    float alpha_ = 1.0f;
+
+    std::array<sf::Vector2f, CIRCLE_DRAW_SEGMENTS + 1> circle_directions_; // Unit vectors around a circle (first one repeated at the end)
+
+    // Mutable so drawing can reuse them
+    mutable std::vector<sf::Vertex> particle_vertices_;
+    mutable std::vector<sf::Vertex> object_vertices_;
+    mutable sf::VertexBuffer particle_buffer_{sf::PrimitiveType::Triangles, sf::VertexBuffer::Usage::Stream};
+    mutable sf::VertexBuffer object_buffer_{sf::PrimitiveType::Triangles, sf::VertexBuffer::Usage::Stream};
+
+    mutable Profiler profiler_{1}; // Mutable so drawing can be measured
+
+    /**
+     * @brief Uploads vertices to a vertex buffer (growing it if needed) and draws them, draws them directly if the buffer
+     * is not available or can not be created or updated.
+     * @param vertices The vertices.
+     * @param buffer The vertex buffer.
+     * @param target The render target.
+     * @param states Current render states.
+     */
+    static void draw_vertices(const std::vector<sf::Vertex> &vertices, sf::VertexBuffer &buffer, sf::RenderTarget &target, const sf::RenderStates &states);
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "scene.h"
+
+namespace
+{
+    // Names of the parameters that can be set from a scene file
+    constexpr std::pair<const char *, float SimulationParameters::*> PARAMS[] = {
+        {"simulation_speed", &SimulationParameters::simulation_speed},
+        {"substeps", &SimulationParameters::substeps},
+        {"gravity_x", &SimulationParameters::gravity_x},
+        {"gravity_y", &SimulationParameters::gravity_y},
+        {"edge_bounciness", &SimulationParameters::edge_bounciness},
+        {"interaction_radius", &SimulationParameters::interaction_radius},
+        {"rest_density", &SimulationParameters::rest_density},
+        {"stiffness", &SimulationParameters::stiffness},
+        {"near_stiffness", &SimulationParameters::near_stiffness},
+        {"linear_viscosity", &SimulationParameters::linear_viscosity},
+        {"quadratic_viscosity", &SimulationParameters::quadratic_viscosity},
+        {"plasticity", &SimulationParameters::plasticity},
+        {"yield_ratio", &SimulationParameters::yield_ratio},
+        {"spring_stiffness", &SimulationParameters::spring_stiffness},
+        {"control_radius", &SimulationParameters::control_radius},
+        {"particle_spawn_rate", &SimulationParameters::particle_spawn_rate},
+        {"object_radius", &SimulationParameters::object_radius},
+        {"object_mass", &SimulationParameters::object_mass},
+    };
+
+    /**
+     * @brief Sets the boundary mode of one or more edges by name.
+     * @return False if the edge or the mode is unknown.
+     */
+    bool set_boundary(Boundaries &boundaries, const std::string &edge, const std::string &mode_name)
+    {
+        const auto mode = std::find(std::begin(BOUNDARY_MODE_NAMES), std::end(BOUNDARY_MODE_NAMES), mode_name);
+        if (mode == std::end(BOUNDARY_MODE_NAMES))
+        {
+            return false;
+        }
+        const BoundaryMode value = static_cast<BoundaryMode>(mode - std::begin(BOUNDARY_MODE_NAMES));
+        const bool x = edge == "x" || edge == "all";
+        const bool y = edge == "y" || edge == "all";
+        if (!x && !y && edge != "left" && edge != "right" && edge != "top" && edge != "bottom")
+        {
+            return false;
+        }
+        if (x || edge == "left")
+            boundaries.left = value;
+        if (x || edge == "right")
+            boundaries.right = value;
+        if (y || edge == "top")
+            boundaries.top = value;
+        if (y || edge == "bottom")
+            boundaries.bottom = value;
+        return true;
+    }
+
+    /**
+     * @brief Reads the required arguments of a command followed by optional ones.
+     * @return False if a required argument is missing or an argument is not a number.
+     */
+    bool read_args(std::istringstream &line, float *args, size_t required, size_t total)
+    {
+        for (size_t i = 0; i < total; ++i)
+        {
+            float value;
+            if (!(line >> value))
+            {
+                return i >= required && line.eof(); // Missing optional arguments keep their defaults
+            }
+            args[i] = value;
+        }
+        std::string rest;
+        return !(line >> rest); // No trailing arguments
+    }
+}
+
+Scene Scene::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("cannot open scene file '" + path + "'");
+    }
+
+    Scene scene;
+    std::string text;
+    size_t line_number = 0;
+    while (std::getline(file, text))
+    {
+        ++line_number;
+        text = text.substr(0, text.find('#'));
+        std::istringstream line(text);
+        std::string command;
+        if (!(line >> command))
+        {
+            continue; // Empty line or comment
+        }
+
+        float args[9] = {};
+        bool valid = false;
+        if (command == "size" && (valid = read_args(line, args, 2, 2)))
+        {
+            scene.size = {static_cast<unsigned int>(args[0]), static_cast<unsigned int>(args[1])};
+        }
+        else if (command == "boundary")
+        {
+            std::string edge;
+            std::string mode;
+            std::string rest;
+            valid = line >> edge >> mode && !(line >> rest) && set_boundary(scene.boundaries, edge, mode);
+        }
+        else if (command == "seed" && (valid = read_args(line, args, 1, 1)))
+        {
+            scene.seed = static_cast<unsigned int>(args[0]);
+        }
+        else if (command == "dt" && (valid = read_args(line, args, 1, 1)))
+        {
+            scene.dt = args[0];
+        }
+        else if (command == "steps" && (valid = read_args(line, args, 1, 1)))
+        {
+            scene.steps = static_cast<size_t>(args[0]);
+        }
+        else if (command == "param")
+        {
+            std::string name;
+            valid = line >> name && read_args(line, args, 1, 1) && scene.set_param(name, args[0]);
+        }
+        else if (command == "block" && (valid = read_args(line, args, 5, 7)))
+        {
+            valid = args[4] > 0.0f;
+            scene.blocks.push_back({{args[0], args[1]}, {args[2], args[3]}, args[4], {args[5], args[6]}});
+        }
+        else if (command == "emitter" || command == "sink")
+        {
+            const std::streampos arguments = line.tellg();
+            std::string shape_name;
+            line >> shape_name;
+            const auto shape = std::find(std::begin(REGION_SHAPE_NAMES), std::end(REGION_SHAPE_NAMES), shape_name);
+            if (shape == std::end(REGION_SHAPE_NAMES))
+            {
+                // Spawns like the spawn key
+                line.clear();
+                line.seekg(arguments);
+                valid = command == "emitter" && read_args(line, args, 4, 4);
+                scene.emitters.push_back({{RegionShape::Circle, {args[0], args[1]}, {scene.params.control_radius, 0.0f}}, scene.params.particle_spawn_rate,
+                                          {0.0f, 0.0f}, static_cast<uint64_t>(args[2]), static_cast<uint64_t>(args[3])});
+            }
+            else
+            {
+                const RegionShape region_shape = static_cast<RegionShape>(shape - std::begin(REGION_SHAPE_NAMES));
+                const size_t region_args = region_shape == RegionShape::Circle ? 3 : 4;
+                if (command == "sink")
+                {
+                    valid = read_args(line, args, region_args, region_args);
+                }
+                else
+                {
+                    args[region_args + 3] = 0.0f;
+                    args[region_args + 4] = -1.0f; // No last step
+                    valid = read_args(line, args, region_args + 1, region_args + 5) && args[region_args] >= 0.0f;
+                }
+                const Region region = {region_shape, {args[0], args[1]}, {args[2], region_shape == RegionShape::Circle ? 0.0f : args[3]}};
+                valid = valid && region.size.x > 0.0f && (region_shape == RegionShape::Circle || region.size.y > 0.0f);
+                if (command == "sink")
+                {
+                    scene.sinks.push_back({region});
+                }
+                else
+                {
+                    ParticleEmitter &emitter = scene.emitters.emplace_back();
+                    emitter.region = region;
+                    emitter.rate = args[region_args];
+                    emitter.velocity = {args[region_args + 1], args[region_args + 2]};
+                    emitter.first_step = static_cast<uint64_t>(args[region_args + 3]);
+                    if (args[region_args + 4] >= 0.0f)
+                    {
+                        emitter.last_step = static_cast<uint64_t>(args[region_args + 4]);
+                    }
+                }
+            }
+        }
+        else if (command == "object")
+        {
+            args[2] = scene.params.object_radius;
+            args[3] = scene.params.object_mass;
+            args[4] = 0.0f;
+            valid = read_args(line, args, 2, 5);
+            scene.objects.push_back({{args[0], args[1]}, args[2], args[3], args[4] != 0.0f});
+        }
+        if (!valid)
+        {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) + ": invalid command '" + text + "'");
+        }
+    }
+    const Boundaries &boundaries = scene.boundaries;
+    if ((boundaries.left == BoundaryMode::Periodic) != (boundaries.right == BoundaryMode::Periodic) ||
+        (boundaries.top == BoundaryMode::Periodic) != (boundaries.bottom == BoundaryMode::Periodic))
+    {
+        throw std::runtime_error(path + ": a periodic edge needs the opposite edge to be periodic too");
+    }
+    return scene;
+}
+
+bool Scene::set_param(const std::string &name, float value)
+{
+    for (auto &&[param_name, member] : PARAMS)
+    {
+        if (name == param_name)
+        {
+            params.*member = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scene::apply(FluidSandbox &sandbox) const
+{
+    sandbox.seed(seed);
+    sandbox.clear();
+    sandbox.resize(size);
+    sandbox.set_boundaries(boundaries);
+    sandbox.set_emitters(emitters);
+    sandbox.set_sinks(sinks);
+    sandbox.params() = params;
+
+    for (auto &&block : blocks)
+    {
+        for (float y = block.position.y; y < block.position.y + block.size.y; y += block.spacing)
+        {
+            for (float x = block.position.x; x < block.position.x + block.size.x; x += block.spacing)
+            {
+                sandbox.add_particle({x, y}, block.velocity);
+            }
+        }
+    }
+    for (auto &&object : objects)
+    {
+        sandbox.add_object(object.position, object.radius, object.mass, object.locked);
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <SFML/Graphics.hpp>
+
+#include <string>
+#include <vector>
+
+#include "fluid_sandbox.h"
+
+/**
+ * @brief A rectangular block of particles placed on a regular lattice.
+ */
+struct SceneBlock
+{
+    sf::Vector2f position; // Top left corner
+    sf::Vector2f size;
+    float spacing;
+    sf::Vector2f velocity;
+};
+
+/**
+ * @brief An object placed at the start of the simulation.
+ */
+struct SceneObject
+{
+    sf::Vector2f position;
+    float radius;
+    float mass;
+    bool locked;
+};
+
+/**
+ * @brief Description of a simulation run without a window: domain, parameters, initial particles, emitters and objects.
+ *
+ * Scenes are plain text files with one command per line (`#` starts a comment):
+ * - `size <width> <height>`: Size of the simulation area.
+ * - `boundary <edge> <mode>`: Sets the mode (`wall`, `periodic` or `outflow`) of `left`, `right`, `top`, `bottom`,
+ *   both edges of an axis (`x`, `y`) or `all` edges. Periodic edges have to come in pairs.
+ * - `seed <seed>`: Seed of the sandbox's random generator used by emitters.
+ * - `dt <seconds>`: Time passed to every update (before the simulation speed is applied).
+ * - `steps <count>`: Default number of steps to run.
+ * - `param <name> <value>`: Sets a simulation parameter (names as in SimulationParameters).
+ * - `block <x> <y> <width> <height> <spacing> [velocity_x velocity_y]`: Fills a rectangle with particles.
+ * - `emitter <x> <y> <first_step> <last_step>`: Spawns particles every step of the range like the spawn key (in a
+ *   circle of the control radius at the spawn rate).
+ * - `emitter circle <x> <y> <radius> <rate> [velocity_x velocity_y] [first_step last_step]`,
+ *   `emitter rect <x> <y> <width> <height> <rate> [velocity_x velocity_y] [first_step last_step]`: Spawns `rate`
+ *   particles per unit of simulation time with an initial velocity (during all steps by default).
+ * - `sink circle <x> <y> <radius>`, `sink rect <x> <y> <width> <height>`: Removes particles entering the area.
+ * - `object <x> <y> [radius] [mass] [locked]`: Places an object (radius and mass default to the parameters).
+ */
+struct Scene
+{
+public:
+    sf::Vector2u size = {1200, 900};
+    Boundaries boundaries;
+    unsigned int seed = 0;
+    float dt = 1.0f / 60.0f;
+    size_t steps = 1000;
+    SimulationParameters params;
+    std::vector<SceneBlock> blocks;
+    std::vector<ParticleEmitter> emitters;
+    std::vector<ParticleSink> sinks;
+    std::vector<SceneObject> objects;
+
+    /**
+     * @brief Loads a scene from a file.
+     * @param path Path of the scene file.
+     * @return The loaded scene.
+     * @throws std::runtime_error If the file can not be read or contains an invalid command.
+     */
+    static Scene load(const std::string &path);
+
+    /**
+     * @brief Sets a simulation parameter by name.
+     * @param name Name of the parameter (e.g., `linear_viscosity`).
+     * @param value The new value.
+     * @return False if no parameter has that name.
+     */
+    bool set_param(const std::string &name, float value);
+
+    /**
+     * @brief Sets up a sandbox for the scene: resizes it, sets its boundaries, emitters and sinks, replaces its state
+     * and parameters and seeds the random generator.
+     * @param sandbox The sandbox to set up.
+     */
+    void apply(FluidSandbox &sandbox) const;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include "simd_kernels.h"
+
+#include <bit>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_KERNELS_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+namespace simd_kernels
+{
+    namespace
+    {
+        constexpr float MIN_DISTANCE_SQ = 0.01f; // Neighbors closer than this are nudged apart instead of relaxed
+
+        using DensityKernel = size_t (*)(const float *, const float *, size_t, float, float, float &, float &);
+        using DisplacementKernel = size_t (*)(const float *, const float *, size_t, float, float, float, float,
+                                              float *, float *, float &, float &);
+
+        /**
+         * @brief Scalar density kernel, also used for the remainders of the vectorized kernels.
+         */
+        size_t accumulate_density_scalar(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                         float &density, float &near_density)
+        {
+            size_t close_count = 0;
+            for (size_t k = 0; k < count; ++k)
+            {
+                const float distance_sq = diff_x[k] * diff_x[k] + diff_y[k] * diff_y[k];
+                if (distance_sq >= radius_sq)
+                {
+                    continue;
+                }
+                if (distance_sq < MIN_DISTANCE_SQ)
+                {
+                    ++close_count;
+                    continue;
+                }
+                const float one_minus_q = 1 - std::sqrt(distance_sq) * inv_radius;
+                const float one_minus_q_sq = one_minus_q * one_minus_q;
+                density += one_minus_q_sq;
+                near_density += one_minus_q_sq * one_minus_q;
+            }
+            return close_count;
+        }
+
+        /**
+         * @brief Scalar displacement kernel, also used for the remainders of the vectorized kernels.
+         */
+        size_t pressure_displacements_scalar(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                             float pressure_factor, float near_pressure_factor,
+                                             float *displacement_x, float *displacement_y, float &total_x, float &total_y)
+        {
+            size_t close_count = 0;
+            for (size_t k = 0; k < count; ++k)
+            {
+                const float distance_sq = diff_x[k] * diff_x[k] + diff_y[k] * diff_y[k];
+                if (distance_sq >= radius_sq || distance_sq < MIN_DISTANCE_SQ)
+                {
+                    close_count += distance_sq < MIN_DISTANCE_SQ;
+                    displacement_x[k] = 0.0f;
+                    displacement_y[k] = 0.0f;
+                    continue;
+                }
+                const float distance = std::sqrt(distance_sq);
+                const float one_minus_q = 1 - distance * inv_radius;
+                const float magnitude = (pressure_factor * one_minus_q + near_pressure_factor * one_minus_q * one_minus_q) / distance;
+                displacement_x[k] = diff_x[k] * magnitude;
+                displacement_y[k] = diff_y[k] * magnitude;
+                total_x -= displacement_x[k];
+                total_y -= displacement_y[k];
+            }
+            return close_count;
+        }
+
+#ifdef SIMD_KERNELS_SSE2
+        float horizontal_sum(__m128 v)
+        {
+            __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+            __m128 sums = _mm_add_ps(v, shuffled);
+            shuffled = _mm_movehl_ps(shuffled, sums);
+            return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+        }
+
+        size_t accumulate_density_sse2(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                       float &density, float &near_density)
+        {
+            const __m128 radius_sq_v = _mm_set1_ps(radius_sq);
+            const __m128 min_distance_sq_v = _mm_set1_ps(MIN_DISTANCE_SQ);
+            const __m128 inv_radius_v = _mm_set1_ps(inv_radius);
+            const __m128 one = _mm_set1_ps(1.0f);
+            __m128 density_v = _mm_setzero_ps();
+            __m128 near_density_v = _mm_setzero_ps();
+            size_t close_count = 0;
+
+            size_t k = 0;
+            for (; k + 4 <= count; k += 4)
+            {
+                const __m128 x = _mm_loadu_ps(diff_x + k);
+                const __m128 y = _mm_loadu_ps(diff_y + k);
+                const __m128 distance_sq = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+                const __m128 close = _mm_cmplt_ps(distance_sq, min_distance_sq_v);
+                const __m128 in_range = _mm_andnot_ps(close, _mm_cmplt_ps(distance_sq, radius_sq_v));
+                close_count += std::popcount(static_cast<unsigned>(_mm_movemask_ps(close)));
+
+                const __m128 one_minus_q = _mm_and_ps(in_range, _mm_sub_ps(one, _mm_mul_ps(_mm_sqrt_ps(distance_sq), inv_radius_v)));
+                const __m128 one_minus_q_sq = _mm_mul_ps(one_minus_q, one_minus_q);
+                density_v = _mm_add_ps(density_v, one_minus_q_sq);
+                near_density_v = _mm_add_ps(near_density_v, _mm_mul_ps(one_minus_q_sq, one_minus_q));
+            }
+            density += horizontal_sum(density_v);
+            near_density += horizontal_sum(near_density_v);
+            return close_count + accumulate_density_scalar(diff_x + k, diff_y + k, count - k, radius_sq, inv_radius, density, near_density);
+        }
+
+        size_t pressure_displacements_sse2(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                           float pressure_factor, float near_pressure_factor,
+                                           float *displacement_x, float *displacement_y, float &total_x, float &total_y)
+        {
+            const __m128 radius_sq_v = _mm_set1_ps(radius_sq);
+            const __m128 min_distance_sq_v = _mm_set1_ps(MIN_DISTANCE_SQ);
+            const __m128 inv_radius_v = _mm_set1_ps(inv_radius);
+            const __m128 pressure_v = _mm_set1_ps(pressure_factor);
+            const __m128 near_pressure_v = _mm_set1_ps(near_pressure_factor);
+            const __m128 one = _mm_set1_ps(1.0f);
+            __m128 total_x_v = _mm_setzero_ps();
+            __m128 total_y_v = _mm_setzero_ps();
+            size_t close_count = 0;
+
+            size_t k = 0;
+            for (; k + 4 <= count; k += 4)
+            {
+                const __m128 x = _mm_loadu_ps(diff_x + k);
+                const __m128 y = _mm_loadu_ps(diff_y + k);
+                const __m128 distance_sq = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+                const __m128 close = _mm_cmplt_ps(distance_sq, min_distance_sq_v);
+                const __m128 in_range = _mm_andnot_ps(close, _mm_cmplt_ps(distance_sq, radius_sq_v));
+                close_count += std::popcount(static_cast<unsigned>(_mm_movemask_ps(close)));
+
+                const __m128 distance = _mm_sqrt_ps(distance_sq);
+                const __m128 one_minus_q = _mm_sub_ps(one, _mm_mul_ps(distance, inv_radius_v));
+                const __m128 pressure = _mm_add_ps(_mm_mul_ps(pressure_v, one_minus_q),
+                                                   _mm_mul_ps(near_pressure_v, _mm_mul_ps(one_minus_q, one_minus_q)));
+                // Lanes out of range may divide by zero, the mask clears them afterwards
+                const __m128 magnitude = _mm_and_ps(in_range, _mm_div_ps(pressure, distance));
+                const __m128 dx = _mm_mul_ps(x, magnitude);
+                const __m128 dy = _mm_mul_ps(y, magnitude);
+                _mm_storeu_ps(displacement_x + k, dx);
+                _mm_storeu_ps(displacement_y + k, dy);
+                total_x_v = _mm_sub_ps(total_x_v, dx);
+                total_y_v = _mm_sub_ps(total_y_v, dy);
+            }
+            total_x += horizontal_sum(total_x_v);
+            total_y += horizontal_sum(total_y_v);
+            return close_count + pressure_displacements_scalar(diff_x + k, diff_y + k, count - k, radius_sq, inv_radius, pressure_factor,
+                                                               near_pressure_factor, displacement_x + k, displacement_y + k, total_x, total_y);
+        }
+#endif
+
+#ifdef SIMD_KERNELS_AVX2
+        __attribute__((target("avx2"))) float horizontal_sum(__m256 v)
+        {
+            return horizontal_sum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+        }
+
+        __attribute__((target("avx2"))) size_t accumulate_density_avx2(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                                                        float &density, float &near_density)
+        {
+            const __m256 radius_sq_v = _mm256_set1_ps(radius_sq);
+            const __m256 min_distance_sq_v = _mm256_set1_ps(MIN_DISTANCE_SQ);
+            const __m256 inv_radius_v = _mm256_set1_ps(inv_radius);
+            const __m256 one = _mm256_set1_ps(1.0f);
+            __m256 density_v = _mm256_setzero_ps();
+            __m256 near_density_v = _mm256_setzero_ps();
+            size_t close_count = 0;
+
+            size_t k = 0;
+            for (; k + 8 <= count; k += 8)
+            {
+                const __m256 x = _mm256_loadu_ps(diff_x + k);
+                const __m256 y = _mm256_loadu_ps(diff_y + k);
+                const __m256 distance_sq = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+                const __m256 close = _mm256_cmp_ps(distance_sq, min_distance_sq_v, _CMP_LT_OQ);
+                const __m256 in_range = _mm256_andnot_ps(close, _mm256_cmp_ps(distance_sq, radius_sq_v, _CMP_LT_OQ));
+                close_count += std::popcount(static_cast<unsigned>(_mm256_movemask_ps(close)));
+
+                const __m256 one_minus_q = _mm256_and_ps(in_range, _mm256_sub_ps(one, _mm256_mul_ps(_mm256_sqrt_ps(distance_sq), inv_radius_v)));
+                const __m256 one_minus_q_sq = _mm256_mul_ps(one_minus_q, one_minus_q);
+                density_v = _mm256_add_ps(density_v, one_minus_q_sq);
+                near_density_v = _mm256_add_ps(near_density_v, _mm256_mul_ps(one_minus_q_sq, one_minus_q));
+            }
+            density += horizontal_sum(density_v);
+            near_density += horizontal_sum(near_density_v);
+            return close_count + accumulate_density_sse2(diff_x + k, diff_y + k, count - k, radius_sq, inv_radius, density, near_density);
+        }
+
+        __attribute__((target("avx2"))) size_t pressure_displacements_avx2(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                                                            float pressure_factor, float near_pressure_factor,
+                                                                            float *displacement_x, float *displacement_y, float &total_x, float &total_y)
+        {
+            const __m256 radius_sq_v = _mm256_set1_ps(radius_sq);
+            const __m256 min_distance_sq_v = _mm256_set1_ps(MIN_DISTANCE_SQ);
+            const __m256 inv_radius_v = _mm256_set1_ps(inv_radius);
+            const __m256 pressure_v = _mm256_set1_ps(pressure_factor);
+            const __m256 near_pressure_v = _mm256_set1_ps(near_pressure_factor);
+            const __m256 one = _mm256_set1_ps(1.0f);
+            __m256 total_x_v = _mm256_setzero_ps();
+            __m256 total_y_v = _mm256_setzero_ps();
+            size_t close_count = 0;
+
+            size_t k = 0;
+            for (; k + 8 <= count; k += 8)
+            {
+                const __m256 x = _mm256_loadu_ps(diff_x + k);
+                const __m256 y = _mm256_loadu_ps(diff_y + k);
+                const __m256 distance_sq = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+                const __m256 close = _mm256_cmp_ps(distance_sq, min_distance_sq_v, _CMP_LT_OQ);
+                const __m256 in_range = _mm256_andnot_ps(close, _mm256_cmp_ps(distance_sq, radius_sq_v, _CMP_LT_OQ));
+                close_count += std::popcount(static_cast<unsigned>(_mm256_movemask_ps(close)));
+
+                const __m256 distance = _mm256_sqrt_ps(distance_sq);
+                const __m256 one_minus_q = _mm256_sub_ps(one, _mm256_mul_ps(distance, inv_radius_v));
+                const __m256 pressure = _mm256_add_ps(_mm256_mul_ps(pressure_v, one_minus_q),
+                                                      _mm256_mul_ps(near_pressure_v, _mm256_mul_ps(one_minus_q, one_minus_q)));
+                // Lanes out of range may divide by zero, the mask clears them afterwards
+                const __m256 magnitude = _mm256_and_ps(in_range, _mm256_div_ps(pressure, distance));
+                const __m256 dx = _mm256_mul_ps(x, magnitude);
+                const __m256 dy = _mm256_mul_ps(y, magnitude);
+                _mm256_storeu_ps(displacement_x + k, dx);
+                _mm256_storeu_ps(displacement_y + k, dy);
+                total_x_v = _mm256_sub_ps(total_x_v, dx);
+                total_y_v = _mm256_sub_ps(total_y_v, dy);
+            }
+            total_x += horizontal_sum(total_x_v);
+            total_y += horizontal_sum(total_y_v);
+            return close_count + pressure_displacements_sse2(diff_x + k, diff_y + k, count - k, radius_sq, inv_radius, pressure_factor,
+                                                             near_pressure_factor, displacement_x + k, displacement_y + k, total_x, total_y);
+        }
+#endif
+
+        /**
+         * @brief Gets the best instruction set supported by the CPU.
+         */
+        InstructionSet supported_instruction_set()
+        {
+#ifdef SIMD_KERNELS_AVX2
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return InstructionSet::AVX2;
+            }
+#endif
+#ifdef SIMD_KERNELS_SSE2
+            return InstructionSet::SSE2;
+#else
+            return InstructionSet::Scalar;
+#endif
+        }
+
+        struct Kernels
+        {
+            InstructionSet instruction_set = InstructionSet::Scalar;
+            DensityKernel density = accumulate_density_scalar;
+            DisplacementKernel displacements = pressure_displacements_scalar;
+        };
+
+        Kernels select_kernels(InstructionSet instruction_set)
+        {
+            if (instruction_set > supported_instruction_set())
+            {
+                instruction_set = supported_instruction_set();
+            }
+            switch (instruction_set)
+            {
+#ifdef SIMD_KERNELS_AVX2
+            case InstructionSet::AVX2:
+                return {InstructionSet::AVX2, accumulate_density_avx2, pressure_displacements_avx2};
+#endif
+#ifdef SIMD_KERNELS_SSE2
+            case InstructionSet::SSE2:
+                return {InstructionSet::SSE2, accumulate_density_sse2, pressure_displacements_sse2};
+#endif
+            default:
+                return {};
+            }
+        }
+
+        Kernels &active_kernels()
+        {
+            static Kernels kernels = select_kernels(supported_instruction_set());
+            return kernels;
+        }
+    }
+
+    InstructionSet active_instruction_set()
+    {
+        return active_kernels().instruction_set;
+    }
+
+    const char *instruction_set_name(InstructionSet instruction_set)
+    {
+        switch (instruction_set)
+        {
+        case InstructionSet::AVX2:
+            return "avx2";
+        case InstructionSet::SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+        }
+    }
+
+    void set_instruction_set(InstructionSet instruction_set)
+    {
+        active_kernels() = select_kernels(instruction_set);
+    }
+
+    size_t accumulate_density(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius, float &density, float &near_density)
+    {
+        density = 0.0f;
+        near_density = 0.0f;
+        return active_kernels().density(diff_x, diff_y, count, radius_sq, inv_radius, density, near_density);
+    }
+
+    size_t pressure_displacements(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                  float pressure_factor, float near_pressure_factor,
+                                  float *displacement_x, float *displacement_y, float &total_x, float &total_y)
+    {
+        total_x = 0.0f;
+        total_y = 0.0f;
+        return active_kernels().displacements(diff_x, diff_y, count, radius_sq, inv_radius, pressure_factor, near_pressure_factor,
+                                              displacement_x, displacement_y, total_x, total_y);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+
+/**
+ * @brief Vectorized inner loops of the double density relaxation (algorithm 2, section 4. Double density relaxation).
+ * Each kernel works on the neighbors of one particle, given as position differences (neighbor - particle).
+ * Branches of the scalar loop (radius test and too close neighbors) are replaced by masks.
+ * The implementation is picked at runtime: AVX2 (8 neighbors at a time), SSE2 (4 at a time) or plain scalar code.
+ */
+namespace simd_kernels
+{
+    /**
+     * @brief Instruction sets the kernels can use.
+     */
+    enum class InstructionSet
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * @brief Gets the instruction set used by the kernels.
+     * @return The instruction set in use.
+     */
+    InstructionSet active_instruction_set();
+
+    /**
+     * @brief Gets the name of an instruction set.
+     * @param instruction_set The instruction set.
+     * @return Lowercase name of the instruction set.
+     */
+    const char *instruction_set_name(InstructionSet instruction_set);
+
+    /**
+     * @brief Selects the instruction set used by the kernels (e.g., to compare against the scalar path).
+     * Instruction sets not supported by the CPU fall back to the best supported one below them.
+     * @param instruction_set The requested instruction set.
+     */
+    void set_instruction_set(InstructionSet instruction_set);
+
+    /**
+     * @brief Accumulates density and near density of a particle.
+     * Neighbors outside of the radius or closer than 0.1 do not contribute.
+     * @param diff_x X position differences of the neighbors.
+     * @param diff_y Y position differences of the neighbors.
+     * @param count Number of neighbors.
+     * @param radius_sq Squared interaction radius.
+     * @param inv_radius Inverse interaction radius.
+     * @param density Resulting density.
+     * @param near_density Resulting near density.
+     * @return Number of neighbors closer than 0.1 (these have to be nudged apart by the caller).
+     */
+    size_t accumulate_density(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius, float &density, float &near_density);
+
+    /**
+     * @brief Computes the pressure displacement of every neighbor and their sum.
+     * Neighbors outside of the radius or closer than 0.1 get a zero displacement.
+     * @param diff_x X position differences of the neighbors.
+     * @param diff_y Y position differences of the neighbors.
+     * @param count Number of neighbors.
+     * @param radius_sq Squared interaction radius.
+     * @param inv_radius Inverse interaction radius.
+     * @param pressure_factor Pressure multiplied by half of the squared time step.
+     * @param near_pressure_factor Near pressure multiplied by half of the squared time step.
+     * @param displacement_x Resulting x displacement of each neighbor.
+     * @param displacement_y Resulting y displacement of each neighbor.
+     * @param total_x Resulting x displacement of the particle itself (minus the sum of neighbor displacements).
+     * @param total_y Resulting y displacement of the particle itself (minus the sum of neighbor displacements).
+     * @return Number of neighbors closer than 0.1 (these have to be nudged apart by the caller).
+     */
+    size_t pressure_displacements(const float *diff_x, const float *diff_y, size_t count, float radius_sq, float inv_radius,
+                                  float pressure_factor, float near_pressure_factor,
+                                  float *displacement_x, float *displacement_y, float &total_x, float &total_y);
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+
+#include "simulation_runner.h"
+
+constexpr float MAX_IDLE_WAIT = 0.1f; // Longest wait for the next step (seconds), in case the speed is zero
+
+SimulationRunner::SimulationRunner(FluidSandbox &sandbox, float step_size) : sandbox_(sandbox), step_size_(step_size)
+{
+    publish(0.0f); // So there is something to draw before the first step
+    thread_ = std::thread(&SimulationRunner::run, this);
+}
+
+SimulationRunner::~SimulationRunner()
+{
+    stop();
+}
+
+void SimulationRunner::stop()
+{
+    if (!thread_.joinable())
+        return;
+    {
+        std::lock_guard lock(command_mutex_);
+        stopping_ = true;
+    }
+    command_condition_.notify_one();
+    thread_.join();
+}
+
+void SimulationRunner::submit(Command command)
+{
+    {
+        std::lock_guard lock(command_mutex_);
+        commands_.push_back(std::move(command));
+    }
+    command_condition_.notify_one();
+}
+
+void SimulationRunner::run()
+{
+    using clock = std::chrono::steady_clock;
+    std::vector<Command> commands;
+    auto last_time = clock::now();
+    float accumulator = 0.0f; // Simulation time not yet simulated
+
+    while (true)
+    {
+        {
+            std::lock_guard lock(command_mutex_);
+            if (stopping_)
+                return;
+            std::swap(commands, commands_);
+        }
+        const bool changed = !commands.empty();
+        for (auto &&command : commands)
+        {
+            command(sandbox_);
+        }
+        commands.clear();
+
+        const auto now = clock::now();
+        const float speed = sandbox_.params().simulation_speed;
+        accumulator += std::chrono::duration<float>(now - last_time).count() * speed;
+        last_time = now;
+
+        size_t steps = 0;
+        while (accumulator >= step_size_ && steps < MAX_STEPS_PER_UPDATE)
+        {
+            sandbox_.step(step_size_);
+            accumulator -= step_size_;
+            ++steps;
+        }
+        if (accumulator >= step_size_) // Fell behind, drop the time that can't be caught up with
+        {
+            accumulator = std::fmod(accumulator, step_size_);
+        }
+
+        const float step_period = speed > 0.0f ? step_size_ / speed : 0.0f;
+        if (steps > 0)
+        {
+            publish(step_period);
+        }
+        else if (changed) // Show the effect of the commands without restarting the interpolation
+        {
+            publish(-1.0f);
+        }
+
+        const float wait = speed > 0.0f ? std::min((step_size_ - accumulator) / speed, MAX_IDLE_WAIT) : MAX_IDLE_WAIT;
+        std::unique_lock lock(command_mutex_);
+        command_condition_.wait_for(lock, std::chrono::duration<float>(wait), [this]
+                                    { return stopping_ || !commands_.empty(); });
+    }
+}
+
+void SimulationRunner::publish(float step_period)
+{
+    if (step_period >= 0.0f) // A new step, otherwise the interpolation continues from the last one
+    {
+        last_step_time_ = std::chrono::steady_clock::now();
+        last_step_period_ = step_period;
+    }
+    RenderState &state = states_.back();
+    sandbox_.capture(state);
+    state.published_at = last_step_time_;
+    state.step_period = last_step_period_;
+    states_.publish();
+}
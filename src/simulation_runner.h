@@ -0,0 +1,98 @@
+#ifndef SIMULATION_RUNNER_H
+#define SIMULATION_RUNNER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fluid_sandbox.h"
+#include "render_state.h"
+#include "triple_buffer.h"
+
+inline constexpr float SIMULATION_STEP_SIZE_DEFAULT = 1.0f; // Simulation time per step (one 100 FPS frame at the default speed)
+constexpr size_t MAX_STEPS_PER_UPDATE = 4; // Steps run before publishing; time beyond that is dropped so a slow simulation slows down instead of falling further behind
+
+/**
+ * @brief Runs a FluidSandbox on its own thread with a fixed timestep, decoupled from rendering.
+ *
+ * Real time is accumulated (scaled by the simulation speed) and consumed in fixed steps, so the result of a step
+ * does not depend on the frame rate and a slow frame does not stall the simulation. After each batch of steps the
+ * state is copied into a RenderState and handed to the render thread through a triple buffer, so drawing and
+ * stepping overlap without either of them waiting for the other.
+ * The sandbox must only be accessed through `submit` while the runner exists.
+ */
+class SimulationRunner
+{
+public:
+    using Command = std::function<void(FluidSandbox &)>;
+
+    /**
+     * @brief Constructs the SimulationRunner and starts the simulation thread.
+     * @param sandbox The sandbox to simulate (must outlive the runner).
+     * @param step_size Simulation time per step.
+     */
+    explicit SimulationRunner(FluidSandbox &sandbox, float step_size = SIMULATION_STEP_SIZE_DEFAULT);
+
+    /**
+     * @brief Stops and joins the simulation thread.
+     */
+    ~SimulationRunner();
+
+    /**
+     * @brief Stops and joins the simulation thread, after which the sandbox can be used directly again.
+     */
+    void stop();
+
+    SimulationRunner(const SimulationRunner &) = delete;
+    SimulationRunner &operator=(const SimulationRunner &) = delete;
+
+    /**
+     * @brief Queues a command to run on the simulation thread before the next step.
+     * @param command The command.
+     */
+    void submit(Command command);
+
+    /**
+     * @brief Calls a function with the last published state and the current interpolation factor.
+     * Never waits for the simulation. Must always be called from the same thread.
+     * @tparam Function Callable taking `(const RenderState &, float alpha)`.
+     * @param function The function to call.
+     */
+    template <typename Function>
+    void read_state(Function &&function)
+    {
+        const RenderState &state = states_.acquire();
+        function(state, state.interpolation(std::chrono::steady_clock::now()));
+    }
+
+private:
+    FluidSandbox &sandbox_;
+    float step_size_;
+
+    std::thread thread_;
+    std::mutex command_mutex_;
+    std::condition_variable command_condition_;
+    std::vector<Command> commands_;
+    bool stopping_ = false;
+
+    TripleBuffer<RenderState> states_;
+    std::chrono::steady_clock::time_point last_step_time_; // When the last published step finished
+    float last_step_period_ = 0.0f;
+
+    /**
+     * @brief The loop of the simulation thread.
+     */
+    void run();
+
+    /**
+     * @brief Copies the sandbox into the back state and publishes it.
+     * @param step_period Wall time one step stands for (seconds), negative if no step was run since the last publish
+     * (keeps the interpolation going from the last step).
+     */
+    void publish(float step_period);
+};
+
+#endif
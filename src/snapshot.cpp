@@ -0,0 +1,398 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "fluid_sandbox.h"
+#include "mapped_file.h"
+#include "snapshot.h"
+
+namespace
+{
+    static_assert(std::is_trivially_copyable_v<SimulationParameters> && sizeof(SimulationParameters) % sizeof(float) == 0,
+                  "snapshots store SimulationParameters as an array of floats");
+    constexpr uint32_t PARAM_COUNT = sizeof(SimulationParameters) / sizeof(float);
+
+    constexpr size_t PARTICLE_FLOAT_ARRAYS = 9;
+    constexpr size_t PARTICLE_BYTES = sizeof(uint64_t) + PARTICLE_FLOAT_ARRAYS * sizeof(float);
+    constexpr size_t OBJECT_BYTES = 12 * sizeof(float) + sizeof(uint8_t);
+    constexpr size_t SPRING_BYTES = 2 * sizeof(uint64_t) + sizeof(float);
+    constexpr size_t BOUNDARY_BYTES = 4 * sizeof(uint8_t);
+    constexpr size_t REGION_BYTES = sizeof(uint8_t) + 4 * sizeof(float);
+    constexpr size_t EMITTER_BYTES = REGION_BYTES + 3 * sizeof(float) + 2 * sizeof(uint64_t);
+    constexpr size_t SINK_BYTES = REGION_BYTES;
+    constexpr size_t COUNTERS_BYTES = 5 * sizeof(uint64_t) + 2 * sizeof(float) + sizeof(uint8_t);
+
+    /**
+     * @brief Writes raw values to a snapshot file.
+     */
+    class SnapshotWriter
+    {
+    public:
+        explicit SnapshotWriter(std::ofstream &out) : out_(out) {}
+
+        template <typename T>
+        void value(const T &value) { out_.write(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+        template <typename T>
+        void array(const std::vector<T> &values)
+        {
+            if (values.empty()) // data() of an empty vector may be null
+                return;
+            out_.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+        }
+
+        void vector(sf::Vector2f vector)
+        {
+            value(vector.x);
+            value(vector.y);
+        }
+
+        void region(const Region &region)
+        {
+            value(static_cast<uint8_t>(region.shape));
+            vector(region.position);
+            vector(region.size);
+        }
+
+    private:
+        std::ofstream &out_;
+    };
+
+    /**
+     * @brief Reads raw values from a mapped snapshot file, throwing when reading past its end.
+     */
+    class SnapshotReader
+    {
+    public:
+        SnapshotReader(const MappedFile &file, const std::string &path)
+            : position_(file.data()), end_(file.data() + file.size()), path_(path) {}
+
+        template <typename T>
+        T value()
+        {
+            T value;
+            copy(&value, 1);
+            return value;
+        }
+
+        template <typename T>
+        void copy(T *out, size_t count)
+        {
+            require(count, sizeof(T));
+            if (count == 0) // Empty arrays pass a null data() as out, which memcpy must not get even for no bytes
+                return;
+            std::memcpy(out, position_, count * sizeof(T));
+            position_ += count * sizeof(T);
+        }
+
+        sf::Vector2f vector()
+        {
+            const float x = value<float>();
+            return {x, value<float>()};
+        }
+
+        Region region()
+        {
+            const RegionShape shape = static_cast<RegionShape>(value<uint8_t>());
+            const sf::Vector2f position = vector();
+            return {shape, position, vector()};
+        }
+
+        void skip(size_t count, size_t element_size)
+        {
+            require(count, element_size);
+            position_ += count * element_size;
+        }
+
+        bool at_end() const { return position_ == end_; }
+
+        [[noreturn]] void fail(const std::string &message) const { throw std::runtime_error(path_ + ": " + message); }
+
+    private:
+        const std::byte *position_;
+        const std::byte *end_;
+        const std::string &path_;
+
+        void require(size_t count, size_t element_size) const
+        {
+            if (count > static_cast<size_t>(end_ - position_) / element_size) // Also catches absurd counts without overflowing
+            {
+                fail("truncated snapshot");
+            }
+        }
+    };
+
+    /**
+     * @brief Reads and checks the header of a snapshot.
+     */
+    void read_header(SnapshotReader &reader)
+    {
+        char magic[sizeof(SNAPSHOT_MAGIC)];
+        reader.copy(magic, sizeof(magic));
+        if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+        {
+            reader.fail("not a snapshot file");
+        }
+        const uint32_t version = reader.value<uint32_t>();
+        if (version != SNAPSHOT_VERSION)
+        {
+            reader.fail("unsupported snapshot version " + std::to_string(version) + " (expected " + std::to_string(SNAPSHOT_VERSION) + ")");
+        }
+        if (reader.value<uint32_t>() != SNAPSHOT_BYTE_ORDER)
+        {
+            reader.fail("snapshot was written on a machine with a different byte order");
+        }
+    }
+
+    /**
+     * @brief Walks a whole snapshot without reading it, so a broken file is rejected before the sandbox is touched.
+     */
+    void validate(SnapshotReader &reader)
+    {
+        read_header(reader);
+        reader.skip(2, sizeof(uint32_t));
+        for (size_t edge = 0; edge < BOUNDARY_BYTES; ++edge)
+        {
+            if (reader.value<uint8_t>() >= BOUNDARY_MODE_COUNT)
+            {
+                reader.fail("invalid boundary mode");
+            }
+        }
+        if (reader.value<uint32_t>() != PARAM_COUNT)
+        {
+            reader.fail("parameter count does not match this version");
+        }
+        reader.skip(PARAM_COUNT, sizeof(float));
+        reader.skip(1, COUNTERS_BYTES);
+        reader.skip(reader.value<uint64_t>(), PARTICLE_BYTES);
+        reader.skip(reader.value<uint64_t>(), OBJECT_BYTES);
+        reader.skip(reader.value<uint64_t>(), SPRING_BYTES);
+        for (size_t element_bytes : {EMITTER_BYTES, SINK_BYTES})
+        {
+            const uint64_t count = reader.value<uint64_t>();
+            for (uint64_t i = 0; i < count; ++i) // Every element consumes bytes, so absurd counts end at the end of the file
+            {
+                if (reader.value<uint8_t>() >= REGION_SHAPE_COUNT)
+                {
+                    reader.fail("invalid region shape");
+                }
+                reader.skip(1, element_bytes - sizeof(uint8_t));
+            }
+        }
+        const uint64_t columns = reader.value<uint64_t>();
+        const uint64_t rows = reader.value<uint64_t>();
+        reader.skip(1, sizeof(uint64_t));
+        const uint64_t cell_count = reader.value<uint64_t>();
+        if (cell_count != 0 && (rows == 0 || columns != cell_count / rows || cell_count % rows != 0))
+        {
+            reader.fail("sleep cell count does not match the grid");
+        }
+        reader.skip(cell_count, sizeof(uint32_t));
+        if (!reader.at_end())
+        {
+            reader.fail("unexpected data after the end of the snapshot");
+        }
+    }
+}
+
+void FluidSandbox::save_snapshot(const std::string &path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        throw std::runtime_error("cannot open '" + path + "' for writing");
+    }
+    SnapshotWriter writer(out);
+
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writer.value(SNAPSHOT_VERSION);
+    writer.value(SNAPSHOT_BYTE_ORDER);
+
+    writer.value(static_cast<uint32_t>(size_.x));
+    writer.value(static_cast<uint32_t>(size_.y));
+    for (BoundaryMode mode : {boundaries_.left, boundaries_.right, boundaries_.top, boundaries_.bottom})
+    {
+        writer.value(static_cast<uint8_t>(mode));
+    }
+    writer.value(PARAM_COUNT);
+    writer.value(params_);
+
+    writer.value(static_cast<uint64_t>(Particle::next_id()));
+    writer.value(static_cast<uint64_t>(step_count_));
+    writer.value(static_cast<uint64_t>(reorder_interval_));
+    writer.value(static_cast<uint64_t>(steps_since_reorder_));
+    writer.value(random_state_);
+    writer.value(step_size_);
+    writer.value(max_acceleration_);
+    writer.value(static_cast<uint8_t>(reverse_calculation_order_));
+
+    writer.value(static_cast<uint64_t>(particles_.size()));
+    for (size_t id : particles_.id)
+    {
+        writer.value(static_cast<uint64_t>(id));
+    }
+    for (const std::vector<float> *array : {&particles_.position_x, &particles_.position_y, &particles_.prev_position_x, &particles_.prev_position_y,
+                                            &particles_.velocity_x, &particles_.velocity_y, &particles_.stress, &particles_.step_start_x, &particles_.step_start_y})
+    {
+        writer.array(*array);
+    }
+
+    writer.value(static_cast<uint64_t>(objects_.size()));
+    for (auto &&object : objects_)
+    {
+        writer.vector(object.position);
+        writer.vector(object.previous_position);
+        writer.vector(object.velocity);
+        writer.vector(object.velocity_buffer);
+        writer.vector(object.step_start);
+        writer.value(object.radius);
+        writer.value(object.mass);
+        writer.value(static_cast<uint8_t>(object.is_locked));
+    }
+
+    writer.value(static_cast<uint64_t>(springs_.size()));
+    springs_.for_each([&writer](const SpringTable::Slot &spring)
+                      {
+                          writer.value(static_cast<uint64_t>(spring.id_low));
+                          writer.value(static_cast<uint64_t>(spring.id_high));
+                          writer.value(spring.rest_length); });
+
+    writer.value(static_cast<uint64_t>(emitters_.size()));
+    for (auto &&emitter : emitters_)
+    {
+        writer.region(emitter.region);
+        writer.value(emitter.rate);
+        writer.vector(emitter.velocity);
+        writer.value(emitter.first_step);
+        writer.value(emitter.last_step);
+    }
+    writer.value(static_cast<uint64_t>(sinks_.size()));
+    for (auto &&sink : sinks_)
+    {
+        writer.region(sink.region);
+    }
+
+    writer.value(static_cast<uint64_t>(sleep_columns_));
+    writer.value(static_cast<uint64_t>(sleep_rows_));
+    writer.value(static_cast<uint64_t>(sleep_cell_size_));
+    writer.value(static_cast<uint64_t>(cell_calm_steps_.size()));
+    writer.array(cell_calm_steps_);
+
+    if (!out.flush())
+    {
+        throw std::runtime_error("cannot write '" + path + "'");
+    }
+}
+
+void FluidSandbox::load_snapshot(const std::string &path)
+{
+    const MappedFile file(path);
+    {
+        SnapshotReader reader(file, path);
+        validate(reader);
+    }
+
+    SnapshotReader reader(file, path);
+    read_header(reader);
+
+    const uint32_t width = reader.value<uint32_t>();
+    size_ = {width, reader.value<uint32_t>()};
+    for (BoundaryMode *mode : {&boundaries_.left, &boundaries_.right, &boundaries_.top, &boundaries_.bottom})
+    {
+        *mode = static_cast<BoundaryMode>(reader.value<uint8_t>()); // Checked by validate
+    }
+    reader.skip(1, sizeof(uint32_t)); // Parameter count, checked by validate
+    params_ = reader.value<SimulationParameters>();
+
+    Particle::set_next_id(static_cast<size_t>(reader.value<uint64_t>()));
+    step_count_ = reader.value<uint64_t>();
+    reorder_interval_ = static_cast<size_t>(reader.value<uint64_t>());
+    steps_since_reorder_ = static_cast<size_t>(reader.value<uint64_t>());
+    random_state_ = reader.value<uint64_t>();
+    step_size_ = reader.value<float>();
+    max_acceleration_ = reader.value<float>();
+    reverse_calculation_order_ = reader.value<uint8_t>() != 0;
+
+    const size_t particle_count = static_cast<size_t>(reader.value<uint64_t>());
+    particles_.clear();
+    particles_.resize(particle_count);
+    if constexpr (sizeof(size_t) == sizeof(uint64_t))
+    {
+        reader.copy(particles_.id.data(), particle_count);
+    }
+    else
+    {
+        for (size_t &id : particles_.id)
+        {
+            id = static_cast<size_t>(reader.value<uint64_t>());
+        }
+    }
+    for (std::vector<float> *array : {&particles_.position_x, &particles_.position_y, &particles_.prev_position_x, &particles_.prev_position_y,
+                                      &particles_.velocity_x, &particles_.velocity_y, &particles_.stress, &particles_.step_start_x, &particles_.step_start_y})
+    {
+        reader.copy(array->data(), particle_count);
+    }
+
+    neighbors_valid_ = false;
+    grabbed_object_ = NO_OBJECT; // The grabbed object is gone, there is nothing to unlock
+    const size_t object_count = static_cast<size_t>(reader.value<uint64_t>());
+    objects_.clear();
+    objects_.reserve(object_count);
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        const sf::Vector2f position = reader.vector();
+        const sf::Vector2f previous_position = reader.vector();
+        const sf::Vector2f velocity = reader.vector();
+        const sf::Vector2f velocity_buffer = reader.vector();
+        const sf::Vector2f step_start = reader.vector();
+        const float radius = reader.value<float>();
+        Object &object = objects_.emplace_back(position, radius, reader.value<float>(), velocity);
+        object.previous_position = previous_position;
+        object.velocity_buffer = velocity_buffer;
+        object.step_start = step_start;
+        object.is_locked = reader.value<uint8_t>() != 0;
+    }
+
+    const size_t spring_count = static_cast<size_t>(reader.value<uint64_t>());
+    springs_.clear();
+    for (size_t i = 0; i < spring_count; ++i)
+    {
+        const size_t id_low = static_cast<size_t>(reader.value<uint64_t>());
+        const size_t id_high = static_cast<size_t>(reader.value<uint64_t>());
+        springs_.insert({id_low, id_high, reader.value<float>()});
+    }
+
+    const size_t emitter_count = static_cast<size_t>(reader.value<uint64_t>());
+    emitters_.clear();
+    for (size_t i = 0; i < emitter_count; ++i)
+    {
+        ParticleEmitter &emitter = emitters_.emplace_back();
+        emitter.region = reader.region();
+        emitter.rate = reader.value<float>();
+        emitter.velocity = reader.vector();
+        emitter.first_step = reader.value<uint64_t>();
+        emitter.last_step = reader.value<uint64_t>();
+    }
+    const size_t sink_count = static_cast<size_t>(reader.value<uint64_t>());
+    sinks_.clear();
+    for (size_t i = 0; i < sink_count; ++i)
+    {
+        sinks_.push_back({reader.region()});
+    }
+
+    sleep_columns_ = static_cast<size_t>(reader.value<uint64_t>());
+    sleep_rows_ = static_cast<size_t>(reader.value<uint64_t>());
+    sleep_cell_size_ = static_cast<size_t>(reader.value<uint64_t>());
+    const size_t cell_count = static_cast<size_t>(reader.value<uint64_t>());
+    cell_calm_steps_.resize(cell_count);
+    reader.copy(cell_calm_steps_.data(), cell_count);
+    cell_sleep_.assign(cell_count, AWAKE); // The levels follow from the counters at the start of the next step
+    particle_sleep_.clear();
+    sleep_params_ = params_;
+
+    // The sleep state is checked against the particle grid before the first substep, so the grid gets the layout the
+    // saved simulation had
+    neighbor_radius_ = params_.interaction_radius + neighbor_skin_;
+    particle_grid_.update(particles_.position_x, particles_.position_y, neighbor_radius_, size_, boundaries_.periodic_x(), boundaries_.periodic_y());
+}
@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+
+/*
+ * Binary snapshot of a FluidSandbox (FluidSandbox::save_snapshot / load_snapshot).
+ *
+ * All values are stored in the byte order of the machine that wrote them (checked with SNAPSHOT_BYTE_ORDER on
+ * load), without padding:
+ * - Header: SNAPSHOT_MAGIC (8 bytes), version (u32), byte order mark (u32).
+ * - Domain: width, height (u32 each), boundary modes of the left, right, top and bottom edge (u8 each, BoundaryMode).
+ * - Parameters: count (u32) followed by that many f32, in the order of the members of SimulationParameters.
+ * - Counters: next particle ID, steps simulated, reorder interval, steps since the last reorder, random generator
+ *   state (u64 each), length of the last step, acceleration estimate of adaptive stepping (f32 each), reversed
+ *   calculation order flag (u8).
+ * - Particles: count n (u64), IDs (n u64), then the arrays position_x, position_y, prev_position_x,
+ *   prev_position_y, velocity_x, velocity_y, stress, step_start_x, step_start_y (n f32 each).
+ * - Objects: count (u64), then per object position, previous_position, velocity, velocity_buffer, step_start
+ *   (2 f32 each), radius, mass (f32) and the locked flag (u8).
+ * - Springs: count (u64), then per spring the lower and the higher particle ID (u64) and the rest length (f32).
+ * - Emitters: count (u64), then per emitter its region, the rate (f32), velocity (2 f32), first and last step (u64).
+ * - Sinks: count (u64), then per sink its region.
+ * - Sleep: particle grid columns, rows and cell size the state belongs to (u64 each), then the cell count (u64, 0 if
+ *   sleeping is off) followed by that many calm step counters (u32), row by row.
+ * A region is stored as its shape (u8, RegionShape), position and size (2 f32 each).
+ *
+ * The version is increased whenever the layout or SimulationParameters change, older versions are rejected.
+ */
+
+constexpr char SNAPSHOT_MAGIC[8] = {'F', 'L', 'U', 'I', 'D', 'S', 'N', 'P'};
+constexpr uint32_t SNAPSHOT_VERSION = 6;
+constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+#endif
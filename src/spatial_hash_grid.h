@@ -1,6 +1,9 @@
 #ifndef SPATIAL_HASH_GRID_H
 #define SPATIAL_HASH_GRID_H
 
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
 #include <unordered_map>
 #include <vector>
 
@@ -10,11 +13,19 @@
  * @brief A spatial hash grid for efficient neighbor searching.
  * @tparam T The type of objects to be stored in the grid (e.g., Particle, Object).
  * Type T must have a public `sf::Vector2f position` member.
+ * Cells and query results are allocated from a memory resource, so a grid rebuilt every step can live in a
+ * FrameArena (call `release` before the arena is reset).
  */
 template <typename T>
 class SpatialHashGrid
 {
 public:
+    /**
+     * @brief Creates an empty grid.
+     * @param memory Memory resource for the cells and query results (must outlive the grid).
+     */
+    explicit SpatialHashGrid(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) : grid_(memory) {}
+
     /**
      * @brief Updates the grid with a new set of objects and cell size.
      * Clears the existing grid and re-inserts all objects.
@@ -28,12 +39,18 @@ public:
      * @brief Queries the grid for objects within a given radius of a center point.
      * @param center The center point of the query circle.
      * @param radius The radius of the query circle.
-     * @return A vector of pointers to objects found within the query radius.
+     * @return A vector of pointers to objects found within the query radius, allocated from the grid's memory resource.
+     */
+    std::pmr::vector<T *> query(sf::Vector2f center, float radius) const;
+
+    /**
+     * @brief Drops all cells and the bucket array without using their memory again (the grid is empty until the
+     * next update). Call before resetting the memory resource.
      */
-    std::vector<T *> query(sf::Vector2f center, float radius) const;
+    void release();
 
 private:
-    std::unordered_map<size_t, std::vector<T *>> grid_;
+    std::pmr::unordered_map<size_t, std::pmr::vector<T *>> grid_;
     size_t cell_size_ = 1;
     size_t max_cell_size_ = 0;
 
@@ -48,6 +65,13 @@ private:
      */
     void clear();
 
+    /**
+     * @brief Computes the cell coordinate of an x or y coordinate (negative left of or above the origin).
+     * @param coordinate The coordinate.
+     * @return The cell coordinate (0 for NaN and coordinates too far out to be represented).
+     */
+    int64_t cell_coordinate(float coordinate) const;
+
     /**
      * @brief Computes the hash key for a given position.
      * @param position The position to hash.
@@ -61,22 +85,28 @@ private:
      * @param cell_y The y-coordinate of the cell.
      * @return The hash key for the cell.
      */
-    size_t hash_cell(size_t cell_x, size_t cell_y) const;
+    size_t hash_cell(int64_t cell_x, int64_t cell_y) const;
 };
 
+template <typename T>
+inline int64_t SpatialHashGrid<T>::cell_coordinate(float coordinate) const
+{
+    // Cells left of or above the origin get their own negative coordinates instead of all sharing cell 0
+    const float cell = std::floor(coordinate / cell_size_);
+    return std::abs(cell) < 1e15f ? static_cast<int64_t>(cell) : 0; // Also catches NaN
+}
+
 template <typename T>
 inline size_t SpatialHashGrid<T>::hash_position(const sf::Vector2f position) const
 {
-    // Ensure non-negative cell coordinates before casting
-    size_t cell_x = (position.x >= 0) ? static_cast<size_t>(position.x / cell_size_) : 0;
-    size_t cell_y = (position.y >= 0) ? static_cast<size_t>(position.y / cell_size_) : 0;
-    return hash_cell(cell_x, cell_y);
+    return hash_cell(cell_coordinate(position.x), cell_coordinate(position.y));
 }
 
 template <typename T>
-inline size_t SpatialHashGrid<T>::hash_cell(size_t cell_x, size_t cell_y) const
+inline size_t SpatialHashGrid<T>::hash_cell(int64_t cell_x, int64_t cell_y) const
 {
-    return cell_x + cell_y * utils::HASH_PRIME;
+    // Unsigned arithmetic wraps, so negative coordinates hash like any others
+    return static_cast<size_t>(cell_x) + static_cast<size_t>(cell_y) * utils::HASH_PRIME;
 }
 
 template <typename T>
@@ -85,6 +115,12 @@ inline void SpatialHashGrid<T>::clear()
     grid_.clear();
 }
 
+template <typename T>
+inline void SpatialHashGrid<T>::release()
+{
+    grid_ = decltype(grid_)(grid_.get_allocator());
+}
+
 template <typename T>
 inline void SpatialHashGrid<T>::insert(std::vector<T> &objects)
 {
@@ -107,26 +143,30 @@ inline void SpatialHashGrid<T>::insert(std::vector<T> &objects)
 }
 
 template <typename T>
-inline std::vector<T *> SpatialHashGrid<T>::query(sf::Vector2f center, float radius) const
+inline std::pmr::vector<T *> SpatialHashGrid<T>::query(sf::Vector2f center, float radius) const
 {
+    std::pmr::vector<T *> result(grid_.get_allocator());
     if (cell_size_ == 0) // Avoid zero division
     {
-        return std::vector<T *>();
+        return result;
     }
 
     const float radius_sq = radius * radius; // Use squared distance for efficiency
 
-    size_t min_cell_x = (center.x - radius) > 0 ? static_cast<size_t>((center.x - radius) / cell_size_) : 0;
-    size_t max_cell_x = (center.x + radius) > 0 ? static_cast<size_t>((center.x + radius) / cell_size_) : 0;
-    size_t min_cell_y = (center.y - radius) > 0 ? static_cast<size_t>((center.y - radius) / cell_size_) : 0;
-    size_t max_cell_y = (center.y + radius) > 0 ? static_cast<size_t>((center.y + radius) / cell_size_) : 0;
+    const int64_t min_cell_x = cell_coordinate(center.x - radius);
+    const int64_t max_cell_x = cell_coordinate(center.x + radius);
+    const int64_t min_cell_y = cell_coordinate(center.y - radius);
+    const int64_t max_cell_y = cell_coordinate(center.y + radius);
 
-    std::vector<T *> result;
-    result.reserve((max_cell_x - min_cell_x + 1) * (max_cell_y - min_cell_y + 1) * max_cell_size_);
+    if (max_cell_x < min_cell_x || max_cell_y < min_cell_y) // Only when a coordinate is out of range
+    {
+        return result;
+    }
+    result.reserve(static_cast<size_t>((max_cell_x - min_cell_x + 1) * (max_cell_y - min_cell_y + 1)) * max_cell_size_);
 
-    for (size_t x = min_cell_x; x <= max_cell_x; ++x)
+    for (int64_t x = min_cell_x; x <= max_cell_x; ++x)
     {
-        for (size_t y = min_cell_y; y <= max_cell_y; ++y)
+        for (int64_t y = min_cell_y; y <= max_cell_y; ++y)
         {
             size_t key = hash_cell(x, y);
 
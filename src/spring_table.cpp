@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+#include "spring_table.h"
+
+void SpringTable::clear()
+{
+    std::fill(slots_.begin(), slots_.end(), Slot{});
+    live_ = 0;
+    tombstones_ = 0;
+}
+
+void SpringTable::begin_step()
+{
+    if (++generation_ < FIRST_GENERATION) // Wrapped around, restamp live springs so none looks kept by accident
+    {
+        generation_ = FIRST_GENERATION + 1;
+        for (Slot &slot : slots_)
+        {
+            if (slot.stamp >= FIRST_GENERATION)
+            {
+                slot.stamp = FIRST_GENERATION;
+            }
+        }
+    }
+}
+
+size_t SpringTable::home_slot(size_t id_low, size_t id_high) const
+{
+    // splitmix64 finalizer over both IDs
+    uint64_t hash = static_cast<uint64_t>(id_low) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(id_high);
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return static_cast<size_t>(hash) & (slots_.size() - 1);
+}
+
+SpringTable::Slot *SpringTable::find(size_t id_low, size_t id_high)
+{
+    if (live_ == 0)
+        return nullptr;
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = home_slot(id_low, id_high);; i = (i + 1) & mask)
+    {
+        Slot &slot = slots_[i];
+        // Other threads may keep the slot meanwhile, that only changes one generation stamp into another
+        const uint32_t stamp = std::atomic_ref<uint32_t>(slot.stamp).load(std::memory_order_relaxed);
+        if (stamp == EMPTY)
+            return nullptr;
+        if (stamp != TOMBSTONE && slot.id_low == id_low && slot.id_high == id_high)
+            return &slot;
+    }
+}
+
+void SpringTable::insert(const Spring &spring)
+{
+    // Live springs and tombstones stay below 3/4 of the slots, so probing always ends at an empty slot
+    if ((live_ + tombstones_ + 1) * 4 > slots_.size() * 3)
+    {
+        rehash(fitting_capacity(live_ + 1));
+    }
+
+    const size_t mask = slots_.size() - 1;
+    size_t i = home_slot(spring.id_low, spring.id_high);
+    while (slots_[i].stamp >= FIRST_GENERATION)
+    {
+        i = (i + 1) & mask;
+    }
+    if (slots_[i].stamp == TOMBSTONE)
+    {
+        --tombstones_;
+    }
+    slots_[i] = {spring.id_low, spring.id_high, spring.rest_length, generation_};
+    ++live_;
+}
+
+void SpringTable::remove_stale()
+{
+    for (Slot &slot : slots_)
+    {
+        if (slot.stamp >= FIRST_GENERATION && slot.stamp != generation_)
+        {
+            slot.stamp = TOMBSTONE;
+            --live_;
+            ++tombstones_;
+        }
+    }
+    // Shrink once most slots are unused, rehash in place once tombstones would slow down probing
+    const size_t capacity = fitting_capacity(live_);
+    if (capacity * 4 <= slots_.size() || tombstones_ * 4 > slots_.size())
+    {
+        rehash(capacity);
+    }
+}
+
+size_t SpringTable::fitting_capacity(size_t springs) const
+{
+    return std::max(MIN_CAPACITY, std::bit_ceil(springs * 2)); // At most half full after a rehash
+}
+
+void SpringTable::rehash(size_t capacity)
+{
+    std::swap(slots_, scratch_);
+    slots_.assign(capacity, Slot{});
+    tombstones_ = 0;
+
+    const size_t mask = capacity - 1;
+    for (const Slot &slot : scratch_)
+    {
+        if (slot.stamp < FIRST_GENERATION)
+            continue;
+        size_t i = home_slot(slot.id_low, slot.id_high);
+        while (slots_[i].stamp != EMPTY)
+        {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = slot;
+    }
+    if (scratch_.size() > capacity) // Shrinking, give the memory back
+    {
+        scratch_ = {};
+    }
+}
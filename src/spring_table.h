@@ -0,0 +1,138 @@
+#ifndef SPRING_TABLE_H
+#define SPRING_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief All springs of the simulation in one flat open-addressing hash table (linear probing) keyed by the
+ * IDs of the two particles (lower ID first).
+ *
+ * Springs are updated in place: each step the spring pass finds the springs of the pairs it visits and keeps
+ * them alive, new springs are inserted and springs not kept during the step are removed afterwards (their slots
+ * become tombstones). The table only reallocates when the number of live springs outgrows it or drops far below
+ * it, so its memory follows the number of live springs.
+ */
+class SpringTable
+{
+public:
+    /**
+     * @brief A spring between two particles.
+     */
+    struct Spring
+    {
+        size_t id_low;  // ID of the particle with the lower ID
+        size_t id_high; // ID of the particle with the higher ID
+        float rest_length;
+    };
+
+    /**
+     * @brief A slot of the table, `stamp` tells whether it is empty, a tombstone, or when the spring was last kept.
+     */
+    struct Slot
+    {
+        size_t id_low = 0;
+        size_t id_high = 0;
+        float rest_length = 0.0f;
+        uint32_t stamp = 0;
+    };
+
+    /**
+     * @brief Gets the number of live springs.
+     * @return Number of springs.
+     */
+    size_t size() const { return live_; }
+
+    /**
+     * @brief Gets the number of slots of the table.
+     * @return Number of slots.
+     */
+    size_t capacity() const { return slots_.size(); }
+
+    /**
+     * @brief Removes all springs.
+     */
+    void clear();
+
+    /**
+     * @brief Starts a new step, after which springs have to be kept or inserted again to survive `remove_stale`.
+     */
+    void begin_step();
+
+    /**
+     * @brief Finds a spring.
+     * May run concurrently with other `find` and `keep` calls (for different springs), but not with `insert` or `remove_stale`,
+     * the stamps `keep` writes meanwhile are read atomically.
+     * @param id_low ID of the particle with the lower ID.
+     * @param id_high ID of the particle with the higher ID.
+     * @return The slot of the spring or nullptr if there is no such spring.
+     */
+    Slot *find(size_t id_low, size_t id_high);
+
+    /**
+     * @brief Marks a found spring as alive during the current step.
+     * Writes the stamp atomically, so it may run concurrently with `find` calls probing over the slot.
+     * @param slot The slot returned by `find`.
+     */
+    void keep(Slot &slot) const { std::atomic_ref<uint32_t>(slot.stamp).store(generation_, std::memory_order_relaxed); }
+
+    /**
+     * @brief Inserts a new spring alive during the current step (there must not be a spring between the particles yet).
+     * @param spring The new spring.
+     */
+    void insert(const Spring &spring);
+
+    /**
+     * @brief Removes all springs that were not kept or inserted since `begin_step`.
+     */
+    void remove_stale();
+
+    /**
+     * @brief Calls a function for every live spring.
+     * @tparam Function Callable taking `const Slot &`.
+     * @param function The function to call.
+     */
+    template <typename Function>
+    void for_each(Function &&function) const
+    {
+        for (const Slot &slot : slots_)
+        {
+            if (slot.stamp >= FIRST_GENERATION)
+            {
+                function(slot);
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t EMPTY = 0;
+    static constexpr uint32_t TOMBSTONE = 1;
+    static constexpr uint32_t FIRST_GENERATION = 2; // Stamps of live springs start here
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    std::vector<Slot> slots_; // Size is zero or a power of two
+    std::vector<Slot> scratch_; // Old slots while rehashing, kept to avoid reallocating
+    size_t live_ = 0;
+    size_t tombstones_ = 0;
+    uint32_t generation_ = FIRST_GENERATION;
+
+    /**
+     * @brief Computes the starting slot of a key.
+     */
+    size_t home_slot(size_t id_low, size_t id_high) const;
+
+    /**
+     * @brief Rebuilds the table without tombstones.
+     * @param capacity The new number of slots (power of two).
+     */
+    void rehash(size_t capacity);
+
+    /**
+     * @brief Computes the capacity fitting the current number of live springs.
+     */
+    size_t fitting_capacity(size_t springs) const;
+};
+
+#endif
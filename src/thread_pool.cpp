@@ -0,0 +1,82 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    start_condition_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(ChunkFunction chunk_function, void *context, size_t count)
+{
+    if (workers_.empty())
+    {
+        chunk_function(context, 0, count, 0);
+        return;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        chunk_function_ = chunk_function;
+        context_ = context;
+        count_ = count;
+        pending_workers_ = workers_.size();
+        ++generation_;
+    }
+    start_condition_.notify_all();
+
+    chunk_function(context, 0, chunk_begin(count, 1), 0);
+
+    std::unique_lock lock(mutex_);
+    done_condition_.wait(lock, [this]
+                         { return pending_workers_ == 0; });
+}
+
+void ThreadPool::worker_loop(size_t thread_index)
+{
+    size_t seen_generation = 0;
+    while (true)
+    {
+        ChunkFunction chunk_function;
+        void *context;
+        size_t count;
+        {
+            std::unique_lock lock(mutex_);
+            start_condition_.wait(lock, [this, seen_generation]
+                                  { return stopping_ || generation_ != seen_generation; });
+            if (stopping_)
+            {
+                return;
+            }
+            seen_generation = generation_;
+            chunk_function = chunk_function_;
+            context = context_;
+            count = count_;
+        }
+
+        chunk_function(context, chunk_begin(count, thread_index), chunk_begin(count, thread_index + 1), thread_index);
+
+        bool last = false;
+        {
+            std::lock_guard lock(mutex_);
+            last = --pending_workers_ == 0;
+        }
+        if (last)
+        {
+            done_condition_.notify_one();
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed-size pool of worker threads for data parallel loops.
+ * The work of one `parallel_for` call is split into one contiguous chunk per thread, the calling thread
+ * works on the first chunk. The split only depends on the item count and thread count, so a loop
+ * that writes disjoint data gives the same result on every run.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief Constructs the ThreadPool.
+     * @param thread_count Total number of threads working on a loop, including the calling thread (at least 1).
+     */
+    explicit ThreadPool(size_t thread_count);
+
+    /**
+     * @brief Stops and joins all worker threads.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Gets the number of threads working on a loop (including the calling thread).
+     * @return Number of threads.
+     */
+    size_t thread_count() const { return workers_.size() + 1; }
+
+    /**
+     * @brief Gets the first item of a thread's chunk.
+     * @param count Number of items of the loop.
+     * @param thread_index Index of the thread.
+     * @return Index of the first item handled by the thread.
+     */
+    size_t chunk_begin(size_t count, size_t thread_index) const { return count * thread_index / thread_count(); }
+
+    /**
+     * @brief Runs a function over `count` items split into one chunk per thread and waits until all chunks are done.
+     * Must not be called from inside a running loop.
+     * @tparam Function Callable taking `(size_t begin, size_t end, size_t thread_index)`.
+     * @param count Number of items.
+     * @param function The function to run for each chunk.
+     */
+    template <typename Function>
+    void parallel_for(size_t count, Function &&function);
+
+private:
+    using ChunkFunction = void (*)(void *context, size_t begin, size_t end, size_t thread_index);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_condition_;
+    std::condition_variable done_condition_;
+
+    ChunkFunction chunk_function_ = nullptr;
+    void *context_ = nullptr;
+    size_t count_ = 0;
+    size_t generation_ = 0;     // Incremented for every loop, workers wait for it to change
+    size_t pending_workers_ = 0; // Workers that have not finished their chunk of the current loop
+    bool stopping_ = false;
+
+    /**
+     * @brief Runs a loop on all threads (type-erased part of `parallel_for`).
+     * @param chunk_function Function running one chunk.
+     * @param context Pointer passed to the chunk function.
+     * @param count Number of items.
+     */
+    void run(ChunkFunction chunk_function, void *context, size_t count);
+
+    /**
+     * @brief Main loop of a worker thread.
+     * @param thread_index Index of the worker thread (1 and up, 0 is the calling thread).
+     */
+    void worker_loop(size_t thread_index);
+};
+
+template <typename Function>
+inline void ThreadPool::parallel_for(size_t count, Function &&function)
+{
+    using FunctionType = std::remove_reference_t<Function>;
+    run([](void *context, size_t begin, size_t end, size_t thread_index)
+        { (*static_cast<FunctionType *>(context))(begin, end, thread_index); },
+        const_cast<void *>(static_cast<const void *>(std::addressof(function))), count);
+}
+
+#endif
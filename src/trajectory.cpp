@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include "fluid_sandbox.h"
+#include "trajectory.h"
+
+namespace
+{
+    constexpr float POSITION_LEVELS = 65535.0f; // Quantization levels of a position within the area
+    constexpr float SIGNED_LEVELS = 32767.0f;   // Quantization levels of a velocity or stress within its scale
+
+    void put_varint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void put_signed(std::vector<uint8_t> &out, int64_t value)
+    {
+        put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63)); // Zigzag
+    }
+
+    template <typename T>
+    void put_raw(std::vector<uint8_t> &out, const T &value)
+    {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    uint16_t quantize_position(float value, unsigned int extent)
+    {
+        if (extent == 0)
+            return 0;
+        return static_cast<uint16_t>(std::clamp(std::lround(value / static_cast<float>(extent) * POSITION_LEVELS), 0L, static_cast<long>(POSITION_LEVELS)));
+    }
+
+    float dequantize_position(uint16_t value, unsigned int extent)
+    {
+        return static_cast<float>(value) * static_cast<float>(extent) / POSITION_LEVELS;
+    }
+
+    /**
+     * @brief Writes the scale of an array followed by its values quantized to signed 16 bits of it.
+     */
+    void put_scaled(std::vector<uint8_t> &out, const std::vector<float> &values)
+    {
+        float scale = 0.0f;
+        for (float value : values)
+        {
+            scale = std::max(scale, std::abs(value));
+        }
+        put_raw(out, scale);
+        const float factor = scale > 0.0f ? SIGNED_LEVELS / scale : 0.0f;
+        for (float value : values)
+        {
+            put_signed(out, std::lround(value * factor));
+        }
+    }
+
+    /**
+     * @brief Reads values from a payload, throwing when reading past its end.
+     */
+    class PayloadReader
+    {
+    public:
+        PayloadReader(const std::byte *data, size_t size, const std::string &path) : position_(data), end_(data + size), path_(path) {}
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                const uint8_t byte = static_cast<uint8_t>(next());
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+            fail();
+        }
+
+        int64_t signed_varint()
+        {
+            const uint64_t value = varint();
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        template <typename T>
+        T raw()
+        {
+            if (static_cast<size_t>(end_ - position_) < sizeof(T))
+                fail();
+            T value;
+            std::memcpy(&value, position_, sizeof(T));
+            position_ += sizeof(T);
+            return value;
+        }
+
+        void scaled(std::vector<float> &values, size_t count)
+        {
+            const float scale = raw<float>();
+            values.resize(count);
+            for (float &value : values)
+            {
+                value = static_cast<float>(signed_varint()) * scale / SIGNED_LEVELS;
+            }
+        }
+
+        [[noreturn]] void fail() const { throw std::runtime_error(path_ + ": broken trajectory frame"); }
+
+    private:
+        const std::byte *position_;
+        const std::byte *end_;
+        const std::string &path_;
+
+        std::byte next()
+        {
+            if (position_ == end_)
+                fail();
+            return *position_++;
+        }
+    };
+}
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string &path, size_t interval)
+    : interval_(std::max<size_t>(1, interval)), out_(path, std::ios::binary)
+{
+    if (!out_)
+    {
+        throw std::runtime_error("cannot open '" + path + "' for writing");
+    }
+    out_.write(TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    const uint32_t header[] = {TRAJECTORY_VERSION, TRAJECTORY_BYTE_ORDER, static_cast<uint32_t>(interval_)};
+    out_.write(reinterpret_cast<const char *>(header), sizeof(header));
+    thread_ = std::thread(&TrajectoryRecorder::run, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    try
+    {
+        finish();
+    }
+    catch (const std::exception &)
+    {
+    }
+}
+
+void TrajectoryRecorder::record(const FluidSandbox &sandbox)
+{
+    if (sandbox.step_count() % interval_ != 0)
+        return;
+
+    std::unique_ptr<TrajectoryFrame> frame;
+    {
+        std::lock_guard lock(mutex_);
+        if (stopping_)
+            return;
+        if (pending_.size() >= TRAJECTORY_MAX_PENDING_FRAMES)
+        {
+            ++dropped_;
+            return;
+        }
+        if (!free_.empty())
+        {
+            frame = std::move(free_.back());
+            free_.pop_back();
+        }
+    }
+    if (!frame)
+    {
+        frame = std::make_unique<TrajectoryFrame>();
+    }
+
+    const ParticleStore &particles = sandbox.particles();
+    frame->step = sandbox.step_count();
+    frame->size = sandbox.size();
+    frame->id.assign(particles.id.begin(), particles.id.end());
+    frame->position_x.assign(particles.position_x.begin(), particles.position_x.end());
+    frame->position_y.assign(particles.position_y.begin(), particles.position_y.end());
+    frame->velocity_x.assign(particles.velocity_x.begin(), particles.velocity_x.end());
+    frame->velocity_y.assign(particles.velocity_y.begin(), particles.velocity_y.end());
+    frame->stress.assign(particles.stress.begin(), particles.stress.end());
+    frame->objects.clear();
+    for (auto &&object : sandbox.objects())
+    {
+        frame->objects.push_back({object.position, object.velocity, object.radius, object.is_locked});
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        pending_.push_back(std::move(frame));
+    }
+    condition_.notify_one();
+}
+
+void TrajectoryRecorder::finish()
+{
+    if (!thread_.joinable())
+        return;
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+    out_.close();
+    if (!error_.empty())
+    {
+        throw std::runtime_error(error_);
+    }
+}
+
+size_t TrajectoryRecorder::frames_written() const
+{
+    std::lock_guard lock(mutex_);
+    return written_;
+}
+
+size_t TrajectoryRecorder::frames_dropped() const
+{
+    std::lock_guard lock(mutex_);
+    return dropped_;
+}
+
+void TrajectoryRecorder::run()
+{
+    while (true)
+    {
+        std::unique_ptr<TrajectoryFrame> frame;
+        {
+            std::unique_lock lock(mutex_);
+            condition_.wait(lock, [this]
+                            { return stopping_ || !pending_.empty(); });
+            if (pending_.empty()) // Stopping and everything is written
+                return;
+            frame = std::move(pending_.front());
+            pending_.erase(pending_.begin());
+        }
+
+        encode(*frame);
+        const uint32_t payload_size = static_cast<uint32_t>(payload_.size());
+        out_.write(reinterpret_cast<const char *>(&payload_size), sizeof(payload_size));
+        out_.write(reinterpret_cast<const char *>(payload_.data()), static_cast<std::streamsize>(payload_.size()));
+
+        std::lock_guard lock(mutex_);
+        if (!out_ && error_.empty())
+        {
+            error_ = "writing the trajectory failed";
+        }
+        ++written_;
+        free_.push_back(std::move(frame));
+    }
+}
+
+void TrajectoryRecorder::encode(TrajectoryFrame &frame)
+{
+    // Sort by ID so particles can be matched with the previous frame by merging (their memory order changes)
+    const size_t count = frame.particle_count();
+    if (!std::is_sorted(frame.id.begin(), frame.id.end()))
+    {
+        order_.resize(count);
+        std::iota(order_.begin(), order_.end(), 0u);
+        std::sort(order_.begin(), order_.end(), [&frame](uint32_t a, uint32_t b)
+                  { return frame.id[a] < frame.id[b]; });
+        id_scratch_.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            id_scratch_[i] = frame.id[order_[i]];
+        }
+        std::swap(frame.id, id_scratch_);
+        for (std::vector<float> *array : {&frame.position_x, &frame.position_y, &frame.velocity_x, &frame.velocity_y, &frame.stress})
+        {
+            float_scratch_.resize(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                float_scratch_[i] = (*array)[order_[i]];
+            }
+            std::swap(*array, float_scratch_);
+        }
+    }
+
+    const bool keyframe = frames_since_keyframe_ == 0;
+    frames_since_keyframe_ = (frames_since_keyframe_ + 1) % TRAJECTORY_KEYFRAME_INTERVAL;
+
+    payload_.clear();
+    put_varint(payload_, frame.step);
+    payload_.push_back(keyframe ? 1 : 0);
+    put_varint(payload_, frame.size.x);
+    put_varint(payload_, frame.size.y);
+    put_varint(payload_, count);
+
+    size_t previous_id = 0;
+    for (size_t id : frame.id)
+    {
+        put_varint(payload_, id - previous_id);
+        previous_id = id;
+    }
+
+    current_x_.resize(count);
+    current_y_.resize(count);
+    size_t match = 0; // Index into the previous frame, advanced while merging
+    for (size_t i = 0; i < count; ++i)
+    {
+        current_x_[i] = quantize_position(frame.position_x[i], frame.size.x);
+        current_y_[i] = quantize_position(frame.position_y[i], frame.size.y);
+        while (match < previous_id_.size() && previous_id_[match] < frame.id[i])
+        {
+            ++match;
+        }
+        const bool matched = !keyframe && match < previous_id_.size() && previous_id_[match] == frame.id[i];
+        put_signed(payload_, static_cast<int64_t>(current_x_[i]) - (matched ? previous_x_[match] : 0));
+        put_signed(payload_, static_cast<int64_t>(current_y_[i]) - (matched ? previous_y_[match] : 0));
+    }
+    previous_id_.assign(frame.id.begin(), frame.id.end());
+    std::swap(previous_x_, current_x_);
+    std::swap(previous_y_, current_y_);
+
+    put_scaled(payload_, frame.velocity_x);
+    put_scaled(payload_, frame.velocity_y);
+    put_scaled(payload_, frame.stress);
+
+    put_varint(payload_, frame.objects.size());
+    for (auto &&object : frame.objects)
+    {
+        put_raw(payload_, object.position.x);
+        put_raw(payload_, object.position.y);
+        put_raw(payload_, object.velocity.x);
+        put_raw(payload_, object.velocity.y);
+        put_raw(payload_, object.radius);
+        payload_.push_back(object.is_locked ? 1 : 0);
+    }
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &path) : file_(path), path_(path)
+{
+    constexpr size_t HEADER_SIZE = sizeof(TRAJECTORY_MAGIC) + 3 * sizeof(uint32_t);
+    uint32_t header[3];
+    if (file_.size() < HEADER_SIZE || std::memcmp(file_.data(), TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0)
+    {
+        throw std::runtime_error(path + ": not a trajectory file");
+    }
+    std::memcpy(header, file_.data() + sizeof(TRAJECTORY_MAGIC), sizeof(header));
+    if (header[0] != TRAJECTORY_VERSION)
+    {
+        throw std::runtime_error(path + ": unsupported trajectory version " + std::to_string(header[0]));
+    }
+    if (header[1] != TRAJECTORY_BYTE_ORDER)
+    {
+        throw std::runtime_error(path + ": trajectory was written on a machine with a different byte order");
+    }
+    interval_ = header[2];
+    position_ = HEADER_SIZE;
+}
+
+bool TrajectoryReader::next(TrajectoryFrame &frame)
+{
+    if (position_ == file_.size())
+        return false;
+    uint32_t payload_size;
+    if (file_.size() - position_ < sizeof(payload_size))
+    {
+        throw std::runtime_error(path_ + ": truncated trajectory");
+    }
+    std::memcpy(&payload_size, file_.data() + position_, sizeof(payload_size));
+    position_ += sizeof(payload_size);
+    if (file_.size() - position_ < payload_size)
+    {
+        throw std::runtime_error(path_ + ": truncated trajectory");
+    }
+    PayloadReader reader(file_.data() + position_, payload_size, path_);
+    position_ += payload_size;
+
+    frame.step = reader.varint();
+    const bool keyframe = reader.raw<uint8_t>() != 0;
+    const auto width = static_cast<unsigned int>(reader.varint());
+    frame.size = {width, static_cast<unsigned int>(reader.varint())};
+    const size_t count = static_cast<size_t>(reader.varint());
+    if (count > payload_size) // Every particle takes at least a byte
+        reader.fail();
+
+    frame.id.resize(count);
+    size_t id = 0;
+    for (size_t &particle_id : frame.id)
+    {
+        id += static_cast<size_t>(reader.varint());
+        particle_id = id;
+    }
+
+    frame.position_x.resize(count);
+    frame.position_y.resize(count);
+    current_x_.resize(count);
+    current_y_.resize(count);
+    size_t match = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        while (match < previous_id_.size() && previous_id_[match] < frame.id[i])
+        {
+            ++match;
+        }
+        const bool matched = !keyframe && match < previous_id_.size() && previous_id_[match] == frame.id[i];
+        current_x_[i] = static_cast<uint16_t>(reader.signed_varint() + (matched ? previous_x_[match] : 0));
+        current_y_[i] = static_cast<uint16_t>(reader.signed_varint() + (matched ? previous_y_[match] : 0));
+        frame.position_x[i] = dequantize_position(current_x_[i], frame.size.x);
+        frame.position_y[i] = dequantize_position(current_y_[i], frame.size.y);
+    }
+    previous_id_.assign(frame.id.begin(), frame.id.end());
+    std::swap(previous_x_, current_x_);
+    std::swap(previous_y_, current_y_);
+
+    reader.scaled(frame.velocity_x, count);
+    reader.scaled(frame.velocity_y, count);
+    reader.scaled(frame.stress, count);
+
+    const size_t object_count = static_cast<size_t>(reader.varint());
+    if (object_count > payload_size)
+        reader.fail();
+    frame.objects.resize(object_count);
+    for (auto &object : frame.objects)
+    {
+        object.position.x = reader.raw<float>();
+        object.position.y = reader.raw<float>();
+        object.velocity.x = reader.raw<float>();
+        object.velocity.y = reader.raw<float>();
+        object.radius = reader.raw<float>();
+        object.is_locked = reader.raw<uint8_t>() != 0;
+    }
+    return true;
+}
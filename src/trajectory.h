@@ -0,0 +1,202 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <SFML/Graphics.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+class FluidSandbox;
+
+/*
+ * Trajectory files (TrajectoryRecorder / TrajectoryReader).
+ *
+ * Header: TRAJECTORY_MAGIC (8 bytes), version (u32), byte order mark (u32), recording interval (u32).
+ * Then one record per recorded step: payload size (u32) followed by the payload. Integers in the payload are
+ * LEB128 varints, signed ones zigzag encoded first. A payload holds:
+ * - step, keyframe flag (u8), area width and height, particle count n,
+ * - particle IDs in ascending order as gaps to the previous ID,
+ * - positions quantized to 16 bits within the area, as differences to the same particle's quantized position in
+ *   the previous frame (to 0 for new particles and in keyframes),
+ * - velocity scale (f32) and velocities quantized to signed 16 bits of it,
+ * - stress scale (f32) and stress quantized to 16 bits of it,
+ * - object count, then per object position, velocity, radius (f32) and the locked flag (u8).
+ * Every TRAJECTORY_KEYFRAME_INTERVAL-th frame is a keyframe, so decoding can start from it.
+ */
+
+constexpr char TRAJECTORY_MAGIC[8] = {'F', 'L', 'U', 'I', 'D', 'T', 'R', 'J'};
+constexpr uint32_t TRAJECTORY_VERSION = 1;
+constexpr uint32_t TRAJECTORY_BYTE_ORDER = 0x01020304;
+constexpr size_t TRAJECTORY_KEYFRAME_INTERVAL = 64;
+constexpr size_t TRAJECTORY_MAX_PENDING_FRAMES = 8; // Frames waiting for the writer before new ones are dropped
+
+/**
+ * @brief State of an object in a trajectory frame.
+ */
+struct TrajectoryObject
+{
+    sf::Vector2f position;
+    sf::Vector2f velocity;
+    float radius;
+    bool is_locked;
+};
+
+/**
+ * @brief One recorded step. Particles are sorted by ID once a frame has been encoded or decoded.
+ */
+struct TrajectoryFrame
+{
+public:
+    uint64_t step = 0;
+    sf::Vector2u size;
+    std::vector<size_t> id;
+    std::vector<float> position_x;
+    std::vector<float> position_y;
+    std::vector<float> velocity_x;
+    std::vector<float> velocity_y;
+    std::vector<float> stress;
+    std::vector<TrajectoryObject> objects;
+
+    /**
+     * @brief Gets the number of particles.
+     * @return Number of particles.
+     */
+    size_t particle_count() const { return id.size(); }
+};
+
+/**
+ * @brief Streams every Nth step of a simulation to a compressed trajectory file.
+ *
+ * `record` only copies the particle arrays into a recycled frame, quantizing, delta encoding and writing happen on
+ * a background thread, so the step loop never waits for the disk. If the writer falls more than
+ * TRAJECTORY_MAX_PENDING_FRAMES frames behind, new frames are dropped (and counted) instead.
+ */
+class TrajectoryRecorder
+{
+public:
+    /**
+     * @brief Creates the trajectory file and starts the writer thread.
+     * @param path Path of the file.
+     * @param interval Record every that many steps (at least 1).
+     * @throws std::runtime_error If the file can not be created.
+     */
+    TrajectoryRecorder(const std::string &path, size_t interval);
+
+    /**
+     * @brief Writes the remaining frames and stops the writer thread (errors are ignored, call `finish` to see them).
+     */
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+    TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+    /**
+     * @brief Records the state of a sandbox if its step count is a multiple of the interval.
+     * @param sandbox The sandbox, called after a step.
+     */
+    void record(const FluidSandbox &sandbox);
+
+    /**
+     * @brief Writes the remaining frames, stops the writer thread and closes the file.
+     * @throws std::runtime_error If writing failed.
+     */
+    void finish();
+
+    /**
+     * @brief Gets the number of frames written so far.
+     * @return Number of frames.
+     */
+    size_t frames_written() const;
+
+    /**
+     * @brief Gets the number of frames dropped because the writer fell behind.
+     * @return Number of frames.
+     */
+    size_t frames_dropped() const;
+
+private:
+    size_t interval_;
+    std::ofstream out_;
+
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::vector<std::unique_ptr<TrajectoryFrame>> pending_; // Frames waiting for the writer, oldest first
+    std::vector<std::unique_ptr<TrajectoryFrame>> free_; // Recycled frames
+    bool stopping_ = false;
+    size_t written_ = 0;
+    size_t dropped_ = 0;
+    std::string error_;
+
+    // Encoder state, only used by the writer thread
+    size_t frames_since_keyframe_ = 0;
+    std::vector<size_t> previous_id_;
+    std::vector<uint16_t> previous_x_;
+    std::vector<uint16_t> previous_y_;
+    std::vector<uint16_t> current_x_;
+    std::vector<uint16_t> current_y_;
+    std::vector<uint32_t> order_;
+    std::vector<size_t> id_scratch_;
+    std::vector<float> float_scratch_;
+    std::vector<uint8_t> payload_;
+
+    /**
+     * @brief The loop of the writer thread.
+     */
+    void run();
+
+    /**
+     * @brief Encodes a frame into the payload buffer (sorts the frame by particle ID first).
+     * @param frame The frame.
+     */
+    void encode(TrajectoryFrame &frame);
+};
+
+/**
+ * @brief Decodes a trajectory file frame by frame (memory mapped).
+ */
+class TrajectoryReader
+{
+public:
+    /**
+     * @brief Opens a trajectory file.
+     * @param path Path of the file.
+     * @throws std::runtime_error If the file can not be read or is not a trajectory file.
+     */
+    explicit TrajectoryReader(const std::string &path);
+
+    /**
+     * @brief Gets the recording interval.
+     * @return Number of steps between frames.
+     */
+    size_t interval() const { return interval_; }
+
+    /**
+     * @brief Decodes the next frame.
+     * @param frame The frame to fill (reusing its memory).
+     * @return False at the end of the file.
+     * @throws std::runtime_error If the frame is broken.
+     */
+    bool next(TrajectoryFrame &frame);
+
+private:
+    MappedFile file_;
+    std::string path_;
+    size_t position_ = 0;
+    size_t interval_ = 1;
+    std::vector<size_t> previous_id_;
+    std::vector<uint16_t> previous_x_;
+    std::vector<uint16_t> previous_y_;
+    std::vector<uint16_t> current_x_;
+    std::vector<uint16_t> current_y_;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Lock-free handoff of values from one writer thread to one reader thread.
+ *
+ * The writer fills the back buffer and publishes it by swapping it with the middle buffer, the reader takes the
+ * middle buffer in exchange for its front buffer when a new one was published. Neither side ever waits for the
+ * other and the reader never sees a buffer that is still being written. Buffers are reused, so values that own
+ * memory (vectors) stop allocating once they have grown to their working size.
+ * @tparam T Type of the values.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    /**
+     * @brief Gets the buffer the writer fills next (writer thread only).
+     * @return Reference to the back buffer.
+     */
+    T &back() { return buffers_[back_]; }
+
+    /**
+     * @brief Publishes the back buffer and takes a free buffer as the new back buffer (writer thread only).
+     */
+    void publish() { back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX_MASK; }
+
+    /**
+     * @brief Gets the most recently published buffer (reader thread only).
+     * The buffer stays unchanged until the next call.
+     * @return Reference to the front buffer.
+     */
+    const T &acquire()
+    {
+        if (middle_.load(std::memory_order_relaxed) & FRESH)
+        {
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        return buffers_[front_];
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4; // Set in middle_ when it holds a buffer the reader has not taken yet
+
+    std::array<T, 3> buffers_;
+    uint8_t back_ = 0; // Only touched by the writer
+    alignas(64) std::atomic<uint8_t> middle_{1}; // Index of the middle buffer and the FRESH flag
+    alignas(64) uint8_t front_ = 2; // Only touched by the reader
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <limits>
+
+#include "uniform_grid.h"
+
+void UniformGrid::update(const std::vector<float> &positions_x, const std::vector<float> &positions_y, size_t cell_size, sf::Vector2u domain_size,
+                         bool periodic_x, bool periodic_y)
+{
+    positions_x_ = positions_x.data();
+    positions_y_ = positions_y.data();
+    cell_size_ = cell_size;
+    if (cell_size_ == 0) // Avoid zero division
+    {
+        columns_ = rows_ = 0;
+        periodic_x_ = periodic_y_ = false;
+        half_period_x_ = half_period_y_ = std::numeric_limits<float>::infinity();
+        point_indices_.clear();
+        return;
+    }
+    inv_cell_size_ = 1.0f / static_cast<float>(cell_size_);
+
+    // A bounded axis has a partial cell at its end, a periodic one is tiled exactly by (wider) cells
+    auto set_up_axis = [this](size_t length, bool periodic, size_t &count, bool &is_periodic, float &inv_cell, float &period, float &half_period)
+    {
+        const size_t periodic_count = length / (cell_size_ + 1);
+        is_periodic = periodic && periodic_count >= 3;
+        count = is_periodic ? periodic_count : length / cell_size_ + 1;
+        inv_cell = is_periodic ? static_cast<float>(count) / static_cast<float>(length) : inv_cell_size_;
+        period = is_periodic ? static_cast<float>(length) : 0.0f;
+        half_period = is_periodic ? 0.5f * period : std::numeric_limits<float>::infinity();
+    };
+    set_up_axis(domain_size.x, periodic_x, columns_, periodic_x_, inv_cell_width_, period_x_, half_period_x_);
+    set_up_axis(domain_size.y, periodic_y, rows_, periodic_y_, inv_cell_height_, period_y_, half_period_y_);
+
+    const size_t num_cells = columns_ * rows_;
+    const size_t num_points = positions_x.size();
+
+    // Counting sort, first pass counts the points in each cell
+    cell_start_.assign(num_cells + 1, 0);
+    point_cells_.resize(num_points);
+    point_indices_.resize(num_points);
+    point_slots_.resize(num_points);
+    for (size_t i = 0; i < num_points; ++i)
+    {
+        uint32_t cell = static_cast<uint32_t>(column_of(positions_x[i]) + row_of(positions_y[i]) * columns_);
+        point_cells_[i] = cell;
+        ++cell_start_[cell];
+    }
+
+    // Inclusive prefix sum turns the counts into the end offset of each cell
+    size_t new_max_cell_size = 0;
+    uint32_t running_sum = 0;
+    for (size_t cell = 0; cell < num_cells; ++cell)
+    {
+        new_max_cell_size = std::max(new_max_cell_size, static_cast<size_t>(cell_start_[cell]));
+        running_sum += cell_start_[cell];
+        cell_start_[cell] = running_sum;
+    }
+    cell_start_[num_cells] = running_sum;
+    max_cell_size_ = new_max_cell_size;
+
+    // Second pass scatters the points backwards, which keeps the sort stable and leaves start offsets behind
+    for (size_t i = num_points; i-- > 0;)
+    {
+        const uint32_t slot = --cell_start_[point_cells_[i]];
+        point_indices_[slot] = static_cast<uint32_t>(i);
+        point_slots_[i] = slot;
+    }
+}
+
+std::vector<uint32_t> UniformGrid::query(sf::Vector2f center, float radius, float slack) const
+{
+    std::vector<uint32_t> result;
+    if (columns_ == 0) // Grid is empty or has zero cell size
+    {
+        return result;
+    }
+
+    size_t cells_x = static_cast<size_t>(2.0f * (radius + slack) * inv_cell_size_) + 2;
+    result.reserve(cells_x * cells_x * max_cell_size_);
+
+    for_each_in_radius(center, radius, [&result](uint32_t point_index)
+                       { result.push_back(point_index); }, slack);
+    return result;
+}
@@ -0,0 +1,432 @@
+#ifndef UNIFORM_GRID_H
+#define UNIFORM_GRID_H
+
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A dense uniform grid for efficient neighbor searching inside a bounded domain.
+ * Points are bucketed by a counting sort into one flat index array, with a prefix-summed
+ * start offset per cell, so rebuilding the grid does not allocate once its buffers have grown.
+ * Positions outside of the domain are clamped into the border cells, unless an axis is periodic: then the cells
+ * exactly tile the period, positions are binned modulo it, searches wrap around to the cells on the opposite side
+ * and distances are measured to the nearest periodic image of a point.
+ * The grid reads positions from structure-of-arrays coordinate arrays (e.g., ParticleStore).
+ */
+class UniformGrid
+{
+public:
+    /**
+     * @brief Updates the grid with a new set of points, cell size and domain size.
+     * Clears the existing grid and re-inserts all points.
+     * The coordinate arrays are referenced (not copied) by later queries, so they must outlive them.
+     * @param positions_x X coordinates of the points.
+     * @param positions_y Y coordinates of the points.
+     * @param cell_size The desired size for each grid cell. Should typically be
+     * related to the interaction radius of the points.
+     * @param domain_size The size of the area covered by the grid.
+     * @param periodic_x Whether the domain repeats along x (its width is the period).
+     * @param periodic_y Whether the domain repeats along y (its height is the period).
+     * A periodic axis gets `size / (cell_size + 1)` cells, each at least a whole unit wider than the cell size, so a
+     * search radius truncated to the cell size still reaches only the adjacent cells. An axis too short for three
+     * such cells is not periodic (see `periodic_x`, `periodic_y`).
+     */
+    void update(const std::vector<float> &positions_x, const std::vector<float> &positions_y, size_t cell_size, sf::Vector2u domain_size,
+                bool periodic_x = false, bool periodic_y = false);
+
+    /**
+     * @brief Queries the grid for points within a given radius of a center point.
+     * @param center The center point of the query circle.
+     * @param radius The radius of the query circle.
+     * @param slack How far points may have moved since the grid was updated (widens the searched cells, the
+     * radius is checked against the current positions).
+     * @return A vector of indices of points found within the query radius.
+     */
+    std::vector<uint32_t> query(sf::Vector2f center, float radius, float slack = 0.0f) const;
+
+    /**
+     * @brief Calls a callback for every point within a given radius of a center point (without allocating).
+     * @tparam Callback Callable taking the index of the point (`uint32_t`).
+     * @param center The center point of the query circle.
+     * @param radius The radius of the query circle.
+     * @param callback The callback to call.
+     * @param slack How far points may have moved since the grid was updated.
+     */
+    template <typename Callback>
+    void for_each_in_radius(sf::Vector2f center, float radius, Callback &&callback, float slack = 0.0f) const;
+
+    /**
+     * @brief Calls a callback for every point within a given radius of a point that comes after it in `cell_order()`.
+     * Over all points this visits every pair within the radius exactly once, and rows of cells before the point's
+     * own row are not searched at all. Needs the points where they were when the grid was updated.
+     * On a periodic axis the radius must not be larger than a cell.
+     * @tparam Callback Callable taking the index of the other point (`uint32_t`).
+     * @param point_index Index of the point.
+     * @param radius The radius of the query circle.
+     * @param callback The callback to call.
+     */
+    template <typename Callback>
+    void for_each_later_in_radius(uint32_t point_index, float radius, Callback &&callback) const;
+
+    /**
+     * @brief Gets the indices of all points sorted by their cell (row-major cell order).
+     * @return Point indices in cell order.
+     */
+    const std::vector<uint32_t> &cell_order() const { return point_indices_; }
+
+    /**
+     * @brief Gets the number of cell columns (0 if the grid has no cells).
+     * @return Number of columns.
+     */
+    size_t columns() const { return columns_; }
+
+    /**
+     * @brief Gets the number of cell rows (0 if the grid has no cells).
+     * @return Number of rows.
+     */
+    size_t rows() const { return rows_; }
+
+    /**
+     * @brief Gets the size of one cell (cells along a periodic axis are wider).
+     * @return The cell size.
+     */
+    size_t cell_size() const { return cell_size_; }
+
+    /**
+     * @brief Checks whether the grid wraps around along x.
+     * @return True if x is periodic.
+     */
+    bool periodic_x() const { return periodic_x_; }
+
+    /**
+     * @brief Checks whether the grid wraps around along y.
+     * @return True if y is periodic.
+     */
+    bool periodic_y() const { return periodic_y_; }
+
+    /**
+     * @brief Turns the difference of two positions into the difference to the nearest periodic image (unchanged
+     * along axes that are not periodic).
+     * @param dx X component of the difference.
+     * @param dy Y component of the difference.
+     */
+    void wrap_difference(float &dx, float &dy) const
+    {
+        if (dx > half_period_x_)
+            dx -= period_x_;
+        else if (dx < -half_period_x_)
+            dx += period_x_;
+        if (dy > half_period_y_)
+            dy -= period_y_;
+        else if (dy < -half_period_y_)
+            dy += period_y_;
+    }
+
+    /**
+     * @brief Gets the cell a position falls into, wrapped or clamped like the points are binned.
+     * @param x X coordinate.
+     * @param y Y coordinate.
+     * @return Index of the cell (row-major), only valid if the grid has cells.
+     */
+    size_t cell_of(float x, float y) const { return column_of(x) + row_of(y) * columns_; }
+
+    /**
+     * @brief Gets the first entry of a cell in `cell_order()`.
+     * @param cell Index of the cell (`x + y * columns()`).
+     * @return Index into `cell_order()`.
+     */
+    uint32_t cell_begin(size_t cell) const { return cell_start_[cell]; }
+
+    /**
+     * @brief Gets the entry one past the last of a cell in `cell_order()`.
+     * @param cell Index of the cell (`x + y * columns()`).
+     * @return Index into `cell_order()`.
+     */
+    uint32_t cell_end(size_t cell) const { return cell_start_[cell + 1]; }
+
+private:
+    const float *positions_x_ = nullptr;
+    const float *positions_y_ = nullptr;
+    size_t cell_size_ = 1;
+    float inv_cell_size_ = 1.0f;
+    size_t columns_ = 0;
+    size_t rows_ = 0;
+    size_t max_cell_size_ = 0;
+
+    bool periodic_x_ = false;
+    bool periodic_y_ = false;
+    float inv_cell_width_ = 1.0f; // Inverse cell size along each axis (only differs from inv_cell_size_ on periodic axes)
+    float inv_cell_height_ = 1.0f;
+    float period_x_ = 0.0f;
+    float period_y_ = 0.0f;
+    float half_period_x_ = std::numeric_limits<float>::infinity(); // Infinite on axes that are not periodic, so nothing wraps
+    float half_period_y_ = std::numeric_limits<float>::infinity();
+
+    std::vector<uint32_t> cell_start_;    // Index of the first point of each cell in point_indices_ (one extra entry at the end)
+    std::vector<uint32_t> point_indices_; // Point indices sorted by cell
+    std::vector<uint32_t> point_cells_;   // Cell of each point
+    std::vector<uint32_t> point_slots_;   // Position of each point in point_indices_
+
+    /**
+     * @brief Computes the (clamped) column or row of a coordinate.
+     * @param coordinate The x or y coordinate.
+     * @param count Number of columns or rows.
+     * @return The column or row containing the coordinate.
+     */
+    size_t cell_coordinate(float coordinate, size_t count) const;
+
+    /**
+     * @brief Computes the column or row of a coordinate along a periodic axis, modulo the number of cells.
+     * @param coordinate The x or y coordinate.
+     * @param inv_cell_size Inverse size of the cells along the axis.
+     * @param count Number of columns or rows.
+     * @return The column or row containing the coordinate.
+     */
+    static size_t wrapped_cell_coordinate(float coordinate, float inv_cell_size, size_t count);
+
+    /**
+     * @brief Computes the column of a point's coordinate, wrapped or clamped depending on the axis.
+     */
+    size_t column_of(float x) const { return periodic_x_ ? wrapped_cell_coordinate(x, inv_cell_width_, columns_) : cell_coordinate(x, columns_); }
+
+    /**
+     * @brief Computes the row of a point's coordinate, wrapped or clamped depending on the axis.
+     */
+    size_t row_of(float y) const { return periodic_y_ ? wrapped_cell_coordinate(y, inv_cell_height_, rows_) : cell_coordinate(y, rows_); }
+
+    /**
+     * @brief Computes the range of columns or rows a search covers along a periodic axis.
+     * @return First cell (possibly negative or past the end, wrapped when used) and number of cells, at most all of them.
+     */
+    static std::pair<long long, size_t> wrapped_span(float min_coordinate, float max_coordinate, float inv_cell_size, size_t count);
+
+    /**
+     * @brief Wraps a column or row index into the grid.
+     */
+    static size_t wrap_index(long long index, size_t count)
+    {
+        const long long wrapped = index % static_cast<long long>(count);
+        return static_cast<size_t>(wrapped < 0 ? wrapped + static_cast<long long>(count) : wrapped);
+    }
+
+    /**
+     * @brief Implementation of `for_each_in_radius` for grids with a periodic axis.
+     */
+    template <typename Callback>
+    void for_each_in_radius_wrapped(sf::Vector2f center, float radius, Callback &&callback, float slack) const;
+
+    /**
+     * @brief Implementation of `for_each_later_in_radius` for grids with a periodic axis.
+     * Searches the own cell after the point and the cells at positive offsets (later rows, or later columns of the
+     * own row), which visits every pair once as long as opposite offsets never wrap to the same cell.
+     */
+    template <typename Callback>
+    void for_each_later_in_radius_wrapped(uint32_t point_index, float radius, Callback &&callback) const;
+};
+
+inline size_t UniformGrid::cell_coordinate(float coordinate, size_t count) const
+{
+    // Ensure non-negative cell coordinates before casting, positions outside the domain go to the border cells
+    if (!(coordinate > 0.0f)) // Also catches NaN
+    {
+        return 0;
+    }
+    size_t cell = static_cast<size_t>(coordinate * inv_cell_size_);
+    return cell < count ? cell : count - 1;
+}
+
+inline size_t UniformGrid::wrapped_cell_coordinate(float coordinate, float inv_cell_size, size_t count)
+{
+    const float cell = std::floor(coordinate * inv_cell_size);
+    if (!(std::abs(cell) < 1e15f)) // NaN and infinite positions go to the first cell
+    {
+        return 0;
+    }
+    return wrap_index(static_cast<long long>(cell), count);
+}
+
+inline std::pair<long long, size_t> UniformGrid::wrapped_span(float min_coordinate, float max_coordinate, float inv_cell_size, size_t count)
+{
+    const float first = std::floor(min_coordinate * inv_cell_size);
+    const float last = std::floor(max_coordinate * inv_cell_size);
+    if (!(std::abs(first) < 1e15f && std::abs(last) < 1e15f) || last - first + 1.0f >= static_cast<float>(count))
+    {
+        return {0, count}; // Covers the whole period (or the position is invalid)
+    }
+    return {static_cast<long long>(first), static_cast<size_t>(last - first) + 1};
+}
+
+template <typename Callback>
+inline void UniformGrid::for_each_in_radius(sf::Vector2f center, float radius, Callback &&callback, float slack) const
+{
+    if (columns_ == 0)
+    {
+        return;
+    }
+    if (periodic_x_ || periodic_y_)
+    {
+        for_each_in_radius_wrapped(center, radius, callback, slack);
+        return;
+    }
+
+    const float radius_sq = radius * radius; // Use squared distance for efficiency
+
+    const float reach = radius + slack; // Points are binned where they were when the grid was updated
+    size_t min_cell_x = cell_coordinate(center.x - reach, columns_);
+    size_t max_cell_x = cell_coordinate(center.x + reach, columns_);
+    size_t min_cell_y = cell_coordinate(center.y - reach, rows_);
+    size_t max_cell_y = cell_coordinate(center.y + reach, rows_);
+
+    for (size_t y = min_cell_y; y <= max_cell_y; ++y)
+    {
+        // Cells of one row are stored next to each other, so the whole row span is one contiguous range
+        const size_t row_offset = y * columns_;
+        const uint32_t begin = cell_start_[row_offset + min_cell_x];
+        const uint32_t end = cell_start_[row_offset + max_cell_x + 1];
+
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const uint32_t point_index = point_indices_[i];
+            float dx = positions_x_[point_index] - center.x;
+            float dy = positions_y_[point_index] - center.y;
+            if (dx * dx + dy * dy <= radius_sq)
+            {
+                callback(point_index);
+            }
+        }
+    }
+}
+
+template <typename Callback>
+inline void UniformGrid::for_each_later_in_radius(uint32_t point_index, float radius, Callback &&callback) const
+{
+    if (columns_ == 0)
+    {
+        return;
+    }
+    if (periodic_x_ || periodic_y_)
+    {
+        for_each_later_in_radius_wrapped(point_index, radius, callback);
+        return;
+    }
+
+    const float radius_sq = radius * radius;
+    const sf::Vector2f center = {positions_x_[point_index], positions_y_[point_index]};
+    const size_t min_cell_x = cell_coordinate(center.x - radius, columns_);
+    const size_t max_cell_x = cell_coordinate(center.x + radius, columns_);
+    const size_t own_cell_y = point_cells_[point_index] / columns_;
+    const size_t max_cell_y = cell_coordinate(center.y + radius, rows_);
+
+    // Earlier rows only hold earlier points, in the point's own row the span starts right after the point
+    for (size_t y = own_cell_y; y <= max_cell_y; ++y)
+    {
+        const size_t row_offset = y * columns_;
+        uint32_t begin = cell_start_[row_offset + min_cell_x];
+        const uint32_t end = cell_start_[row_offset + max_cell_x + 1];
+        if (y == own_cell_y)
+        {
+            begin = std::max(begin, point_slots_[point_index] + 1);
+        }
+
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const uint32_t other_index = point_indices_[i];
+            float dx = positions_x_[other_index] - center.x;
+            float dy = positions_y_[other_index] - center.y;
+            if (dx * dx + dy * dy <= radius_sq)
+            {
+                callback(other_index);
+            }
+        }
+    }
+}
+
+template <typename Callback>
+inline void UniformGrid::for_each_in_radius_wrapped(sf::Vector2f center, float radius, Callback &&callback, float slack) const
+{
+    const float radius_sq = radius * radius;
+    const float reach = radius + slack;
+
+    // Along a periodic axis the span may start before the first cell or end after the last, it is wrapped cell by cell
+    std::pair<long long, size_t> span_x = {static_cast<long long>(cell_coordinate(center.x - reach, columns_)), 0};
+    std::pair<long long, size_t> span_y = {static_cast<long long>(cell_coordinate(center.y - reach, rows_)), 0};
+    if (periodic_x_)
+        span_x = wrapped_span(center.x - reach, center.x + reach, inv_cell_width_, columns_);
+    else
+        span_x.second = cell_coordinate(center.x + reach, columns_) - static_cast<size_t>(span_x.first) + 1;
+    if (periodic_y_)
+        span_y = wrapped_span(center.y - reach, center.y + reach, inv_cell_height_, rows_);
+    else
+        span_y.second = cell_coordinate(center.y + reach, rows_) - static_cast<size_t>(span_y.first) + 1;
+
+    for (size_t j = 0; j < span_y.second; ++j)
+    {
+        const size_t row_offset = wrap_index(span_y.first + static_cast<long long>(j), rows_) * columns_;
+        for (size_t i = 0; i < span_x.second; ++i)
+        {
+            const size_t cell = row_offset + wrap_index(span_x.first + static_cast<long long>(i), columns_);
+            for (uint32_t n = cell_start_[cell]; n < cell_start_[cell + 1]; ++n)
+            {
+                const uint32_t point_index = point_indices_[n];
+                float dx = positions_x_[point_index] - center.x;
+                float dy = positions_y_[point_index] - center.y;
+                wrap_difference(dx, dy);
+                if (dx * dx + dy * dy <= radius_sq)
+                {
+                    callback(point_index);
+                }
+            }
+        }
+    }
+}
+
+template <typename Callback>
+inline void UniformGrid::for_each_later_in_radius_wrapped(uint32_t point_index, float radius, Callback &&callback) const
+{
+    const float radius_sq = radius * radius;
+    const sf::Vector2f center = {positions_x_[point_index], positions_y_[point_index]};
+    const long long own_x = static_cast<long long>(point_cells_[point_index] % columns_);
+    const long long own_y = static_cast<long long>(point_cells_[point_index] / columns_);
+    const long long reach_x = static_cast<long long>(std::ceil(radius * inv_cell_width_));
+    const long long reach_y = static_cast<long long>(std::ceil(radius * inv_cell_height_));
+
+    for (long long offset_y = 0; offset_y <= reach_y; ++offset_y)
+    {
+        const long long y = own_y + offset_y;
+        if (!periodic_y_ && y >= static_cast<long long>(rows_))
+            break;
+        const size_t row_offset = wrap_index(y, rows_) * columns_;
+        for (long long offset_x = offset_y == 0 ? 0 : -reach_x; offset_x <= reach_x; ++offset_x)
+        {
+            const long long x = own_x + offset_x;
+            if (!periodic_x_ && (x < 0 || x >= static_cast<long long>(columns_)))
+                continue;
+
+            const size_t cell = row_offset + wrap_index(x, columns_);
+            uint32_t begin = cell_start_[cell];
+            if (offset_x == 0 && offset_y == 0)
+            {
+                begin = point_slots_[point_index] + 1;
+            }
+            for (uint32_t n = begin; n < cell_start_[cell + 1]; ++n)
+            {
+                const uint32_t other_index = point_indices_[n];
+                float dx = positions_x_[other_index] - center.x;
+                float dy = positions_y_[other_index] - center.y;
+                wrap_difference(dx, dy);
+                if (dx * dx + dy * dy <= radius_sq)
+                {
+                    callback(other_index);
+                }
+            }
+        }
+    }
+}
+
+#endif
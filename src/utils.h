@@ -4,6 +4,7 @@
 #include <SFML/Graphics.hpp>
 
 #include <cmath>
+#include <cstdint>
 
 /**
  * @brief Contains utility functions for the simulation.
@@ -41,6 +42,29 @@ namespace utils
         return a.x * b.x + a.y * b.y;
     }
 
+    /**
+     * @brief Advances a SplitMix64 random generator (small state that is cheap to save and identical on every platform).
+     * @param state The generator state.
+     * @return The next random number.
+     */
+    inline uint64_t split_mix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * @brief Draws a random float in [0, 1) from a SplitMix64 generator.
+     * @param state The generator state.
+     * @return The random number.
+     */
+    inline float random_float(uint64_t &state)
+    {
+        return static_cast<float>(split_mix64(state) >> 40) * 0x1.0p-24f;
+    }
+
 }
 
 #endif
@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "field_renderer.h"
+#include "fluid_sandbox.h"
+#include "scene.h"
+
+constexpr char const USAGE[] =
+    "Usage: fluid_simulation_batch <scene file> [options]\n"
+    "Runs a scene without a window and reports the simulation speed.\n"
+    "\n"
+    "Options:\n"
+    "  --steps <count>        Number of steps to run (overrides the scene)\n"
+    "  --threads <count>      Number of simulation threads (default: all hardware threads)\n"
+    "  --skin <distance>      Reuses neighbor lists gathered that much beyond the interaction radius (default: 0)\n"
+    "  --adaptive <courant>   Chooses every substep so particles move at most that fraction of the interaction\n"
+    "                         radius (default: 0, fixed substeps)\n"
+    "  --max-substep <length> Longest substep of adaptive stepping (default: 1)\n"
+    "  --step-stats <file>    Writes how every step was split into substeps to a file\n"
+    "  --sleep <speed>        Puts grid cells to sleep once their particles stay slower than that (default: 0, never)\n"
+    "  --sleep-steps <count>  Calm steps before a cell falls asleep (default: 30)\n"
+    "  --set <name>=<value>   Overrides a simulation parameter (can be repeated)\n"
+    "  --load <file>          Starts from a snapshot instead of the scene's initial state (the snapshot's\n"
+    "                         size and parameters replace the scene's, --set still applies)\n"
+    "  --save <file>          Saves a snapshot after the last step\n"
+    "  --record <file>        Records a compressed trajectory\n"
+    "  --record-every <steps> Steps between recorded frames (default: 1)\n"
+    "  --dump <file>          Writes the particle and object state to a file\n"
+    "  --dump-every <steps>   Also dumps every that many steps (default: only after the last step)\n"
+    "  --frames <prefix>      Renders frames on the CPU and saves them as <prefix><step>.png\n"
+    "  --video <file>         Renders frames on the CPU and writes them to a file or pipe as raw RGBA video\n"
+    "  --render-every <steps> Steps between rendered frames (default: 1)\n"
+    "  --render-size <w>x<h>  Resolution of rendered frames (default: the scene size)\n"
+    "  --render-mode <mode>   surface (metaballs) or density (default: surface)\n";
+
+/**
+ * @brief Appends the state of the simulation to a dump file.
+ * Every dump starts with a `step <index> <particle count> <object count>` line, followed by one
+ * `p <id> <x> <y> <velocity x> <velocity y>` line per particle and one
+ * `o <x> <y> <velocity x> <velocity y> <radius> <mass> <locked>` line per object.
+ * @param out The dump file.
+ * @param sandbox The simulation.
+ * @param step Number of steps run so far.
+ */
+void dump_state(std::ostream &out, const FluidSandbox &sandbox, size_t step)
+{
+    const ParticleStore &particles = sandbox.particles();
+    out << "step " << step << ' ' << particles.size() << ' ' << sandbox.objects().size() << '\n';
+    for (size_t i = 0; i < particles.size(); ++i)
+    {
+        out << "p " << particles.id[i] << ' ' << particles.position_x[i] << ' ' << particles.position_y[i] << ' '
+            << particles.velocity_x[i] << ' ' << particles.velocity_y[i] << '\n';
+    }
+    for (auto &&object : sandbox.objects())
+    {
+        out << "o " << object.position.x << ' ' << object.position.y << ' ' << object.velocity.x << ' ' << object.velocity.y << ' '
+            << object.radius << ' ' << object.mass << ' ' << object.is_locked << '\n';
+    }
+}
+
+/**
+ * @brief Parses a resolution written as `<width>x<height>`.
+ * @throws std::runtime_error If the text is not a valid resolution.
+ */
+sf::Vector2u parse_size(const std::string &text)
+{
+    std::istringstream stream(text);
+    sf::Vector2u size;
+    char separator = 0;
+    if (!(stream >> size.x >> separator >> size.y) || separator != 'x' || !stream.eof() || size.x == 0 || size.y == 0)
+    {
+        throw std::runtime_error("invalid size '" + text + "'");
+    }
+    return size;
+}
+
+/**
+ * @brief Builds the file name of a rendered frame.
+ * @param prefix Prefix of the file names.
+ * @param step Number of steps run so far.
+ * @return The prefix followed by the step (zero padded to 6 digits) and `.png`.
+ */
+std::string frame_path(const std::string &prefix, uint64_t step)
+{
+    std::ostringstream path;
+    path << prefix << std::setw(6) << std::setfill('0') << step << ".png";
+    return path.str();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || std::string(argv[1]) == "--help")
+    {
+        std::cerr << USAGE;
+        return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    try
+    {
+        Scene scene = Scene::load(argv[1]);
+        size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        float neighbor_skin = 0.0f;
+        AdaptiveStepSettings adaptive_stepping;
+        std::string step_stats_path;
+        SleepSettings sleep_settings;
+        std::string dump_path;
+        size_t dump_every = 0;
+        std::string load_path;
+        std::string save_path;
+        std::string record_path;
+        size_t record_every = 1;
+        std::string frames_prefix;
+        std::string video_path;
+        size_t render_every = 1;
+        FieldRenderSettings render_settings;
+        std::vector<std::pair<std::string, float>> overrides;
+
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string option = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for option '" + option + "'");
+            }
+            const std::string value = argv[++i];
+            if (option == "--steps")
+            {
+                scene.steps = std::stoul(value);
+            }
+            else if (option == "--threads")
+            {
+                thread_count = std::max<size_t>(1, std::stoul(value));
+            }
+            else if (option == "--skin")
+            {
+                neighbor_skin = std::stof(value);
+            }
+            else if (option == "--adaptive")
+            {
+                adaptive_stepping.courant = std::stof(value);
+            }
+            else if (option == "--max-substep")
+            {
+                adaptive_stepping.max_substep = std::stof(value);
+            }
+            else if (option == "--step-stats")
+            {
+                step_stats_path = value;
+            }
+            else if (option == "--sleep")
+            {
+                sleep_settings.speed_threshold = std::stof(value);
+            }
+            else if (option == "--sleep-steps")
+            {
+                sleep_settings.steps = std::stoul(value);
+            }
+            else if (option == "--set")
+            {
+                const size_t separator = value.find('=');
+                if (separator == std::string::npos || !scene.set_param(value.substr(0, separator), std::stof(value.substr(separator + 1))))
+                {
+                    throw std::runtime_error("invalid parameter override '" + value + "'");
+                }
+                overrides.emplace_back(value.substr(0, separator), std::stof(value.substr(separator + 1)));
+            }
+            else if (option == "--dump")
+            {
+                dump_path = value;
+            }
+            else if (option == "--dump-every")
+            {
+                dump_every = std::stoul(value);
+            }
+            else if (option == "--load")
+            {
+                load_path = value;
+            }
+            else if (option == "--save")
+            {
+                save_path = value;
+            }
+            else if (option == "--record")
+            {
+                record_path = value;
+            }
+            else if (option == "--record-every")
+            {
+                record_every = std::stoul(value);
+            }
+            else if (option == "--frames")
+            {
+                frames_prefix = value;
+            }
+            else if (option == "--video")
+            {
+                video_path = value;
+            }
+            else if (option == "--render-every")
+            {
+                render_every = std::max<size_t>(1, std::stoul(value));
+            }
+            else if (option == "--render-size")
+            {
+                render_settings.size = parse_size(value);
+            }
+            else if (option == "--render-mode")
+            {
+                if (value == "surface")
+                    render_settings.mode = FieldRenderMode::Surface;
+                else if (value == "density")
+                    render_settings.mode = FieldRenderMode::Density;
+                else
+                    throw std::runtime_error("unknown render mode '" + value + "'");
+            }
+            else
+            {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+
+        std::ofstream dump;
+        if (!dump_path.empty())
+        {
+            dump.open(dump_path);
+            if (!dump)
+            {
+                throw std::runtime_error("cannot open dump file '" + dump_path + "'");
+            }
+            dump << std::setprecision(std::numeric_limits<float>::max_digits10); // Exact floats for comparing runs
+        }
+
+        std::ofstream step_stats_file;
+        if (!step_stats_path.empty())
+        {
+            step_stats_file.open(step_stats_path);
+            if (!step_stats_file)
+            {
+                throw std::runtime_error("cannot open step statistics file '" + step_stats_path + "'");
+            }
+            step_stats_file << "step substeps min_substep max_substep max_speed max_acceleration";
+            for (const char *name : STEP_LIMIT_NAMES)
+            {
+                step_stats_file << ' ' << name;
+            }
+            step_stats_file << '\n';
+        }
+
+        FluidSandbox sandbox(scene.size);
+        sandbox.set_thread_count(thread_count);
+        sandbox.set_neighbor_skin(neighbor_skin);
+        sandbox.set_adaptive_stepping(adaptive_stepping);
+        sandbox.set_sleeping(sleep_settings);
+        scene.apply(sandbox);
+        if (!load_path.empty())
+        {
+            sandbox.load_snapshot(load_path);
+            Scene loaded; // Applies the overrides on top of the loaded parameters
+            loaded.params = sandbox.params();
+            for (auto &&[name, value] : overrides)
+            {
+                loaded.set_param(name, value);
+            }
+            sandbox.params() = loaded.params;
+        }
+
+        std::unique_ptr<TrajectoryRecorder> recorder;
+        if (!record_path.empty())
+        {
+            recorder = std::make_unique<TrajectoryRecorder>(record_path, record_every);
+            sandbox.set_recorder(recorder.get());
+        }
+
+        std::unique_ptr<FieldRenderer> renderer;
+        RenderState render_state;
+        std::ofstream video;
+        if (!frames_prefix.empty() || !video_path.empty())
+        {
+            if (render_settings.size.x == 0)
+            {
+                render_settings.size = sandbox.size();
+            }
+            render_settings.thread_count = thread_count;
+            renderer = std::make_unique<FieldRenderer>(sandbox.params(), render_settings);
+            if (!video_path.empty())
+            {
+                video.open(video_path, std::ios::binary);
+                if (!video)
+                {
+                    throw std::runtime_error("cannot open video file '" + video_path + "'");
+                }
+            }
+        }
+        size_t frames_rendered = 0;
+        std::chrono::steady_clock::duration render_time{};
+        auto render_frame = [&]()
+        {
+            const auto start = std::chrono::steady_clock::now();
+            sandbox.capture(render_state);
+            renderer->render(render_state);
+            if (!frames_prefix.empty())
+            {
+                renderer->save_png(frame_path(frames_prefix, sandbox.step_count()));
+            }
+            if (video.is_open())
+            {
+                renderer->write_raw(video);
+            }
+            ++frames_rendered;
+            render_time += std::chrono::steady_clock::now() - start;
+        };
+
+        // Dumping and rendering are excluded from the measured time
+        std::chrono::steady_clock::duration simulation_time{};
+        size_t total_substeps = 0;
+        float min_substep = std::numeric_limits<float>::infinity();
+        float max_substep = 0.0f;
+        std::array<size_t, STEP_LIMIT_COUNT> limited_by{};
+        for (size_t step = 0; step < scene.steps; ++step)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            sandbox.update(scene.dt);
+            simulation_time += std::chrono::steady_clock::now() - start;
+
+            const StepStats &stats = sandbox.step_stats();
+            total_substeps += stats.substeps;
+            min_substep = std::min(min_substep, stats.min_substep);
+            max_substep = std::max(max_substep, stats.max_substep);
+            for (size_t limit = 0; limit < STEP_LIMIT_COUNT; ++limit)
+            {
+                limited_by[limit] += stats.limited_by[limit];
+            }
+            if (step_stats_file.is_open())
+            {
+                step_stats_file << step + 1 << ' ' << stats.substeps << ' ' << stats.min_substep << ' ' << stats.max_substep << ' '
+                                << stats.max_speed << ' ' << stats.max_acceleration;
+                for (size_t count : stats.limited_by)
+                {
+                    step_stats_file << ' ' << count;
+                }
+                step_stats_file << '\n';
+            }
+
+            if (dump.is_open() && dump_every != 0 && (step + 1) % dump_every == 0 && step + 1 != scene.steps)
+            {
+                dump_state(dump, sandbox, step + 1);
+            }
+            if (renderer && (step + 1) % render_every == 0)
+            {
+                render_frame();
+            }
+        }
+        if (dump.is_open())
+        {
+            dump_state(dump, sandbox, scene.steps);
+        }
+        if (!save_path.empty())
+        {
+            sandbox.save_snapshot(save_path);
+        }
+        if (recorder)
+        {
+            sandbox.set_recorder(nullptr);
+            recorder->finish();
+        }
+
+        const double seconds = std::chrono::duration<double>(simulation_time).count();
+        std::cout << "steps: " << scene.steps << '\n'
+                  << "threads: " << sandbox.thread_count() << '\n'
+                  << "particles: " << sandbox.particle_count() << '\n'
+                  << "objects: " << sandbox.object_count() << '\n'
+                  << "seconds: " << seconds << '\n'
+                  << "steps_per_second: " << (seconds > 0.0 ? static_cast<double>(scene.steps) / seconds : 0.0) << '\n'
+                  << "neighbor_builds: " << sandbox.neighbor_builds() << '\n'
+                  << "substeps: " << total_substeps << '\n'
+                  << "substep_min: " << (total_substeps > 0 ? min_substep : 0.0f) << '\n'
+                  << "substep_max: " << max_substep << '\n';
+        for (size_t limit = 0; limit < STEP_LIMIT_COUNT; ++limit)
+        {
+            if (limited_by[limit] != 0)
+            {
+                std::cout << "substeps_limited_by_" << STEP_LIMIT_NAMES[limit] << ": " << limited_by[limit] << '\n';
+            }
+        }
+        if (sleep_settings.speed_threshold > 0.0f)
+        {
+            std::cout << "sleeping_particles: " << sandbox.sleeping_particle_count() << '\n';
+        }
+        if (recorder)
+        {
+            std::cout << "frames_recorded: " << recorder->frames_written() << '\n'
+                      << "frames_dropped: " << recorder->frames_dropped() << '\n';
+        }
+        if (renderer)
+        {
+            std::cout << "frames_rendered: " << frames_rendered << '\n'
+                      << "render_size: " << renderer->settings().size.x << 'x' << renderer->settings().size.y << '\n'
+                      << "render_seconds: " << std::chrono::duration<double>(render_time).count() << '\n';
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "error: " << error.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "fluid_sandbox.h"
+#include "scene.h"
+#include "simd_kernels.h"
+
+constexpr char const USAGE[] =
+    "Usage: fluid_simulation_benchmark [options]\n"
+    "Times every phase of the simulation step on fixed scenes and prints the results as JSON.\n"
+    "\n"
+    "Options:\n"
+    "  --scenes <list>      Comma separated scenes (default: dam_break,still_pool,viscous_blob,many_objects,drain)\n"
+    "  --sizes <list>       Comma separated particle counts (default: 1000,10000,100000)\n"
+    "  --steps <count>      Measured steps per run (default: depends on the particle count)\n"
+    "  --warmup <count>     Steps run before measuring (default: 30)\n"
+    "  --threads <count>    Number of simulation threads (default: 1)\n"
+    "  --skin <distance>    Skin of the reused neighbor lists (default: 0, rebuilt every step)\n"
+    "  --adaptive <courant> Courant number of adaptive time stepping (default: 0, fixed substeps)\n"
+    "  --sleep <speed>      Speed threshold of sleeping fluid (default: 0, never sleeps), the fluid needs a warmup\n"
+    "                       longer than 30 steps to settle and fall asleep\n"
+    "  --output <file>      Writes the JSON to a file instead of the standard output\n";
+
+constexpr float BENCHMARK_PARTICLE_SPACING = 12.0f;
+constexpr float BENCHMARK_DT = 0.016f;
+constexpr unsigned int BENCHMARK_SEED = 1;
+constexpr size_t BENCHMARK_STEP_BUDGET = 200000; // Default measured steps times particles per run
+constexpr size_t BENCHMARK_MIN_STEPS = 5;
+constexpr float STILL_POOL_ROWS = 20.0f; // Depth of the still pool, deeper pools keep churning at the default step size
+
+const std::vector<std::string> BENCHMARK_SCENES = {"dam_break", "still_pool", "viscous_blob", "many_objects", "drain"};
+
+// Every global heap allocation of the process, counted so the results show whether stepping allocates
+std::atomic<size_t> heap_allocations{0};
+
+void *operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size != 0 ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+/**
+ * @brief Timings of one scene at one particle count.
+ */
+struct BenchmarkResult
+{
+    std::string scene;
+    size_t particles;
+    size_t objects;
+    size_t steps;
+    size_t neighbor_builds; // During the measured steps
+    size_t substeps; // During the measured steps (phase times are those of the last substep of every step)
+    size_t allocations; // Global heap allocations during the measured steps
+    size_t sleeping_particles; // During the last measured step
+    std::array<std::vector<double>, SIMULATION_PHASE_COUNT> phase_times; // Seconds per measured step
+    std::vector<double> step_times;
+};
+
+/**
+ * @brief Computes the size of a rectangular block of roughly `count` particles with a given width to height ratio.
+ * @return The block size, slightly smaller than a whole number of spacings so the lattice is not rounded up.
+ */
+sf::Vector2f block_size(size_t count, float aspect_ratio)
+{
+    const float columns = std::max(1.0f, std::round(std::sqrt(static_cast<float>(count) * aspect_ratio)));
+    const float rows = std::max(1.0f, std::round(static_cast<float>(count) / columns));
+    return {(columns - 0.5f) * BENCHMARK_PARTICLE_SPACING, (rows - 0.5f) * BENCHMARK_PARTICLE_SPACING};
+}
+
+/**
+ * @brief Builds one of the fixed benchmark scenes, scaled so it holds about `count` particles.
+ * @param name Name of the scene.
+ * @param count Number of particles.
+ * @return The scene.
+ * @throws std::runtime_error If there is no scene with that name.
+ */
+Scene make_scene(const std::string &name, size_t count)
+{
+    Scene scene;
+    scene.seed = BENCHMARK_SEED;
+    scene.dt = BENCHMARK_DT;
+
+    if (name == "dam_break") // Tall column collapsing to the right
+    {
+        const sf::Vector2f block = block_size(count, 0.5f);
+        scene.size = {static_cast<unsigned int>(block.x * 4.0f), static_cast<unsigned int>(block.y * 1.25f)};
+        scene.blocks.push_back({{1.0f, static_cast<float>(scene.size.y) - block.y - 1.0f}, block, BENCHMARK_PARTICLE_SPACING, {0.0f, 0.0f}});
+    }
+    else if (name == "still_pool") // Shallow pool of a fixed depth filling the bottom of the area, so it settles
+    {
+        const sf::Vector2f block = block_size(count, static_cast<float>(count) / (STILL_POOL_ROWS * STILL_POOL_ROWS));
+        scene.size = {static_cast<unsigned int>(block.x + 2.0f), static_cast<unsigned int>(block.y * 1.5f)};
+        scene.blocks.push_back({{1.0f, static_cast<float>(scene.size.y) - block.y - 1.0f}, block, BENCHMARK_PARTICLE_SPACING, {0.0f, 0.0f}});
+    }
+    else if (name == "viscous_blob") // Square of viscoelastic fluid falling to the floor
+    {
+        const sf::Vector2f block = block_size(count, 1.0f);
+        scene.size = {static_cast<unsigned int>(block.x * 2.0f), static_cast<unsigned int>(block.y * 2.0f)};
+        scene.params.linear_viscosity = 0.3f;
+        scene.params.quadratic_viscosity = 0.1f;
+        scene.params.spring_stiffness = 0.3f;
+        scene.blocks.push_back({block * 0.5f, block, BENCHMARK_PARTICLE_SPACING, {0.0f, 0.0f}});
+    }
+    else if (name == "many_objects") // Pool with a grid of objects falling into it
+    {
+        const sf::Vector2f block = block_size(count, 4.0f);
+        scene.size = {static_cast<unsigned int>(block.x + 2.0f), static_cast<unsigned int>(block.y * 2.5f)};
+        scene.blocks.push_back({{1.0f, static_cast<float>(scene.size.y) - block.y - 1.0f}, block, BENCHMARK_PARTICLE_SPACING, {0.0f, 0.0f}});
+
+        const float radius = 30.0f;
+        const float object_spacing = radius * 3.0f;
+        const size_t object_count = std::max<size_t>(4, count / 250);
+        const size_t columns = std::max<size_t>(1, static_cast<size_t>(block.x / object_spacing));
+        for (size_t i = 0; i < object_count; ++i)
+        {
+            const float x = object_spacing * (0.5f + static_cast<float>(i % columns));
+            const float y = object_spacing * (0.5f + static_cast<float>(i / columns));
+            scene.objects.push_back({{x, y}, radius, scene.params.object_mass, false});
+        }
+    }
+    else if (name == "drain") // Pool draining through a hole in the floor while rain falls into it
+    {
+        const sf::Vector2f block = block_size(count, 4.0f);
+        scene.size = {static_cast<unsigned int>(block.x + 2.0f), static_cast<unsigned int>(block.y * 1.5f)};
+        scene.blocks.push_back({{1.0f, static_cast<float>(scene.size.y) - block.y - 1.0f}, block, BENCHMARK_PARTICLE_SPACING, {0.0f, 0.0f}});
+
+        const float hole_width = BENCHMARK_PARTICLE_SPACING * 4.0f;
+        scene.sinks.push_back({{RegionShape::Rectangle, {(block.x - hole_width) * 0.5f, static_cast<float>(scene.size.y) - BENCHMARK_PARTICLE_SPACING},
+                                {hole_width, BENCHMARK_PARTICLE_SPACING}}});
+        ParticleEmitter &rain = scene.emitters.emplace_back();
+        rain.region = {RegionShape::Rectangle, {1.0f, 1.0f}, {block.x, BENCHMARK_PARTICLE_SPACING}};
+        rain.rate = static_cast<float>(count) * 0.0005f / (BENCHMARK_DT * scene.params.simulation_speed); // A 2000th of the particles per step
+    }
+    else
+    {
+        throw std::runtime_error("unknown scene '" + name + "'");
+    }
+    return scene;
+}
+
+/**
+ * @brief Runs one scene and records how long each phase of every measured step took.
+ */
+BenchmarkResult run_benchmark(const std::string &name, size_t count, size_t steps, size_t warmup, size_t thread_count, float neighbor_skin,
+                              float courant, float sleep_threshold)
+{
+    const Scene scene = make_scene(name, count);
+    FluidSandbox sandbox(scene.size);
+    sandbox.set_thread_count(thread_count);
+    sandbox.set_neighbor_skin(neighbor_skin);
+    sandbox.set_adaptive_stepping({courant});
+    sandbox.set_sleeping({sleep_threshold});
+    scene.apply(sandbox);
+
+    for (size_t step = 0; step < warmup; ++step)
+    {
+        sandbox.update(scene.dt);
+    }
+
+    BenchmarkResult result{name, sandbox.particle_count(), sandbox.object_count(), steps, 0, 0, 0, 0, {}, {}};
+    for (auto &&times : result.phase_times)
+    {
+        times.reserve(steps);
+    }
+    result.step_times.reserve(steps);
+    const size_t warmup_builds = sandbox.neighbor_builds();
+    const size_t warmup_allocations = heap_allocations.load(std::memory_order_relaxed);
+    for (size_t step = 0; step < steps; ++step)
+    {
+        sandbox.update(scene.dt);
+        result.substeps += sandbox.step_stats().substeps;
+        double step_time = 0.0;
+        for (size_t p = 0; p < SIMULATION_PHASE_COUNT; ++p)
+        {
+            const double time = sandbox.phase_time(static_cast<SimulationPhase>(p));
+            result.phase_times[p].push_back(time);
+            step_time += time;
+        }
+        result.step_times.push_back(step_time);
+    }
+    result.allocations = heap_allocations.load(std::memory_order_relaxed) - warmup_allocations;
+    result.neighbor_builds = sandbox.neighbor_builds() - warmup_builds;
+    result.sleeping_particles = sandbox.sleeping_particle_count();
+    return result;
+}
+
+/**
+ * @brief Writes mean, minimum and maximum of a series of durations as a JSON object (in milliseconds).
+ */
+void write_stats(std::ostream &out, const std::vector<double> &times)
+{
+    double sum = 0.0;
+    double min = times.empty() ? 0.0 : times.front();
+    double max = min;
+    for (double time : times)
+    {
+        sum += time;
+        min = std::min(min, time);
+        max = std::max(max, time);
+    }
+    const double mean = times.empty() ? 0.0 : sum / static_cast<double>(times.size());
+    out << "{\"mean_ms\": " << mean * 1e3 << ", \"min_ms\": " << min * 1e3 << ", \"max_ms\": " << max * 1e3 << "}";
+}
+
+/**
+ * @brief Writes all results as one JSON document.
+ */
+void write_json(std::ostream &out, const std::vector<BenchmarkResult> &results, size_t warmup, size_t thread_count, float neighbor_skin, float courant,
+                float sleep_threshold)
+{
+    out << "{\n"
+        << "  \"instruction_set\": \"" << simd_kernels::instruction_set_name(simd_kernels::active_instruction_set()) << "\",\n"
+        << "  \"threads\": " << thread_count << ",\n"
+        << "  \"warmup_steps\": " << warmup << ",\n"
+        << "  \"neighbor_skin\": " << neighbor_skin << ",\n"
+        << "  \"adaptive_courant\": " << courant << ",\n"
+        << "  \"sleep_threshold\": " << sleep_threshold << ",\n"
+        << "  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r)
+    {
+        const BenchmarkResult &result = results[r];
+        out << (r == 0 ? "\n" : ",\n")
+            << "    {\n"
+            << "      \"scene\": \"" << result.scene << "\",\n"
+            << "      \"particles\": " << result.particles << ",\n"
+            << "      \"objects\": " << result.objects << ",\n"
+            << "      \"steps\": " << result.steps << ",\n"
+            << "      \"neighbor_builds\": " << result.neighbor_builds << ",\n"
+            << "      \"substeps\": " << result.substeps << ",\n"
+            << "      \"allocations\": " << result.allocations << ",\n"
+            << "      \"sleeping_particles\": " << result.sleeping_particles << ",\n"
+            << "      \"step\": ";
+        write_stats(out, result.step_times);
+        out << ",\n      \"phases\": {";
+        for (size_t p = 0; p < SIMULATION_PHASE_COUNT; ++p)
+        {
+            out << (p == 0 ? "\n" : ",\n") << "        \"" << SIMULATION_PHASE_NAMES[p] << "\": ";
+            write_stats(out, result.phase_times[p]);
+        }
+        out << "\n      }\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+/**
+ * @brief Splits a comma separated list.
+ */
+std::vector<std::string> split_list(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::vector<std::string> scenes = BENCHMARK_SCENES;
+        std::vector<size_t> sizes = {1000, 10000, 100000};
+        size_t steps = 0; // 0 = depends on the particle count
+        size_t warmup = 30; // Past the first particle reorder, which sizes its buffers
+        size_t thread_count = 1;
+        float neighbor_skin = 0.0f;
+        float courant = 0.0f;
+        float sleep_threshold = 0.0f;
+        std::string output_path;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string option = argv[i];
+            if (option == "--help")
+            {
+                std::cerr << USAGE;
+                return EXIT_SUCCESS;
+            }
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for option '" + option + "'");
+            }
+            const std::string value = argv[++i];
+            if (option == "--scenes")
+            {
+                scenes = split_list(value);
+            }
+            else if (option == "--sizes")
+            {
+                sizes.clear();
+                for (auto &&size : split_list(value))
+                {
+                    sizes.push_back(std::stoul(size));
+                }
+            }
+            else if (option == "--steps")
+            {
+                steps = std::stoul(value);
+            }
+            else if (option == "--warmup")
+            {
+                warmup = std::stoul(value);
+            }
+            else if (option == "--threads")
+            {
+                thread_count = std::max<size_t>(1, std::stoul(value));
+            }
+            else if (option == "--skin")
+            {
+                neighbor_skin = std::stof(value);
+            }
+            else if (option == "--adaptive")
+            {
+                courant = std::stof(value);
+            }
+            else if (option == "--sleep")
+            {
+                sleep_threshold = std::stof(value);
+            }
+            else if (option == "--output")
+            {
+                output_path = value;
+            }
+            else
+            {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+
+        std::vector<BenchmarkResult> results;
+        for (auto &&scene : scenes)
+        {
+            for (size_t size : sizes)
+            {
+                const size_t run_steps = steps != 0 ? steps : std::max(BENCHMARK_MIN_STEPS, BENCHMARK_STEP_BUDGET / std::max<size_t>(1, size));
+                std::cerr << "running " << scene << " with " << size << " particles for " << run_steps << " steps\n";
+                results.push_back(run_benchmark(scene, size, run_steps, warmup, thread_count, neighbor_skin, courant, sleep_threshold));
+            }
+        }
+
+        if (output_path.empty())
+        {
+            write_json(std::cout, results, warmup, thread_count, neighbor_skin, courant, sleep_threshold);
+        }
+        else
+        {
+            std::ofstream output(output_path);
+            if (!output)
+            {
+                throw std::runtime_error("cannot open output file '" + output_path + "'");
+            }
+            write_json(output, results, warmup, thread_count, neighbor_skin, courant, sleep_threshold);
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "error: " << error.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
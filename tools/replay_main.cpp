@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "fluid_sandbox.h"
+#include "input_log.h"
+#include "simd_kernels.h"
+
+constexpr char const USAGE[] =
+    "Usage: fluid_simulation_replay <input log> [options]\n"
+    "Re-runs a session recorded with fluid_simulation_sandbox --record-input as fast as possible, reports the\n"
+    "simulation speed and checks that it ends in the same state.\n"
+    "\n"
+    "Options:\n"
+    "  --threads <count>      Number of simulation threads (default: as in the recorded session). Any count of\n"
+    "                         two or more ends in the same state, but one thread and two or more do not\n";
+
+/**
+ * @brief Scratch files the snapshots saved during the session are saved to again, removed when the replay ends.
+ */
+class ScratchSnapshots
+{
+public:
+    ~ScratchSnapshots()
+    {
+        for (auto &&[logged_path, scratch_path] : paths_)
+        {
+            std::error_code error;
+            std::filesystem::remove(scratch_path, error);
+        }
+    }
+
+    /**
+     * @brief Redirects a snapshot input: saves go to a scratch file of their path, loads of a path saved earlier in
+     * the replay read that scratch file, other loads read the logged path.
+     * @param event The logged input.
+     * @return The input to apply.
+     */
+    InputEvent redirect(const InputEvent &event)
+    {
+        if (event.type != InputEventType::SaveSnapshot && event.type != InputEventType::LoadSnapshot)
+            return event;
+
+        InputEvent redirected = event;
+        auto scratch = paths_.find(event.path);
+        if (event.type == InputEventType::SaveSnapshot && scratch == paths_.end())
+        {
+            const std::string name = "fluid_simulation_replay_" + std::to_string(prefix_) + "_" + std::to_string(paths_.size()) + ".snapshot";
+            scratch = paths_.emplace(event.path, (std::filesystem::temp_directory_path() / name).string()).first;
+        }
+        if (scratch != paths_.end())
+        {
+            redirected.path = scratch->second;
+        }
+        return redirected;
+    }
+
+private:
+    std::map<std::string, std::string> paths_; // Logged path to scratch path
+    unsigned int prefix_ = std::random_device{}(); // Keeps replays running at the same time apart
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || std::string(argv[1]) == "--help")
+    {
+        std::cerr << USAGE;
+        return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    try
+    {
+        const InputLog log = InputLog::load(argv[1]);
+
+        size_t thread_count = log.thread_count;
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string option = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for option '" + option + "'");
+            }
+            const std::string value = argv[++i];
+            if (option == "--threads")
+            {
+                thread_count = std::stoul(value);
+            }
+            else
+            {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+
+        FluidSandbox sandbox(log.size);
+        sandbox.set_thread_count(thread_count);
+        log.start(sandbox);
+
+        // Inputs are applied between steps exactly where the session applied them
+        uint64_t steps = 0;
+        const auto start = std::chrono::steady_clock::now();
+        auto run_until = [&](uint64_t step)
+        {
+            while (sandbox.step_count() < step)
+            {
+                sandbox.step(log.step_size);
+                ++steps;
+            }
+        };
+        ScratchSnapshots scratch_snapshots;
+        for (auto &&[step, event] : log.events)
+        {
+            run_until(step);
+            scratch_snapshots.redirect(event).apply(sandbox);
+        }
+        if (log.finished)
+        {
+            run_until(log.end_step);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const uint64_t state_hash = sandbox.state_hash();
+        std::cout << "steps: " << steps << '\n'
+                  << "events: " << log.events.size() << '\n'
+                  << "threads: " << sandbox.thread_count() << '\n'
+                  << "instruction_set: " << simd_kernels::instruction_set_name(simd_kernels::active_instruction_set()) << '\n'
+                  << "particles: " << sandbox.particle_count() << '\n'
+                  << "objects: " << sandbox.object_count() << '\n'
+                  << "seconds: " << seconds << '\n'
+                  << "steps_per_second: " << (seconds > 0.0 ? static_cast<double>(steps) / seconds : 0.0) << '\n'
+                  << "state_hash: " << std::hex << state_hash << std::dec << '\n';
+        if (!log.finished)
+        {
+            std::cout << "match: unknown (the session did not end normally)\n";
+            return EXIT_SUCCESS;
+        }
+        const bool match = sandbox.step_count() == log.end_step && state_hash == log.state_hash;
+        std::cout << "match: " << (match ? "yes" : "no") << '\n';
+        return match ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "error: " << error.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
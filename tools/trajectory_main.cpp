@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "trajectory.h"
+
+constexpr char const USAGE[] =
+    "Usage: fluid_simulation_trajectory <trajectory file> [options]\n"
+    "Decodes a trajectory recorded with fluid_simulation_batch --record.\n"
+    "\n"
+    "Options:\n"
+    "  --dump <file>          Writes every frame in the batch dump format (objects have no mass, it is printed as 0)\n";
+
+/**
+ * @brief Appends a decoded frame to a dump file, in the format of fluid_simulation_batch --dump.
+ * @param out The dump file.
+ * @param frame The frame.
+ */
+void dump_frame(std::ostream &out, const TrajectoryFrame &frame)
+{
+    out << "step " << frame.step << ' ' << frame.particle_count() << ' ' << frame.objects.size() << '\n';
+    for (size_t i = 0; i < frame.particle_count(); ++i)
+    {
+        out << "p " << frame.id[i] << ' ' << frame.position_x[i] << ' ' << frame.position_y[i] << ' '
+            << frame.velocity_x[i] << ' ' << frame.velocity_y[i] << '\n';
+    }
+    for (auto &&object : frame.objects)
+    {
+        out << "o " << object.position.x << ' ' << object.position.y << ' ' << object.velocity.x << ' ' << object.velocity.y << ' '
+            << object.radius << ' ' << 0 << ' ' << object.is_locked << '\n';
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || std::string(argv[1]) == "--help")
+    {
+        std::cerr << USAGE;
+        return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    try
+    {
+        TrajectoryReader reader(argv[1]);
+
+        std::string dump_path;
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string option = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for option '" + option + "'");
+            }
+            const std::string value = argv[++i];
+            if (option == "--dump")
+            {
+                dump_path = value;
+            }
+            else
+            {
+                throw std::runtime_error("unknown option '" + option + "'");
+            }
+        }
+
+        std::ofstream dump;
+        if (!dump_path.empty())
+        {
+            dump.open(dump_path);
+            if (!dump)
+            {
+                throw std::runtime_error("cannot open dump file '" + dump_path + "'");
+            }
+            dump << std::setprecision(std::numeric_limits<float>::max_digits10);
+        }
+
+        TrajectoryFrame frame;
+        size_t frame_count = 0;
+        uint64_t first_step = 0;
+        uint64_t last_step = 0;
+        size_t max_particles = 0;
+        while (reader.next(frame))
+        {
+            if (frame_count == 0)
+            {
+                first_step = frame.step;
+            }
+            last_step = frame.step;
+            max_particles = std::max(max_particles, frame.particle_count());
+            ++frame_count;
+            if (dump.is_open())
+            {
+                dump_frame(dump, frame);
+            }
+        }
+
+        std::cout << "interval: " << reader.interval() << '\n'
+                  << "frames: " << frame_count << '\n'
+                  << "first_step: " << first_step << '\n'
+                  << "last_step: " << last_step << '\n'
+                  << "max_particles: " << max_particles << '\n';
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "error: " << error.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}